@@ -18,6 +18,9 @@
 #ifndef AUDIOWMARK_AUDIO_BUFFER_HH
 #define AUDIOWMARK_AUDIO_BUFFER_HH
 
+#include <vector>
+#include <algorithm>
+
 #include <assert.h>
 
 class AudioBuffer
@@ -31,20 +34,37 @@ public:
   {
   }
   void
+  write_frames (const float *samples, size_t frames)
+  {
+    buffer.insert (buffer.end(), samples, samples + frames * n_channels);
+  }
+  void
   write_frames (const std::vector<float>& samples)
   {
     buffer.insert (buffer.end(), samples.begin(), samples.end());
   }
-  std::vector<float>
-  read_frames (size_t frames)
+  void
+  read_frames (float *samples, size_t frames)
   {
     assert (frames * n_channels <= buffer.size());
     const auto begin = buffer.begin();
     const auto end   = begin + frames * n_channels;
-    std::vector<float> result (begin, end);
+    std::copy (begin, end, samples);
     buffer.erase (begin, end);
+  }
+  std::vector<float>
+  read_frames (size_t frames)
+  {
+    std::vector<float> result (frames * n_channels);
+    read_frames (result.data(), frames);
     return result;
   }
+  void
+  skip_frames (size_t frames)
+  {
+    assert (frames * n_channels <= buffer.size());
+    buffer.erase (buffer.begin(), buffer.begin() + frames * n_channels);
+  }
   size_t
   can_read_frames() const
   {
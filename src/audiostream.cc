@@ -15,6 +15,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "config.h"
 #include "audiostream.hh"
 #include "wmcommon.hh"
 #include "sfinputstream.hh"
@@ -24,6 +25,10 @@
 #include "rawoutputstream.hh"
 #include "stdoutwavoutputstream.hh"
 #include "wavpipeinputstream.hh"
+#include "mmapwavinputstream.hh"
+#if HAVE_FFMPEG
+#include "ffinputstream.hh"
+#endif
 
 using std::string;
 
@@ -31,6 +36,46 @@ AudioStream::~AudioStream()
 {
 }
 
+Error
+AudioInputStream::read_frames (std::vector<float>& samples, size_t count)
+{
+  const int n_channels = this->n_channels();
+
+  /* vector capacity is kept, so repeated reads into the same vector don't allocate */
+  samples.resize (count * n_channels);
+
+  size_t n_frames_read = 0;
+  Error err = read_frames (samples.data(), count, n_frames_read);
+
+  samples.resize (n_frames_read * n_channels);
+  return err;
+}
+
+bool
+AudioInputStream::can_reopen() const
+{
+  return false;
+}
+
+std::unique_ptr<AudioInputStream>
+AudioInputStream::reopen (Error& err) const
+{
+  err = Error ("reopen not supported for this input stream");
+  return nullptr;
+}
+
+Error
+AudioInputStream::seek (size_t frame)
+{
+  return Error ("seek not supported for this input stream");
+}
+
+Error
+AudioOutputStream::write_frames (const std::vector<float>& frames)
+{
+  return write_frames (frames.data(), frames.size() / n_channels());
+}
+
 std::unique_ptr<AudioInputStream>
 AudioInputStream::create (const string& filename, Error& err)
 {
@@ -38,6 +83,14 @@ AudioInputStream::create (const string& filename, Error& err)
 
   if (Params::input_format == Format::AUTO)
     {
+      /* fast path for uncompressed wav files: no copies, no libsndfile */
+      if (filename != "-")
+        {
+          MmapWavInputStream *mmistream = new MmapWavInputStream();
+          in_stream.reset (mmistream);
+          if (!mmistream->open (filename))
+            return in_stream;
+        }
       SFInputStream *sistream = new SFInputStream();
       in_stream.reset (sistream);
       err = sistream->open (filename);
@@ -46,10 +99,22 @@ AudioInputStream::create (const string& filename, Error& err)
           MP3InputStream *mistream = new MP3InputStream();
           in_stream.reset (mistream);
 
-          err = mistream->open (filename);
+          err = mistream->open (filename, Params::mp3_fast_open ? MP3InputStream::Scan::HEADER : MP3InputStream::Scan::FULL);
           if (err)
             return nullptr;
         }
+#if HAVE_FFMPEG
+      else if (err && filename != "-")
+        {
+          /* other compressed formats (aac, m4a, opus, ...): decode in-process with ffmpeg */
+          FFInputStream *fistream = new FFInputStream();
+          std::unique_ptr<AudioInputStream> ff_stream (fistream);
+          if (fistream->open (filename))
+            return nullptr; // report libsndfile error
+          in_stream = std::move (ff_stream);
+          err = Error::Code::NONE;
+        }
+#endif
       else if (err)
         return nullptr;
     }
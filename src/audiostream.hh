@@ -48,7 +48,22 @@ public:
   virtual size_t n_frames() const = 0;
   virtual Encoding encoding() const = 0;
 
-  virtual Error read_frames (std::vector<float>& samples, size_t count) = 0;
+  /* read up to count frames into a caller owned buffer of count * n_channels() values
+   *  - n_frames_read is set to the number of frames that were actually read
+   *  - n_frames_read == 0 indicates eof
+   */
+  virtual Error read_frames (float *samples, size_t count, size_t& n_frames_read) = 0;
+
+  /* convenience version: samples is resized to the number of values read */
+  Error read_frames (std::vector<float>& samples, size_t count);
+
+  /* seekable streams (i.e. flac/mp3 files) can be decoded in parallel (see ParallelInputStream)
+   *  - reopen() creates another independent reader for the same file (without scanning it again)
+   *  - seek() sets the frame position for the next read_frames() call
+   */
+  virtual bool  can_reopen() const;
+  virtual std::unique_ptr<AudioInputStream> reopen (Error& err) const;
+  virtual Error seek (size_t frame);
 };
 
 class AudioOutputStream : public AudioStream
@@ -57,7 +72,10 @@ public:
   static std::unique_ptr<AudioOutputStream> create (const std::string& filename,
     int n_channels, int sample_rate, int bit_depth, Encoding encoding, size_t n_frames, Error& err);
 
-  virtual Error write_frames (const std::vector<float>& frames) = 0;
+  /* write n_frames frames (n_frames * n_channels() values) */
+  virtual Error write_frames (const float *frames, size_t n_frames) = 0;
+
+  Error write_frames (const std::vector<float>& frames);
   virtual Error close() = 0;
 };
 
@@ -33,7 +33,11 @@
 #include "wmcommon.hh"
 #include "shortcode.hh"
 #include "hls.hh"
+#include "video.hh"
+#include "bench.hh"
 #include "resample.hh"
+#include "fft.hh"
+#include "stats.hh"
 
 #include <assert.h>
 
@@ -60,17 +64,33 @@ print_usage()
   printf ("  * compare watermark message with expected message\n");
   printf ("    audiowmark cmp <watermarked_wav> <message_hex>\n");
   printf ("\n");
+  printf ("  * watermark the audio track of a video file (copies the video stream)\n");
+  printf ("    audiowmark video-add <input_video> <watermarked_video> <message_hex>\n");
+  printf ("\n");
+  printf ("  * retrieve message from the audio track of a video file\n");
+  printf ("    audiowmark video-get <watermarked_video>\n");
+  printf ("\n");
   printf ("  * generate 128-bit watermarking key, to be used with --key option\n");
   printf ("    audiowmark gen-key <key_file> [ --name <key_name> ]\n");
   printf ("\n");
+  printf ("  * benchmark add / get on generated input, write JSON report\n");
+  printf ("    audiowmark bench [ --seconds <s> ] [ --hls-segment <prepared_ts> ] [ --no-scaling ] [ --json <file> ]\n");
+  printf ("\n");
   printf ("Global options:\n");
   printf ("  -q, --quiet             disable information messages\n");
   printf ("  --strict                treat (minor) problems as errors\n");
+  printf ("  --fft-planning <p>      fft planning: estimate, measure or patient\n");
+  printf ("  --fft-wisdom <file>     load/save fft plans from/to file\n");
+  printf ("  --mp3-fast-open         open mp3 files without scanning the whole file\n");
+  printf ("  --stats <format>        print per phase timings and counters at exit (format: json)\n");
+  printf ("  --stats-file <file>     write stats to file instead of stderr\n");
   printf ("\n");
   printf ("Options for get / cmp:\n");
   printf ("  --detect-speed          detect and correct replay speed difference\n");
   printf ("  --detect-speed-patient  slower, more accurate speed detection\n");
+  printf ("  --detect-speed-reuse    reuse speed detected in first chunk for later chunks\n");
   printf ("  --json <file>           write JSON results into file\n");
+  printf ("  --sample-storage <s>    sample storage: float or int16 (less memory)\n");
   printf ("  --skip-block-type-b     prioritize block type A during decoding for improved reliability\n");
   printf ("\n");
   printf ("Options for add / get / cmp:\n");
@@ -100,6 +120,18 @@ print_usage_hls()
   printf ("  * watermark one HLS segment:\n");
   printf ("    audiowmark hls-add <input_ts> <output_ts> <message_hex>\n");
   printf ("\n");
+  printf ("  * create A/B variants (payload bit 0 and 1) of prepared HLS segments:\n");
+  printf ("    audiowmark hls-prepare-ab <input_dir> <output_dir> <playlist_name>\n");
+  printf ("\n");
+  printf ("  * retrieve payload from a stream delivered as A/B variants:\n");
+  printf ("    audiowmark get-ab <watermarked_wav>\n");
+  printf ("\n");
+  printf ("  * retrieve message from a (local) HLS playlist:\n");
+  printf ("    audiowmark get-hls <playlist>\n");
+  printf ("\n");
+  printf ("  * compare message from a (local) HLS playlist with expected message:\n");
+  printf ("    audiowmark cmp-hls <playlist> <message_hex>\n");
+  printf ("\n");
   printf ("Global options:\n");
   printf ("  -q, --quiet           disable information messages\n");
   printf ("  --strict              treat (minor) problems as errors\n");
@@ -109,6 +141,11 @@ print_usage_hls()
   printf ("  --short <bits>        enable short payload mode\n");
   printf ("  --key <file>          load watermarking key from file\n");
   printf ("  --bit-rate            set AAC bitrate\n");
+  printf ("  --ab-bits <n>         number of payload bits for A/B variants [%d]\n", Params::hls_ab_bits);
+  printf ("\n");
+  printf ("Options for hls-prepare:\n");
+  printf ("  --context <c>         context encoding: flac, flac-fast or raw\n");
+  printf ("  --state <file>        incremental mode for live playlists\n");
 }
 
 Format
@@ -400,14 +437,7 @@ test_speed (const Key& key, int seed)
 int
 test_gen_noise (const Key& key, const string& out_file, double seconds, int rate, int bits)
 {
-  const int channels = 2;
-
-  vector<float> noise;
-  Random rng (key, 0, /* there is no stream for this test */ Random::Stream::data_up_down);
-  for (size_t i = 0; i < size_t (rate * seconds) * channels; i++)
-    noise.push_back (rng.random_double() * 2 - 1);
-
-  WavData out_wav_data (noise, channels, rate, bits);
+  WavData out_wav_data = gen_noise (key, seconds, rate, bits);
   Error err = out_wav_data.save (out_file);
   if (err)
     {
@@ -849,6 +879,15 @@ parse_get_options (ArgParser& ap)
       error ("audiowmark: can only use one option: --detect-speed or --detect-speed-patient or --try-speed\n");
       exit (1);
     }
+  if (ap.parse_opt ("--detect-speed-reuse"))
+    {
+      if (!Params::detect_speed && !Params::detect_speed_patient)
+        {
+          error ("audiowmark: --detect-speed-reuse needs --detect-speed or --detect-speed-patient\n");
+          exit (1);
+        }
+      Params::detect_speed_reuse = true;
+    }
   if (ap.parse_opt ("--test-speed", f))
     {
       Params::test_speed = f;
@@ -866,6 +905,18 @@ parse_get_options (ArgParser& ap)
         }
       Params::get_chunk_size = f;
     }
+  if (ap.parse_opt ("--sample-storage", s))
+    {
+      if (s == "float")
+        Params::get_sample_format = WavData::Format::FLOAT;
+      else if (s == "int16")
+        Params::get_sample_format = WavData::Format::INT16;
+      else
+        {
+          error ("audiowmark: unsupported sample storage '%s' (use float or int16)\n", s.c_str());
+          exit (1);
+        }
+    }
   if (ap.parse_opt ("--sync-threshold", f))
     {
       Params::sync_threshold2 = f;
@@ -942,6 +993,37 @@ main (int argc, char **argv)
     {
       Params::strict = true;
     }
+  if (ap.parse_opt ("--mp3-fast-open"))
+    {
+      Params::mp3_fast_open = true;
+    }
+  string stats_format;
+  string stats_file = "-";
+  bool have_stats_file = ap.parse_opt ("--stats-file", stats_file);
+  if (ap.parse_opt ("--stats", stats_format) || have_stats_file)
+    {
+      if (stats_format != "" && stats_format != "json")
+        {
+          error ("audiowmark: unsupported stats format '%s' (use json)\n", stats_format.c_str());
+          return 1;
+        }
+      Stats::enable (stats_file);
+    }
+  string fft_planning = "estimate";
+  string fft_wisdom;
+  ap.parse_opt ("--fft-planning", fft_planning);
+  ap.parse_opt ("--fft-wisdom", fft_wisdom);
+  if (fft_planning == "estimate")
+    fft_set_planning (FFTPlanning::ESTIMATE, fft_wisdom);
+  else if (fft_planning == "measure")
+    fft_set_planning (FFTPlanning::MEASURE, fft_wisdom);
+  else if (fft_planning == "patient")
+    fft_set_planning (FFTPlanning::PATIENT, fft_wisdom);
+  else
+    {
+      error ("audiowmark: unsupported fft planning '%s' (use estimate, measure or patient)\n", fft_planning.c_str());
+      return 1;
+    }
   if (ap.parse_cmd ("hls-add"))
     {
       parse_shared_options (ap);
@@ -956,9 +1038,49 @@ main (int argc, char **argv)
     {
       ap.parse_opt ("--bit-rate", Params::hls_bit_rate);
 
+      string context;
+      if (ap.parse_opt ("--context", context))
+        {
+          if (context == "flac")
+            Params::hls_context = HLSContext::FLAC;
+          else if (context == "flac-fast")
+            Params::hls_context = HLSContext::FLAC_FAST;
+          else if (context == "raw")
+            Params::hls_context = HLSContext::RAW;
+          else
+            {
+              error ("audiowmark: unsupported context format '%s' (use flac, flac-fast or raw)\n", context.c_str());
+              return 1;
+            }
+        }
+
+      ap.parse_opt ("--state", Params::hls_state_file);
+
       args = parse_positional (ap, "input_dir", "output_dir", "playlist_name", "audio_master");
       return hls_prepare (args[0], args[1], args[2], args[3]);
     }
+  else if (ap.parse_cmd ("hls-prepare-ab"))
+    {
+      parse_shared_options (ap);
+
+      ap.parse_opt ("--bit-rate", Params::hls_bit_rate);
+      ap.parse_opt ("--ab-bits", Params::hls_ab_bits);
+
+      Key key = parse_key (ap);
+      args = parse_positional (ap, "input_dir", "output_dir", "playlist_name");
+      return hls_prepare_ab (key, args[0], args[1], args[2]);
+    }
+  else if (ap.parse_cmd ("get-ab"))
+    {
+      parse_shared_options (ap);
+      parse_get_options (ap);
+
+      ap.parse_opt ("--ab-bits", Params::hls_ab_bits);
+
+      vector<Key> key_list = parse_key_list (ap);
+      args = parse_positional (ap, "watermarked_wav");
+      return get_ab_watermark (key_list, args[0]);
+    }
   else if (ap.parse_cmd ("add"))
     {
       parse_shared_options (ap);
@@ -977,6 +1099,26 @@ main (int argc, char **argv)
       args = parse_positional (ap, "watermarked_wav");
       return get_watermark (key_list, args[0], /* no ber */ "");
     }
+  else if (ap.parse_cmd ("get-hls"))
+    {
+      parse_shared_options (ap);
+      parse_get_options (ap);
+
+      vector<Key> key_list = parse_key_list (ap);
+      args = parse_positional (ap, "playlist");
+      return hls_get (key_list, args[0], /* no ber */ "");
+    }
+  else if (ap.parse_cmd ("cmp-hls"))
+    {
+      parse_shared_options (ap);
+      parse_get_options (ap);
+
+      ap.parse_opt ("--expect-matches", Params::expect_matches);
+
+      vector<Key> key_list = parse_key_list (ap);
+      args = parse_positional (ap, "playlist", "message_hex");
+      return hls_get (key_list, args[0], args[1]);
+    }
   else if (ap.parse_cmd ("cmp"))
     {
       parse_shared_options (ap);
@@ -988,6 +1130,24 @@ main (int argc, char **argv)
       args = parse_positional (ap, "watermarked_wav", "message_hex");
       return get_watermark (key_list, args[0], args[1]);
     }
+  else if (ap.parse_cmd ("video-add"))
+    {
+      parse_shared_options (ap);
+      parse_add_options (ap);
+
+      Key key = parse_key (ap);
+      args = parse_positional (ap, "input_video", "watermarked_video", "message_hex");
+      return video_add (key, args[0], args[1], args[2]);
+    }
+  else if (ap.parse_cmd ("video-get"))
+    {
+      parse_shared_options (ap);
+      parse_get_options (ap);
+
+      vector<Key> key_list = parse_key_list (ap);
+      args = parse_positional (ap, "watermarked_video");
+      return video_get (key_list, args[0], /* no ber */ "");
+    }
   else if (ap.parse_cmd ("gen-key"))
     {
       string key_name;
@@ -995,6 +1155,21 @@ main (int argc, char **argv)
       args = parse_positional (ap, "key_file");
       return gen_key (args[0], key_name);
     }
+  else if (ap.parse_cmd ("bench"))
+    {
+      float seconds = 180;
+      string hls_segment;
+      string json_file = "-";
+
+      ap.parse_opt ("--seconds", seconds);
+      ap.parse_opt ("--hls-segment", hls_segment);
+      ap.parse_opt ("--json", json_file);
+      bool scaling = !ap.parse_opt ("--no-scaling");
+
+      Key key = parse_key (ap);
+      parse_positional (ap);
+      return bench (key, seconds, hls_segment, scaling, json_file);
+    }
   else if (ap.parse_cmd ("gentest"))
     {
       args = parse_positional (ap, "input_wav", "output_wav");
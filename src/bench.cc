@@ -0,0 +1,408 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <algorithm>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "config.h"
+#include "bench.hh"
+#include "hls.hh"
+#if HAVE_FFMPEG
+#include "hlsoutputstream.hh"
+#endif
+#include "shortcode.hh"
+#include "threadpool.hh"
+#include "utils.hh"
+
+using std::string;
+using std::vector;
+using std::map;
+using std::min;
+
+/*
+ * audiowmark bench: end-to-end benchmark on deterministic input (test-gen-noise)
+ *
+ * Each phase runs the code of the corresponding audiowmark command in a forked
+ * child process, with the normal command output suppressed. For each phase,
+ * wall clock time, cpu time (all threads), realtime factor and the peak RSS of
+ * the child are reported as JSON. Since every phase starts with a fresh copy of
+ * the (small) bench process, the peak RSS is not inflated by earlier phases.
+ */
+namespace
+{
+
+struct Measurement
+{
+  string name;
+  size_t n_threads = 0;
+  double audio_seconds = 0;
+  double wall = 0;
+  double cpu = 0;
+  long   max_rss_kb = 0;
+  bool   ok = false;
+};
+
+double
+cpu_time (const struct rusage& ru)
+{
+  return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+}
+
+Measurement
+measure (const string& name, double audio_seconds, size_t n_threads, std::function<int()> fun)
+{
+  Measurement m;
+  m.name = name;
+  m.n_threads = n_threads;
+  m.audio_seconds = audio_seconds;
+
+  fflush (stdout);
+  fflush (stderr);
+
+  const double start_wall = get_time();
+
+  pid_t pid = fork();
+  if (pid < 0)
+    {
+      error ("audiowmark: bench: fork failed: %s\n", strerror (errno));
+      return m;
+    }
+  if (pid == 0)
+    {
+      /* child: suppress info messages and results printed to stdout */
+      set_log_level (Log::WARNING);
+
+      const int null_fd = open ("/dev/null", O_WRONLY);
+      if (null_fd >= 0)
+        {
+          dup2 (null_fd, STDOUT_FILENO);
+          close (null_fd);
+        }
+      int rc = fun();
+      fflush (stdout);
+      fflush (stderr);
+      _exit (rc == 0 ? 0 : 1); // no atexit handlers (like --stats output) in the child
+    }
+
+  int status = 0;
+  struct rusage ru;
+  pid_t ret;
+  do
+    ret = wait4 (pid, &status, 0, &ru);
+  while (ret < 0 && errno == EINTR);
+
+  m.wall = get_time() - start_wall;
+  if (ret == pid)
+    {
+      m.ok = WIFEXITED (status) && WEXITSTATUS (status) == 0;
+      m.cpu = cpu_time (ru);
+      m.max_rss_kb = ru.ru_maxrss; // in kilobytes (linux)
+    }
+
+  info ("%-18s %3zd threads %9.3f s wall %9.3f s cpu %8.1f x realtime%s\n", name.c_str(), n_threads,
+        m.wall, m.cpu, m.audio_seconds / m.wall, m.ok ? "" : "  FAILED");
+  return m;
+}
+
+void
+print_json_measurements (FILE *out, const vector<Measurement>& measurements)
+{
+  for (size_t i = 0; i < measurements.size(); i++)
+    {
+      const Measurement& m = measurements[i];
+      fprintf (out, "    { \"name\": \"%s\", \"threads\": %zd, \"audio_seconds\": %.3f, \"wall\": %.4f, \"cpu\": %.4f, "
+               "\"x_realtime\": %.2f, \"max_rss_kb\": %ld, \"ok\": %s }%s\n",
+               m.name.c_str(), m.n_threads, m.audio_seconds, m.wall, m.cpu, m.audio_seconds / m.wall, m.max_rss_kb,
+               m.ok ? "true" : "false", i + 1 < measurements.size() ? "," : "");
+    }
+}
+
+#if HAVE_FFMPEG
+Error
+hls_segment_seconds (const string& filename, double& seconds)
+{
+  TSReader reader;
+
+  Error err = reader.load (filename);
+  if (err)
+    return err;
+
+  map<string, string> vars = reader.parse_vars ("vars");
+
+  std::unique_ptr<AudioInputStream> in_stream;
+  err = hls_open_context (reader, vars, in_stream);
+  if (err)
+    return err;
+
+  seconds = atof (vars["size"].c_str()) / in_stream->sample_rate();
+  return Error::Code::NONE;
+}
+#endif
+
+}
+
+#if HAVE_FFMPEG
+/* generate a segment like hls-prepare would (AAC segment + audio context + vars), so hls-add can be
+ * benchmarked without an external hls stream
+ */
+Error
+bench_gen_hls_segment (const WavData& wav_data, double segment_seconds, HLSContext context,
+                       const string& aac_ts, const string& prepared_ts, double& seconds)
+{
+  const int    n_channels = wav_data.n_channels();
+  const int    sample_rate = wav_data.sample_rate();
+  const int    bit_rate = 192000;
+  const string channel_layout = n_channels == 1 ? "mono" : "stereo";
+
+  /* segment starting 10 seconds into the input, aligned to AAC frames */
+  const size_t size = 1024 * size_t (segment_seconds * sample_rate / 1024);
+  const size_t start_pos = 1024 * size_t (10 * sample_rate / 1024);
+  const size_t ctx_3sec = 3 * sample_rate;
+  if (wav_data.n_values() < (start_pos + size + ctx_3sec) * n_channels)
+    return Error ("input too short for hls segment");
+
+  const auto& samples = wav_data.samples();
+  const vector<float> window (samples.begin() + (start_pos - ctx_3sec) * n_channels,
+                              samples.begin() + (start_pos + size + ctx_3sec) * n_channels);
+
+  /* input segment: AAC in mpegts, encoded the same way hls-add does */
+  const size_t prev_ctx = 3 * 1024;
+  HLSOutputStream aac_stream (n_channels, sample_rate, wav_data.bit_depth());
+  aac_stream.set_bit_rate (bit_rate);
+  aac_stream.set_channel_layout (channel_layout);
+
+  Error err = aac_stream.open (aac_ts, prev_ctx / 1024, size / 1024, double (start_pos) / sample_rate, ctx_3sec - prev_ctx);
+  if (err)
+    return err;
+  err = aac_stream.write_frames (window);
+  if (err)
+    return err;
+  err = aac_stream.close();
+  if (err)
+    return err;
+
+  /* prepared segment: input segment + context + vars */
+  map<string, string> vars;
+  vars["channel_layout"] = channel_layout;
+  vars["pts_start"] = string_printf ("%f", double (start_pos) / sample_rate);
+  vars["start_pos"] = string_printf ("%zd", start_pos);
+  vars["size"] = string_printf ("%zd", size);
+  vars["prev_size"] = string_printf ("%zd", ctx_3sec);
+  vars["bit_rate"] = string_printf ("%d", bit_rate);
+
+  string entry_name;
+  vector<unsigned char> context_data;
+  err = hls_encode_context (context, window, n_channels, sample_rate, entry_name, context_data, vars);
+  if (err)
+    return err;
+
+  TSWriter writer;
+  writer.append_data (entry_name, std::move (context_data));
+  writer.append_vars ("vars", vars);
+
+  err = writer.process (aac_ts, prepared_ts);
+  if (err)
+    return err;
+
+  seconds = double (size) / sample_rate;
+  return Error::Code::NONE;
+}
+#endif
+
+int
+bench (const Key& key, double seconds, const string& hls_segment, bool scaling, const string& json_file)
+{
+  const int    sample_rate  = 44100;
+  const double clip_seconds = 20;
+  const string message      = "0123456789abcdef0011223344556677";
+  const size_t short_bits   = 20;
+  const string short_message = "abcde";
+
+  if (seconds < 2 * clip_seconds)
+    {
+      error ("audiowmark: bench: input length must be at least %.0f seconds\n", 2 * clip_seconds);
+      return 1;
+    }
+
+  const char *tmpdir = getenv ("TMPDIR");
+  string dir_template = string (tmpdir ? tmpdir : "/tmp") + "/audiowmark-bench-XXXXXX";
+  vector<char> dir_buffer (dir_template.begin(), dir_template.end());
+  dir_buffer.push_back (0);
+  if (!mkdtemp (dir_buffer.data()))
+    {
+      error ("audiowmark: bench: unable to create temporary directory: %s\n", strerror (errno));
+      return 1;
+    }
+  const string dir = dir_buffer.data();
+  const string in_wav = dir + "/in.wav";
+  const string out_wav = dir + "/out.wav";
+  const string clip_wav = dir + "/clip.wav";
+  const string short_wav = dir + "/short.wav";
+  const string hls_aac = dir + "/aac.ts";
+  const string hls_prep = dir + "/prep.ts";
+  const string hls_out = dir + "/out.ts";
+
+  auto cleanup = [&]()
+    {
+      for (auto filename : { in_wav, out_wav, clip_wav, short_wav, hls_aac, hls_prep, hls_out })
+        unlink (filename.c_str());
+      rmdir (dir.c_str());
+    };
+
+  /* deterministic input: same as audiowmark test-gen-noise (only kept in memory while saving, so
+   * that the forked phases don't inherit it)
+   */
+  Error err;
+#if HAVE_FFMPEG
+  double hls_seconds = 0;
+#endif
+  {
+    WavData in_data = gen_noise (key, seconds, sample_rate, 16);
+    err = in_data.save (in_wav);
+    if (err)
+      {
+        error ("audiowmark: bench: error saving %s: %s\n", in_wav.c_str(), err.message());
+        cleanup();
+        return 1;
+      }
+#if HAVE_FFMPEG
+    /* hls-add segment: either a segment given by the user, or generated from the input */
+    if (hls_segment.empty())
+      err = bench_gen_hls_segment (in_data, 10, HLSContext::FLAC, hls_aac, hls_prep, hls_seconds);
+    else
+      err = hls_segment_seconds (hls_segment, hls_seconds);
+    if (err)
+      {
+        error ("audiowmark: bench: hls segment %s: %s\n", hls_segment.empty() ? hls_prep.c_str() : hls_segment.c_str(), err.message());
+        cleanup();
+        return 1;
+      }
+#else
+    if (!hls_segment.empty())
+      {
+        error ("audiowmark: bench: hls support is not available in this build of audiowmark\n");
+        cleanup();
+        return 1;
+      }
+#endif
+  }
+
+  const size_t n_cpus = std::thread::hardware_concurrency();
+  const vector<Key> key_list { key };
+  vector<Measurement> phases;
+
+  phases.push_back (measure ("add", seconds, n_cpus, [&]() { return add_watermark (key, in_wav, out_wav, message); }));
+  phases.push_back (measure ("get", seconds, n_cpus, [&]() { return get_watermark (key_list, out_wav, message); }));
+
+  /* clip decoder: short excerpt of the watermarked file */
+  {
+    WavData out_data;
+    err = out_data.load (out_wav);
+    if (!err)
+      {
+        const size_t clip_start = out_data.n_values() / 2 / out_data.n_channels() * out_data.n_channels();
+        const size_t clip_values = size_t (clip_seconds * out_data.sample_rate()) * out_data.n_channels();
+
+        vector<float> clip (out_data.samples().begin() + clip_start, out_data.samples().begin() + clip_start + clip_values);
+        err = WavData (clip, out_data.n_channels(), out_data.sample_rate(), out_data.bit_depth()).save (clip_wav);
+      }
+  }
+  if (err)
+    {
+      error ("audiowmark: bench: error creating clip: %s\n", err.message());
+      cleanup();
+      return 1;
+    }
+  phases.push_back (measure ("get-clip", clip_seconds, n_cpus, [&]() { return get_watermark (key_list, clip_wav, message); }));
+
+  Params::detect_speed = true;
+  phases.push_back (measure ("get-detect-speed", seconds, n_cpus, [&]() { return get_watermark (key_list, out_wav, message); }));
+  Params::detect_speed = false;
+
+  /* short payload */
+  const size_t payload_size = Params::payload_size;
+  Params::payload_size = short_bits;
+  Params::payload_short = true;
+  short_code_init (short_bits);
+
+  phases.push_back (measure ("add-short", seconds, n_cpus, [&]() { return add_watermark (key, in_wav, short_wav, short_message); }));
+  phases.push_back (measure ("get-short", seconds, n_cpus, [&]() { return get_watermark (key_list, short_wav, short_message); }));
+
+  Params::payload_size = payload_size;
+  Params::payload_short = false;
+
+#if HAVE_FFMPEG
+  const string hls_in = hls_segment.empty() ? hls_prep : hls_segment;
+  phases.push_back (measure ("hls-add", hls_seconds, n_cpus, [&]() { return hls_add (key, hls_in, hls_out, message); }));
+#endif
+
+  /* thread scaling of watermark detection, which is the most parallel part */
+  vector<Measurement> scaling_results;
+  if (scaling)
+    {
+      for (size_t n = 1; ; n *= 2)
+        {
+          const size_t n_threads = min (n, n_cpus);
+
+          ThreadPool::set_default_n_threads (n_threads);
+          scaling_results.push_back (measure ("get", seconds, n_threads, [&]() { return get_watermark (key_list, out_wav, message); }));
+
+          if (n_threads == n_cpus)
+            break;
+        }
+      ThreadPool::set_default_n_threads (0);
+    }
+  cleanup();
+
+  FILE *out = fopen (json_file == "-" ? "/dev/stdout" : json_file.c_str(), "w");
+  if (!out)
+    {
+      error ("audiowmark: bench: failed to open %s: %s\n", json_file.c_str(), strerror (errno));
+      return 1;
+    }
+  fprintf (out, "{ \"audio_seconds\": %.3f,\n", seconds);
+  fprintf (out, "  \"sample_rate\": %d,\n", sample_rate);
+  fprintf (out, "  \"cpus\": %zd,\n", n_cpus);
+  fprintf (out, "  \"phases\": [\n");
+  print_json_measurements (out, phases);
+  fprintf (out, "  ],\n");
+  fprintf (out, "  \"scaling\": [\n");
+  print_json_measurements (out, scaling_results);
+  fprintf (out, "  ]\n");
+  fprintf (out, "}\n");
+  fclose (out);
+
+  for (const auto& m : phases)
+    if (!m.ok)
+      return 1;
+  for (const auto& m : scaling_results)
+    if (!m.ok)
+      return 1;
+  return 0;
+}
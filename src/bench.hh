@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIOWMARK_BENCH_HH
+#define AUDIOWMARK_BENCH_HH
+
+#include <string>
+
+#include "wmcommon.hh"
+
+int bench (const Key& key, double seconds, const std::string& hls_segment, bool scaling, const std::string& json_file);
+
+/* only available in builds with ffmpeg */
+Error bench_gen_hls_segment (const WavData& wav_data, double segment_seconds, HLSContext context,
+                             const std::string& aac_ts, const std::string& prepared_ts, double& seconds);
+
+#endif /* AUDIOWMARK_BENCH_HH */
@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <random>
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "utils.hh"
+#include "convcode.hh"
+#include "shortcode.hh"
+#include "syncfinder.hh"
+#include "wmspeed.hh"
+#include "wmcommon.hh"
+#include "limiter.hh"
+#include "rawconverter.hh"
+#include "resample.hh"
+#include "dspkernels.hh"
+
+using std::string;
+using std::vector;
+
+/*
+ * benchkernels: microbenchmarks for the hot spots of watermark generation and
+ * detection. Each benchmark times one kernel on fixed (deterministic) data,
+ * which makes it possible to compare the performance before and after
+ * changing the code of the kernel.
+ *
+ * After a warmup phase (which also determines how many operations are needed
+ * for one repetition to take at least min_rep_time), the kernel is timed
+ * for a number of repetitions, and we report median, minimum and standard
+ * deviation of the time per operation, as well as the throughput (bytes of
+ * kernel input per second, based on the median; not for SpeedSync::compare,
+ * which works on precomputed magnitudes).
+ *
+ * Usage: benchkernels [--reps <n>] [<name> ...]
+ *
+ * If names are given, only benchmarks which contain one of them are run.
+ */
+class KernelBench
+{
+  vector<string> m_patterns;
+  int            m_reps = 15;
+
+  static constexpr double min_rep_time = 0.02;
+  static constexpr double warmup_time  = 0.1;
+public:
+  KernelBench (int argc, char **argv)
+  {
+    for (int i = 1; i < argc; i++)
+      {
+        if (strcmp (argv[i], "--reps") == 0 && i + 1 < argc)
+          m_reps = std::max (atoi (argv[++i]), 1);
+        else
+          m_patterns.push_back (argv[i]);
+      }
+  }
+  bool
+  enabled (const string& name) const
+  {
+    if (m_patterns.empty())
+      return true;
+
+    for (const auto& pattern : m_patterns)
+      if (name.find (pattern) != string::npos)
+        return true;
+    return false;
+  }
+  void
+  run (const string& name, size_t bytes_per_op, const std::function<void()>& op)
+  {
+    if (!enabled (name))
+      return;
+
+    /* warmup: run op until warmup_time is over, measure the time per op */
+    size_t n_warmup = 0;
+    const double warmup_start = get_time();
+    double warmup_end;
+    do
+      {
+        op();
+        n_warmup++;
+        warmup_end = get_time();
+      }
+    while (warmup_end - warmup_start < warmup_time);
+
+    const double est_op_time = (warmup_end - warmup_start) / n_warmup;
+    const size_t ops_per_rep = std::max<size_t> (ceil (min_rep_time / est_op_time), 1);
+
+    vector<double> ns_per_op;
+    for (int rep = 0; rep < m_reps; rep++)
+      {
+        const double start = get_time();
+        for (size_t i = 0; i < ops_per_rep; i++)
+          op();
+        const double end = get_time();
+
+        ns_per_op.push_back ((end - start) * 1e9 / ops_per_rep);
+      }
+    std::sort (ns_per_op.begin(), ns_per_op.end());
+
+    const double median = ns_per_op[ns_per_op.size() / 2];
+    double mean = 0, var = 0;
+    for (auto t : ns_per_op)
+      mean += t;
+    mean /= ns_per_op.size();
+    for (auto t : ns_per_op)
+      var += (t - mean) * (t - mean);
+    const double stddev = sqrt (var / ns_per_op.size());
+
+    string throughput;
+    if (bytes_per_op)
+      throughput = string_printf ("%10.2f MB/s", bytes_per_op / median * 1e3);
+    else
+      throughput = string_printf ("%10s     ", "-");
+
+    printf ("%-32s %14.1f ns/op  min %14.1f  stddev %5.1f%%  %s  [%d x %zd ops]\n",
+            name.c_str(), median, ns_per_op.front(), 100 * stddev / mean, throughput.c_str(), m_reps, ops_per_rep);
+    fflush (stdout);
+  }
+};
+
+class SyncFinderBench
+{
+public:
+  static void
+  run (KernelBench& kb, const Key& key, const WavData& wav_data)
+  {
+    const size_t n_bands = Params::max_band - Params::min_band + 1;
+    const size_t total_frame_count = mark_sync_frame_count() + mark_data_frame_count();
+
+    SyncFinder sync_finder;
+    sync_finder.scan_silence (wav_data);
+
+    vector<float> fft_db;
+    vector<char>  have_frames;
+
+    /* one job of sync_fft_parallel (32 frames) */
+    const size_t fft_frames = 32;
+    kb.run ("SyncFinder::sync_fft", fft_frames * Params::frame_size * wav_data.n_channels() * sizeof (float), [&]()
+      {
+        sync_finder.sync_fft (wav_data, 0, fft_frames, fft_db, have_frames, {});
+      });
+
+    /* one sync_decode call for a full block, as used by search_approx */
+    sync_finder.sync_fft (wav_data, 0, total_frame_count, fft_db, have_frames, {});
+    assert (fft_db.size() == total_frame_count * n_bands);
+
+    const auto sync_bits = SyncFinder::get_sync_bits (key, SyncFinder::Mode::BLOCK);
+    kb.run ("SyncFinder::sync_decode", fft_db.size() * sizeof (float), [&]()
+      {
+        sync_finder.sync_decode (sync_bits, 0, fft_db, have_frames);
+      });
+  }
+};
+
+static vector<float>
+random_vec (std::mt19937& rng, size_t n, float min_value, float max_value)
+{
+  std::uniform_real_distribution<float> dist (min_value, max_value);
+
+  vector<float> v (n);
+  for (auto& x : v)
+    x = dist (rng);
+  return v;
+}
+
+static void
+bench_codes (KernelBench& kb, std::mt19937& rng)
+{
+  /* soft decoding of a full (noisy) 128 bit payload */
+  for (auto block_type : { ConvBlockType::a, ConvBlockType::b, ConvBlockType::ab })
+    {
+      vector<int> in_bits;
+      while (in_bits.size() != 128)
+        in_bits.push_back (rng() & 1);
+
+      vector<float> coded_bits;
+      for (auto b : conv_encode (block_type, in_bits))
+        coded_bits.push_back (b + std::normal_distribution<float> (0, 0.3) (rng));
+
+      const char *name = block_type == ConvBlockType::a ? "a" : (block_type == ConvBlockType::b ? "b" : "ab");
+      kb.run (string ("conv_decode_soft/") + name, coded_bits.size() * sizeof (float), [&]()
+        {
+          conv_decode_soft (block_type, coded_bits);
+        });
+    }
+
+  /* block decoding of short payloads */
+  for (size_t k : { 12, 16, 20 })
+    {
+      short_code_init (k);
+
+      vector<int> in_bits;
+      while (in_bits.size() != k)
+        in_bits.push_back (rng() & 1);
+
+      const vector<int> coded_bits = short_encode_blk (in_bits);
+      kb.run (string_printf ("short_decode_blk/%zd", k), coded_bits.size() * sizeof (int), [&]()
+        {
+          short_decode_blk (coded_bits);
+        });
+    }
+}
+
+static void
+bench_dsp (KernelBench& kb, std::mt19937& rng, const WavData& wav_data)
+{
+  const int n_channels = wav_data.n_channels();
+
+  /* FFTAnalyzer::run_fft: one frame (all channels) */
+  {
+    FFTAnalyzer fft_analyzer (n_channels);
+    vector<float> samples (wav_data.samples().begin(), wav_data.samples().begin() + Params::frame_size * n_channels);
+
+    kb.run ("FFTAnalyzer::run_fft", samples.size() * sizeof (float), [&]()
+      {
+        fft_analyzer.run_fft (samples, 0);
+      });
+  }
+
+  /* apply_frame_mod (wmadd.cc) is a thin wrapper around frame_mod_delta, so we time that for one channel */
+  {
+    const size_t n_bins = Params::frame_size / 2 + 1;
+    const float  min_mag = 1e-7;
+    vector<float> fft_out = random_vec (rng, n_bins * 2, -1, 1);
+    vector<float> exponents (Params::max_band + 1);
+    for (int i = Params::min_band; i <= Params::max_band; i++)
+      exponents[i] = (rng() & 1) ? Params::water_delta : -Params::water_delta;
+
+    vector<float> fft_delta_spect (n_bins * 2);
+    kb.run ("apply_frame_mod", exponents.size() * 2 * sizeof (float), [&]()
+      {
+        dsp_kernels().frame_mod_delta (fft_out.data(), exponents.data(), fft_delta_spect.data(), exponents.size(), min_mag);
+      });
+  }
+
+  /* Limiter::process: 1024 frames, 10% above ceiling */
+  {
+    Limiter limiter (n_channels, wav_data.sample_rate());
+    limiter.set_block_size_ms (1000);
+    limiter.set_ceiling (0.9);
+
+    vector<float> samples (wav_data.samples().begin(), wav_data.samples().begin() + 1024 * n_channels);
+    for (auto& s : samples)
+      s *= 1.1;
+
+    kb.run ("Limiter::process", samples.size() * sizeof (float), [&]()
+      {
+        limiter.process (samples);
+      });
+  }
+
+  /* RawConverter: 1024 frames in both directions, for each format */
+  const size_t n_samples = 1024 * n_channels;
+  struct RawFmt {
+    const char *name;
+    int         bit_depth;
+    Encoding    encoding;
+  };
+  for (auto raw_fmt : { RawFmt { "s16le", 16, Encoding::SIGNED },
+                        RawFmt { "s24le", 24, Encoding::SIGNED },
+                        RawFmt { "s32le", 32, Encoding::SIGNED },
+                        RawFmt { "f32le", 32, Encoding::FLOAT } })
+    {
+      RawFormat format (n_channels, wav_data.sample_rate(), raw_fmt.bit_depth);
+      format.set_encoding (raw_fmt.encoding);
+
+      Error err;
+      std::unique_ptr<RawConverter> converter (RawConverter::create (format, err));
+      if (err)
+        {
+          fprintf (stderr, "benchkernels: RawConverter::create failed: %s\n", err.message());
+          exit (1);
+        }
+      const size_t n_bytes = n_samples * raw_fmt.bit_depth / 8;
+      vector<unsigned char> bytes (n_bytes);
+      vector<float> samples (wav_data.samples().begin(), wav_data.samples().begin() + n_samples);
+
+      kb.run (string ("RawConverter::to_raw/") + raw_fmt.name, n_samples * sizeof (float), [&]()
+        {
+          converter->to_raw (samples.data(), bytes.data(), n_samples);
+        });
+      kb.run (string ("RawConverter::from_raw/") + raw_fmt.name, n_bytes, [&]()
+        {
+          converter->from_raw (bytes.data(), samples.data(), n_samples);
+        });
+    }
+
+  /* BufferedResamplerImpl: resample blocks of 1024 frames (using zita Resampler for 48000 and VResampler for 33333) */
+  for (int new_rate : { 48000, 33333 })
+    {
+      std::unique_ptr<ResamplerImpl> resampler (ResamplerImpl::create (n_channels, wav_data.sample_rate(), new_rate));
+      assert (resampler);
+
+      vector<float> samples (wav_data.samples().begin(), wav_data.samples().begin() + 1024 * n_channels);
+      kb.run (string_printf ("BufferedResamplerImpl/%d-%d", wav_data.sample_rate(), new_rate), samples.size() * sizeof (float), [&]()
+        {
+          resampler->write_frames (samples);
+          resampler->read_frames (resampler->can_read_frames());
+        });
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  KernelBench kb (argc, argv);
+  std::mt19937 rng (42);
+
+  Key key;
+  key.set_test_key (0);
+
+  /* two full blocks (sync + data) of audio */
+  const double seconds = 2.0 * (mark_sync_frame_count() + mark_data_frame_count()) * Params::frame_size / Params::mark_sample_rate;
+  WavData wav_data = gen_noise (key, seconds, Params::mark_sample_rate, 16);
+
+  bench_codes (kb, rng);
+  SyncFinderBench::run (kb, key, wav_data);
+
+  if (kb.enabled ("SpeedSync::compare"))
+    speed_sync_compare_bench (key, wav_data, [&] (const std::function<void()>& compare)
+      {
+        kb.run ("SpeedSync::compare", 0, compare);
+      });
+
+  bench_dsp (kb, rng, wav_data);
+  return 0;
+}
@@ -17,6 +17,7 @@
 
 #include "utils.hh"
 #include "convcode.hh"
+#include "stats.hh"
 
 #include <array>
 #include <algorithm>
@@ -130,6 +131,8 @@ conv_encode (ConvBlockType block_type, const vector<int>& in_bits)
 vector<int>
 conv_decode_soft (ConvBlockType block_type, const vector<float>& coded_bits, float *error_out)
 {
+  ScopedStat stat (Stat::VITERBI);
+
   auto generators = get_block_type_generators (block_type);
   unsigned int rate = generators.size();
   vector<int> decoded_bits;
@@ -0,0 +1,933 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dspkernels.hh"
+#include "utils.hh"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#if defined (__x86_64__) || defined (__i386__)
+#define AUDIOWMARK_DSP_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined (__aarch64__)
+#define AUDIOWMARK_DSP_NEON 1
+#include <arm_neon.h>
+#endif
+
+using std::vector;
+
+/* ---------------------------- scalar reference ---------------------------- */
+
+namespace scalar
+{
+
+static void
+window_deinterleave (const float *in, size_t stride, const float *window, float *out, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    out[i] = in[i * stride] * window[i];
+}
+
+static void
+add_db_from_complex (const float *in, float *db_out, size_t n, float min_db)
+{
+  const float log2_db_factor = 3.01029995663981; // 10 / log2 (10)
+
+  for (size_t i = 0; i < n; i++)
+    {
+      const float abs2 = in[2 * i] * in[2 * i] + in[2 * i + 1] * in[2 * i + 1];
+      db_out[i] += abs2 > 0 ? log2f (abs2) * log2_db_factor : min_db;
+    }
+}
+
+static void
+sum_up_down (const float *db, const int *up, const int *down, size_t n, float *umag, float *dmag)
+{
+  for (size_t i = 0; i < n; i++)
+    {
+      *umag += db[up[i]];
+      *dmag += db[down[i]];
+    }
+}
+
+static void
+frame_mod_delta (const float *in, const float *exponent, float *out, size_t n, float min_mag)
+{
+  for (size_t i = 0; i < n; i++)
+    {
+      const float mag = sqrtf (in[2 * i] * in[2 * i] + in[2 * i + 1] * in[2 * i + 1]);
+      if (exponent[i] != 0 && mag > min_mag)
+        {
+          const float factor = powf (mag, exponent[i]) - 1;
+          out[2 * i] = in[2 * i] * factor;
+          out[2 * i + 1] = in[2 * i + 1] * factor;
+        }
+    }
+}
+
+static float
+abs_max (const float *in, size_t n, float init)
+{
+  float maximum = init;
+  for (size_t i = 0; i < n; i++)
+    maximum = std::max (maximum, fabsf (in[i]));
+  return maximum;
+}
+
+static void
+scale_ramp (const float *in, float *out, size_t n_frames, size_t n_channels, float scale_start, float scale_step)
+{
+  for (size_t i = 0; i < n_frames; i++)
+    {
+      const float scale = scale_start + i * scale_step;
+
+      for (size_t c = 0; c < n_channels; c++)
+        out[i * n_channels + c] = in[i * n_channels + c] * scale;
+    }
+}
+
+static void
+add (float *out, const float *in, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    out[i] += in[i];
+}
+
+static void
+power_sum (const float *a, const float *b, size_t n, double *power_a, double *power_b)
+{
+  for (size_t i = 0; i < n; i++)
+    {
+      const double da = a[i];
+      const double db = b[i];
+
+      *power_a += da * da;
+      *power_b += db * db;
+    }
+}
+
+static void
+log2_block (const float *in, float *out, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    out[i] = log2f (in[i]);
+}
+
+static void
+pow_block (const float *in, float exponent, float *out, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    out[i] = powf (in[i], exponent);
+}
+
+/* raw sample conversion: same normalization and clipping as RawConverter */
+static const float s32_norm = 1.0 / 0x80000000LL;
+
+static inline int32_t
+float_to_s32_clip (float f)
+{
+  const float snorm = f * 2147483648.f;
+
+  if (snorm >= 2147483648.f)
+    return 0x7fffffff;
+  else if (snorm <= -2147483648.f)
+    return -0x7fffffff - 1;
+  else
+    return snorm;
+}
+
+static inline int16_t
+float_to_s16_clip (float f)
+{
+  const float snorm = f * 32768.f;
+
+  if (snorm >= 32767.f)
+    return 32767;
+  else if (snorm <= -32768.f)
+    return -32768;
+  else
+    return snorm;
+}
+
+static void
+s16le_to_float (const unsigned char *in, float *out, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    out[i] = int32_t ((in[2 * i] << 16) | (uint32_t (in[2 * i + 1]) << 24)) * s32_norm;
+}
+
+static void
+s24le_to_float (const unsigned char *in, float *out, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    out[i] = int32_t ((in[3 * i] << 8) | (in[3 * i + 1] << 16) | (uint32_t (in[3 * i + 2]) << 24)) * s32_norm;
+}
+
+static void
+s32le_to_float (const unsigned char *in, float *out, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    out[i] = int32_t (in[4 * i] | (in[4 * i + 1] << 8) | (in[4 * i + 2] << 16) | (uint32_t (in[4 * i + 3]) << 24)) * s32_norm;
+}
+
+static void
+float_to_s16le (const float *in, unsigned char *out, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    {
+      const int16_t s = float_to_s16_clip (in[i]);
+      out[2 * i]     = s;
+      out[2 * i + 1] = s >> 8;
+    }
+}
+
+static void
+float_to_s24le (const float *in, unsigned char *out, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    {
+      const int32_t s = float_to_s32_clip (in[i]);
+      out[3 * i]     = s >> 8;
+      out[3 * i + 1] = s >> 16;
+      out[3 * i + 2] = s >> 24;
+    }
+}
+
+static void
+float_to_s32le (const float *in, unsigned char *out, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    {
+      const int32_t s = float_to_s32_clip (in[i]);
+      out[4 * i]     = s;
+      out[4 * i + 1] = s >> 8;
+      out[4 * i + 2] = s >> 16;
+      out[4 * i + 3] = s >> 24;
+    }
+}
+
+static void
+float_to_f32le (const float *in, unsigned char *out, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    {
+      /* same as float_clip: NaN is passed through */
+      const float f = in[i] >= 1 ? 1 : (in[i] <= -1 ? -1 : in[i]);
+      uint32_t u;
+      memcpy (&u, &f, 4);
+      out[4 * i]     = u;
+      out[4 * i + 1] = u >> 8;
+      out[4 * i + 2] = u >> 16;
+      out[4 * i + 3] = u >> 24;
+    }
+}
+
+static const DSPKernels kernels =
+{
+  .name                = "scalar",
+  .window_deinterleave = window_deinterleave,
+  .add_db_from_complex = add_db_from_complex,
+  .sum_up_down         = sum_up_down,
+  .frame_mod_delta     = frame_mod_delta,
+  .abs_max             = abs_max,
+  .scale_ramp          = scale_ramp,
+  .add                 = add,
+  .power_sum           = power_sum,
+  .log2_block          = log2_block,
+  .pow_block           = pow_block,
+  .s16le_to_float      = s16le_to_float,
+  .s24le_to_float      = s24le_to_float,
+  .s32le_to_float      = s32le_to_float,
+  .float_to_s16le      = float_to_s16le,
+  .float_to_s24le      = float_to_s24le,
+  .float_to_s32le      = float_to_s32le,
+  .float_to_f32le      = float_to_f32le,
+};
+
+}
+
+/* ---------------------------- x86 ---------------------------- */
+
+#if AUDIOWMARK_DSP_X86
+
+/* compile everything between TARGET_BEGIN and TARGET_END for one instruction set */
+#define AUDIOWMARK_DSP_PRAGMA(x) _Pragma (#x)
+#if defined (AUDIOWMARK_COMP_CLANG)
+  #define AUDIOWMARK_DSP_TARGET_BEGIN(t) AUDIOWMARK_DSP_PRAGMA (clang attribute push (__attribute__((target (t))), apply_to = function))
+  #define AUDIOWMARK_DSP_TARGET_END      AUDIOWMARK_DSP_PRAGMA (clang attribute pop)
+#else
+  #define AUDIOWMARK_DSP_TARGET_BEGIN(t) AUDIOWMARK_DSP_PRAGMA (GCC push_options) AUDIOWMARK_DSP_PRAGMA (GCC target (t))
+  #define AUDIOWMARK_DSP_TARGET_END      AUDIOWMARK_DSP_PRAGMA (GCC pop_options)
+#endif
+
+AUDIOWMARK_DSP_TARGET_BEGIN ("sse4.1")
+
+namespace sse4
+{
+
+struct S
+{
+  static constexpr const char *name = "sse4.1";
+  static constexpr int W = 4;
+
+  typedef __m128  F;
+  typedef __m128i I;
+  typedef __m128  M;
+
+  static F load (const float *p)        { return _mm_loadu_ps (p); }
+  static void store (float *p, F v)     { _mm_storeu_ps (p, v); }
+  static F set1 (float f)               { return _mm_set1_ps (f); }
+  static I set1_i (int i)               { return _mm_set1_epi32 (i); }
+  static F min (F a, F b)               { return _mm_min_ps (a, b); }
+  static F max (F a, F b)               { return _mm_max_ps (a, b); }
+  static F abs (F a)                    { return _mm_and_ps (a, _mm_castsi128_ps (_mm_set1_epi32 (0x7fffffff))); }
+  static F fmadd (F a, F b, F c)        { return _mm_add_ps (_mm_mul_ps (a, b), c); }
+  static F round (F a)                  { return _mm_round_ps (a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+  static M lt (F a, F b)                { return _mm_cmplt_ps (a, b); }
+  static M gt (F a, F b)                { return _mm_cmpgt_ps (a, b); }
+  static M ne (F a, F b)                { return _mm_cmpneq_ps (a, b); }
+  static M and_m (M a, M b)             { return _mm_and_ps (a, b); }
+  static F select (M m, F a, F b)       { return _mm_blendv_ps (b, a, m); }
+  static I as_int (F a)                 { return _mm_castps_si128 (a); }
+  static F as_float (I a)               { return _mm_castsi128_ps (a); }
+  static F cvt (I a)                    { return _mm_cvtepi32_ps (a); }
+  static I cvt_i (F a)                  { return _mm_cvtps_epi32 (a); }
+  static I and_i (I a, I b)             { return _mm_and_si128 (a, b); }
+  static I or_i (I a, I b)              { return _mm_or_si128 (a, b); }
+  static I add_i (I a, I b)             { return _mm_add_epi32 (a, b); }
+  static I srl23 (I a)                  { return _mm_srli_epi32 (a, 23); }
+  static I sll23 (I a)                  { return _mm_slli_epi32 (a, 23); }
+
+  static void
+  deinterleave (F a, F b, F& even, F& odd)
+  {
+    even = _mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0));
+    odd  = _mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1));
+  }
+  static void
+  interleave (F even, F odd, F& a, F& b)
+  {
+    a = _mm_unpacklo_ps (even, odd);
+    b = _mm_unpackhi_ps (even, odd);
+  }
+  static F
+  gather (const float *base, const int *idx)
+  {
+    return _mm_setr_ps (base[idx[0]], base[idx[1]], base[idx[2]], base[idx[3]]);
+  }
+  static float
+  reduce_add (F a)
+  {
+    a = _mm_add_ps (a, _mm_movehl_ps (a, a));
+    a = _mm_add_ss (a, _mm_shuffle_ps (a, a, 1));
+    return _mm_cvtss_f32 (a);
+  }
+  static float
+  reduce_max (F a)
+  {
+    a = _mm_max_ps (a, _mm_movehl_ps (a, a));
+    a = _mm_max_ss (a, _mm_shuffle_ps (a, a, 1));
+    return _mm_cvtss_f32 (a);
+  }
+};
+
+/* raw sample conversion (16 samples per iteration for 24 bit = 48 bytes = 3 vectors) */
+
+static inline __m128i
+float_to_s32_clip (__m128 f)
+{
+  const __m128 snorm = _mm_mul_ps (f, _mm_set1_ps (2147483648.f));
+
+  /* cvttps gives 0x80000000 for out of range values, which is correct for negative values,
+   * positive overflow is fixed by xor with the all ones mask -> 0x7fffffff */
+  const __m128i pos_overflow = _mm_castps_si128 (_mm_cmpge_ps (snorm, _mm_set1_ps (2147483648.f)));
+  return _mm_xor_si128 (_mm_cvttps_epi32 (snorm), pos_overflow);
+}
+
+static inline __m128i
+float_to_s16_clip (__m128 f)
+{
+  __m128 snorm = _mm_mul_ps (f, _mm_set1_ps (32768.f));
+  snorm = _mm_min_ps (_mm_max_ps (snorm, _mm_set1_ps (-32768.f)), _mm_set1_ps (32767.f));
+  return _mm_cvttps_epi32 (snorm);
+}
+
+/* 4 x 12 bytes (in the low bytes of a, b, c, d) -> 3 x 16 bytes */
+static inline void
+store_s24 (unsigned char *out, __m128i a, __m128i b, __m128i c, __m128i d)
+{
+  _mm_storeu_si128 ((__m128i *) out,        _mm_or_si128 (a, _mm_slli_si128 (b, 12)));
+  _mm_storeu_si128 ((__m128i *) (out + 16), _mm_or_si128 (_mm_srli_si128 (b, 4), _mm_slli_si128 (c, 8)));
+  _mm_storeu_si128 ((__m128i *) (out + 32), _mm_or_si128 (_mm_srli_si128 (c, 8), _mm_slli_si128 (d, 4)));
+}
+
+/* 3 x 16 bytes -> 4 x 12 bytes (in the low bytes of a, b, c, d) */
+static inline void
+load_s24 (const unsigned char *in, __m128i& a, __m128i& b, __m128i& c, __m128i& d)
+{
+  const __m128i in0 = _mm_loadu_si128 ((const __m128i *) in);
+  const __m128i in1 = _mm_loadu_si128 ((const __m128i *) (in + 16));
+  const __m128i in2 = _mm_loadu_si128 ((const __m128i *) (in + 32));
+
+  a = in0;
+  b = _mm_alignr_epi8 (in1, in0, 12);
+  c = _mm_alignr_epi8 (in2, in1, 8);
+  d = _mm_srli_si128 (in2, 4);
+}
+
+static inline __m128i
+s24_shuffle_in()
+{
+  /* 3 bytes per sample -> upper 3 bytes of int32 */
+  return _mm_setr_epi8 (-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+}
+
+static inline __m128i
+s24_shuffle_out()
+{
+  /* upper 3 bytes of int32 -> 3 bytes per sample */
+  return _mm_setr_epi8 (1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1);
+}
+
+static void
+s16le_to_float (const unsigned char *in, float *out, size_t n)
+{
+  const __m128 norm = _mm_set1_ps (1.f / 32768);
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    {
+      const __m128i s = _mm_loadu_si128 ((const __m128i *) (in + 2 * i));
+      _mm_storeu_ps (out + i,     _mm_mul_ps (_mm_cvtepi32_ps (_mm_cvtepi16_epi32 (s)), norm));
+      _mm_storeu_ps (out + i + 4, _mm_mul_ps (_mm_cvtepi32_ps (_mm_cvtepi16_epi32 (_mm_srli_si128 (s, 8))), norm));
+    }
+  scalar::s16le_to_float (in + 2 * i, out + i, n - i);
+}
+
+static void
+s24le_to_float (const unsigned char *in, float *out, size_t n)
+{
+  const __m128  norm = _mm_set1_ps (1.f / 2147483648.f);
+  const __m128i shuffle = s24_shuffle_in();
+
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+    {
+      __m128i a, b, c, d;
+      load_s24 (in + 3 * i, a, b, c, d);
+      _mm_storeu_ps (out + i,      _mm_mul_ps (_mm_cvtepi32_ps (_mm_shuffle_epi8 (a, shuffle)), norm));
+      _mm_storeu_ps (out + i + 4,  _mm_mul_ps (_mm_cvtepi32_ps (_mm_shuffle_epi8 (b, shuffle)), norm));
+      _mm_storeu_ps (out + i + 8,  _mm_mul_ps (_mm_cvtepi32_ps (_mm_shuffle_epi8 (c, shuffle)), norm));
+      _mm_storeu_ps (out + i + 12, _mm_mul_ps (_mm_cvtepi32_ps (_mm_shuffle_epi8 (d, shuffle)), norm));
+    }
+  scalar::s24le_to_float (in + 3 * i, out + i, n - i);
+}
+
+static void
+s32le_to_float (const unsigned char *in, float *out, size_t n)
+{
+  const __m128 norm = _mm_set1_ps (1.f / 2147483648.f);
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_ps (out + i, _mm_mul_ps (_mm_cvtepi32_ps (_mm_loadu_si128 ((const __m128i *) (in + 4 * i))), norm));
+  scalar::s32le_to_float (in + 4 * i, out + i, n - i);
+}
+
+static void
+float_to_s16le (const float *in, unsigned char *out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    {
+      const __m128i lo = float_to_s16_clip (_mm_loadu_ps (in + i));
+      const __m128i hi = float_to_s16_clip (_mm_loadu_ps (in + i + 4));
+      _mm_storeu_si128 ((__m128i *) (out + 2 * i), _mm_packs_epi32 (lo, hi));
+    }
+  scalar::float_to_s16le (in + i, out + 2 * i, n - i);
+}
+
+static void
+float_to_s24le (const float *in, unsigned char *out, size_t n)
+{
+  const __m128i shuffle = s24_shuffle_out();
+
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+    {
+      store_s24 (out + 3 * i,
+                 _mm_shuffle_epi8 (float_to_s32_clip (_mm_loadu_ps (in + i)), shuffle),
+                 _mm_shuffle_epi8 (float_to_s32_clip (_mm_loadu_ps (in + i + 4)), shuffle),
+                 _mm_shuffle_epi8 (float_to_s32_clip (_mm_loadu_ps (in + i + 8)), shuffle),
+                 _mm_shuffle_epi8 (float_to_s32_clip (_mm_loadu_ps (in + i + 12)), shuffle));
+    }
+  scalar::float_to_s24le (in + i, out + 3 * i, n - i);
+}
+
+static void
+float_to_s32le (const float *in, unsigned char *out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_si128 ((__m128i *) (out + 4 * i), float_to_s32_clip (_mm_loadu_ps (in + i)));
+  scalar::float_to_s32le (in + i, out + 4 * i, n - i);
+}
+
+static void
+float_to_f32le (const float *in, unsigned char *out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    {
+      /* operand order: maxps/minps return the second operand if one is NaN, so NaN is passed through */
+      const __m128 f = _mm_min_ps (_mm_set1_ps (1.f), _mm_max_ps (_mm_set1_ps (-1.f), _mm_loadu_ps (in + i)));
+      _mm_storeu_ps ((float *) (out + 4 * i), f);
+    }
+  scalar::float_to_f32le (in + i, out + 4 * i, n - i);
+}
+
+#include "dspkernelsimpl.hh"
+
+}
+
+AUDIOWMARK_DSP_TARGET_END
+
+AUDIOWMARK_DSP_TARGET_BEGIN ("avx2,fma")
+
+namespace avx2
+{
+
+struct S
+{
+  static constexpr const char *name = "avx2";
+  static constexpr int W = 8;
+
+  typedef __m256  F;
+  typedef __m256i I;
+  typedef __m256  M;
+
+  static F load (const float *p)        { return _mm256_loadu_ps (p); }
+  static void store (float *p, F v)     { _mm256_storeu_ps (p, v); }
+  static F set1 (float f)               { return _mm256_set1_ps (f); }
+  static I set1_i (int i)               { return _mm256_set1_epi32 (i); }
+  static F min (F a, F b)               { return _mm256_min_ps (a, b); }
+  static F max (F a, F b)               { return _mm256_max_ps (a, b); }
+  static F abs (F a)                    { return _mm256_and_ps (a, _mm256_castsi256_ps (_mm256_set1_epi32 (0x7fffffff))); }
+  static F fmadd (F a, F b, F c)        { return _mm256_fmadd_ps (a, b, c); }
+  static F round (F a)                  { return _mm256_round_ps (a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+  static M lt (F a, F b)                { return _mm256_cmp_ps (a, b, _CMP_LT_OQ); }
+  static M gt (F a, F b)                { return _mm256_cmp_ps (a, b, _CMP_GT_OQ); }
+  static M ne (F a, F b)                { return _mm256_cmp_ps (a, b, _CMP_NEQ_UQ); }
+  static M and_m (M a, M b)             { return _mm256_and_ps (a, b); }
+  static F select (M m, F a, F b)       { return _mm256_blendv_ps (b, a, m); }
+  static I as_int (F a)                 { return _mm256_castps_si256 (a); }
+  static F as_float (I a)               { return _mm256_castsi256_ps (a); }
+  static F cvt (I a)                    { return _mm256_cvtepi32_ps (a); }
+  static I cvt_i (F a)                  { return _mm256_cvtps_epi32 (a); }
+  static I and_i (I a, I b)             { return _mm256_and_si256 (a, b); }
+  static I or_i (I a, I b)              { return _mm256_or_si256 (a, b); }
+  static I add_i (I a, I b)             { return _mm256_add_epi32 (a, b); }
+  static I srl23 (I a)                  { return _mm256_srli_epi32 (a, 23); }
+  static I sll23 (I a)                  { return _mm256_slli_epi32 (a, 23); }
+
+  static void
+  deinterleave (F a, F b, F& even, F& odd)
+  {
+    /* shuffle gives [ 0 2 8 10 | 4 6 12 14 ], permute fixes the order of the 64-bit blocks */
+    const F e = _mm256_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0));
+    const F o = _mm256_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1));
+    even = _mm256_castpd_ps (_mm256_permute4x64_pd (_mm256_castps_pd (e), _MM_SHUFFLE (3, 1, 2, 0)));
+    odd  = _mm256_castpd_ps (_mm256_permute4x64_pd (_mm256_castps_pd (o), _MM_SHUFFLE (3, 1, 2, 0)));
+  }
+  static void
+  interleave (F even, F odd, F& a, F& b)
+  {
+    const F lo = _mm256_unpacklo_ps (even, odd);
+    const F hi = _mm256_unpackhi_ps (even, odd);
+    a = _mm256_permute2f128_ps (lo, hi, 0x20);
+    b = _mm256_permute2f128_ps (lo, hi, 0x31);
+  }
+  static F
+  gather (const float *base, const int *idx)
+  {
+    return _mm256_i32gather_ps (base, _mm256_loadu_si256 ((const __m256i *) idx), 4);
+  }
+  static float
+  reduce_add (F a)
+  {
+    return sse4::S::reduce_add (_mm_add_ps (_mm256_castps256_ps128 (a), _mm256_extractf128_ps (a, 1)));
+  }
+  static float
+  reduce_max (F a)
+  {
+    return sse4::S::reduce_max (_mm_max_ps (_mm256_castps256_ps128 (a), _mm256_extractf128_ps (a, 1)));
+  }
+};
+
+/* raw sample conversion: 8 floats per vector, 24 bit conversion uses the sse4.1 byte layout helpers */
+
+static inline __m256i
+float_to_s32_clip (__m256 f)
+{
+  const __m256 snorm = _mm256_mul_ps (f, _mm256_set1_ps (2147483648.f));
+  const __m256i pos_overflow = _mm256_castps_si256 (_mm256_cmp_ps (snorm, _mm256_set1_ps (2147483648.f), _CMP_GE_OQ));
+  return _mm256_xor_si256 (_mm256_cvttps_epi32 (snorm), pos_overflow);
+}
+
+static inline __m256i
+float_to_s16_clip (__m256 f)
+{
+  __m256 snorm = _mm256_mul_ps (f, _mm256_set1_ps (32768.f));
+  snorm = _mm256_min_ps (_mm256_max_ps (snorm, _mm256_set1_ps (-32768.f)), _mm256_set1_ps (32767.f));
+  return _mm256_cvttps_epi32 (snorm);
+}
+
+static void
+s16le_to_float (const unsigned char *in, float *out, size_t n)
+{
+  const __m256 norm = _mm256_set1_ps (1.f / 32768);
+
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+    {
+      const __m128i lo = _mm_loadu_si128 ((const __m128i *) (in + 2 * i));
+      const __m128i hi = _mm_loadu_si128 ((const __m128i *) (in + 2 * i + 16));
+      _mm256_storeu_ps (out + i,     _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (lo)), norm));
+      _mm256_storeu_ps (out + i + 8, _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (hi)), norm));
+    }
+  scalar::s16le_to_float (in + 2 * i, out + i, n - i);
+}
+
+static void
+s24le_to_float (const unsigned char *in, float *out, size_t n)
+{
+  const __m256  norm = _mm256_set1_ps (1.f / 2147483648.f);
+  const __m256i shuffle = _mm256_broadcastsi128_si256 (sse4::s24_shuffle_in());
+
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+    {
+      __m128i a, b, c, d;
+      sse4::load_s24 (in + 3 * i, a, b, c, d);
+      const __m256i ab = _mm256_shuffle_epi8 (_mm256_inserti128_si256 (_mm256_castsi128_si256 (a), b, 1), shuffle);
+      const __m256i cd = _mm256_shuffle_epi8 (_mm256_inserti128_si256 (_mm256_castsi128_si256 (c), d, 1), shuffle);
+      _mm256_storeu_ps (out + i,     _mm256_mul_ps (_mm256_cvtepi32_ps (ab), norm));
+      _mm256_storeu_ps (out + i + 8, _mm256_mul_ps (_mm256_cvtepi32_ps (cd), norm));
+    }
+  scalar::s24le_to_float (in + 3 * i, out + i, n - i);
+}
+
+static void
+s32le_to_float (const unsigned char *in, float *out, size_t n)
+{
+  const __m256 norm = _mm256_set1_ps (1.f / 2147483648.f);
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps (out + i, _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_loadu_si256 ((const __m256i *) (in + 4 * i))), norm));
+  scalar::s32le_to_float (in + 4 * i, out + i, n - i);
+}
+
+static void
+float_to_s16le (const float *in, unsigned char *out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+    {
+      const __m256i lo = float_to_s16_clip (_mm256_loadu_ps (in + i));
+      const __m256i hi = float_to_s16_clip (_mm256_loadu_ps (in + i + 8));
+
+      /* packs works within 128-bit lanes: [ lo0 hi0 lo1 hi1 ] -> [ lo0 lo1 hi0 hi1 ] */
+      const __m256i packed = _mm256_packs_epi32 (lo, hi);
+      _mm256_storeu_si256 ((__m256i *) (out + 2 * i), _mm256_permute4x64_epi64 (packed, _MM_SHUFFLE (3, 1, 2, 0)));
+    }
+  scalar::float_to_s16le (in + i, out + 2 * i, n - i);
+}
+
+static void
+float_to_s24le (const float *in, unsigned char *out, size_t n)
+{
+  const __m256i shuffle = _mm256_broadcastsi128_si256 (sse4::s24_shuffle_out());
+
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+    {
+      const __m256i ab = _mm256_shuffle_epi8 (float_to_s32_clip (_mm256_loadu_ps (in + i)), shuffle);
+      const __m256i cd = _mm256_shuffle_epi8 (float_to_s32_clip (_mm256_loadu_ps (in + i + 8)), shuffle);
+      sse4::store_s24 (out + 3 * i,
+                       _mm256_castsi256_si128 (ab), _mm256_extracti128_si256 (ab, 1),
+                       _mm256_castsi256_si128 (cd), _mm256_extracti128_si256 (cd, 1));
+    }
+  scalar::float_to_s24le (in + i, out + 3 * i, n - i);
+}
+
+static void
+float_to_s32le (const float *in, unsigned char *out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_si256 ((__m256i *) (out + 4 * i), float_to_s32_clip (_mm256_loadu_ps (in + i)));
+  scalar::float_to_s32le (in + i, out + 4 * i, n - i);
+}
+
+static void
+float_to_f32le (const float *in, unsigned char *out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    {
+      const __m256 f = _mm256_min_ps (_mm256_set1_ps (1.f), _mm256_max_ps (_mm256_set1_ps (-1.f), _mm256_loadu_ps (in + i)));
+      _mm256_storeu_ps ((float *) (out + 4 * i), f);
+    }
+  scalar::float_to_f32le (in + i, out + 4 * i, n - i);
+}
+
+#include "dspkernelsimpl.hh"
+
+}
+
+AUDIOWMARK_DSP_TARGET_END
+
+/* gcc-12 falsely reports use of _mm512_undefined_* values within many avx512 intrinsics */
+#if defined (AUDIOWMARK_COMP_GCC)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+AUDIOWMARK_DSP_TARGET_BEGIN ("avx512f")
+
+namespace avx512
+{
+
+struct S
+{
+  static constexpr const char *name = "avx512";
+  static constexpr int W = 16;
+
+  typedef __m512    F;
+  typedef __m512i   I;
+  typedef __mmask16 M;
+
+  static F load (const float *p)        { return _mm512_loadu_ps (p); }
+  static void store (float *p, F v)     { _mm512_storeu_ps (p, v); }
+  static F set1 (float f)               { return _mm512_set1_ps (f); }
+  static I set1_i (int i)               { return _mm512_set1_epi32 (i); }
+  static F min (F a, F b)               { return _mm512_min_ps (a, b); }
+  static F max (F a, F b)               { return _mm512_max_ps (a, b); }
+  static F abs (F a)                    { return _mm512_abs_ps (a); }
+  static F fmadd (F a, F b, F c)        { return _mm512_fmadd_ps (a, b, c); }
+  static F round (F a)                  { return _mm512_roundscale_ps (a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+  static M lt (F a, F b)                { return _mm512_cmp_ps_mask (a, b, _CMP_LT_OQ); }
+  static M gt (F a, F b)                { return _mm512_cmp_ps_mask (a, b, _CMP_GT_OQ); }
+  static M ne (F a, F b)                { return _mm512_cmp_ps_mask (a, b, _CMP_NEQ_UQ); }
+  static M and_m (M a, M b)             { return a & b; }
+  static F select (M m, F a, F b)       { return _mm512_mask_blend_ps (m, b, a); }
+  static I as_int (F a)                 { return _mm512_castps_si512 (a); }
+  static F as_float (I a)               { return _mm512_castsi512_ps (a); }
+  static F cvt (I a)                    { return _mm512_cvtepi32_ps (a); }
+  static I cvt_i (F a)                  { return _mm512_cvtps_epi32 (a); }
+  static I and_i (I a, I b)             { return _mm512_and_si512 (a, b); }
+  static I or_i (I a, I b)              { return _mm512_or_si512 (a, b); }
+  static I add_i (I a, I b)             { return _mm512_add_epi32 (a, b); }
+  static I srl23 (I a)                  { return _mm512_srli_epi32 (a, 23); }
+  static I sll23 (I a)                  { return _mm512_slli_epi32 (a, 23); }
+
+  static void
+  deinterleave (F a, F b, F& even, F& odd)
+  {
+    const I even_idx = _mm512_setr_epi32 (0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+    const I odd_idx  = _mm512_setr_epi32 (1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+    even = _mm512_permutex2var_ps (a, even_idx, b);
+    odd  = _mm512_permutex2var_ps (a, odd_idx, b);
+  }
+  static void
+  interleave (F even, F odd, F& a, F& b)
+  {
+    const I lo_idx = _mm512_setr_epi32 (0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+    const I hi_idx = _mm512_setr_epi32 (8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31);
+    a = _mm512_permutex2var_ps (even, lo_idx, odd);
+    b = _mm512_permutex2var_ps (even, hi_idx, odd);
+  }
+  static F
+  gather (const float *base, const int *idx)
+  {
+    return _mm512_i32gather_ps (_mm512_loadu_si512 (idx), base, 4);
+  }
+  static float
+  reduce_add (F a)
+  {
+    a = _mm512_add_ps (a, _mm512_shuffle_f32x4 (a, a, _MM_SHUFFLE (1, 0, 3, 2)));
+    a = _mm512_add_ps (a, _mm512_shuffle_f32x4 (a, a, _MM_SHUFFLE (2, 3, 0, 1)));
+    return sse4::S::reduce_add (_mm512_castps512_ps128 (a));
+  }
+  static float
+  reduce_max (F a)
+  {
+    a = _mm512_max_ps (a, _mm512_shuffle_f32x4 (a, a, _MM_SHUFFLE (1, 0, 3, 2)));
+    a = _mm512_max_ps (a, _mm512_shuffle_f32x4 (a, a, _MM_SHUFFLE (2, 3, 0, 1)));
+    return sse4::S::reduce_max (_mm512_castps512_ps128 (a));
+  }
+};
+
+/* raw sample conversion is memory bound, avx2 is good enough */
+using avx2::s16le_to_float;
+using avx2::s24le_to_float;
+using avx2::s32le_to_float;
+using avx2::float_to_s16le;
+using avx2::float_to_s24le;
+using avx2::float_to_s32le;
+using avx2::float_to_f32le;
+
+#include "dspkernelsimpl.hh"
+
+}
+
+AUDIOWMARK_DSP_TARGET_END
+
+#if defined (AUDIOWMARK_COMP_GCC)
+#pragma GCC diagnostic pop
+#endif
+
+#endif /* AUDIOWMARK_DSP_X86 */
+
+/* ---------------------------- aarch64 ---------------------------- */
+
+#if AUDIOWMARK_DSP_NEON
+
+namespace neon
+{
+
+struct S
+{
+  static constexpr const char *name = "neon";
+  static constexpr int W = 4;
+
+  typedef float32x4_t F;
+  typedef uint32x4_t  I;
+  typedef uint32x4_t  M;
+
+  static F load (const float *p)        { return vld1q_f32 (p); }
+  static void store (float *p, F v)     { vst1q_f32 (p, v); }
+  static F set1 (float f)               { return vdupq_n_f32 (f); }
+  static I set1_i (int i)               { return vdupq_n_u32 (i); }
+  static F min (F a, F b)               { return vminq_f32 (a, b); }
+  static F max (F a, F b)               { return vmaxq_f32 (a, b); }
+  static F abs (F a)                    { return vabsq_f32 (a); }
+  static F fmadd (F a, F b, F c)        { return vfmaq_f32 (c, a, b); }
+  static F round (F a)                  { return vrndnq_f32 (a); }
+  static M lt (F a, F b)                { return vcltq_f32 (a, b); }
+  static M gt (F a, F b)                { return vcgtq_f32 (a, b); }
+  static M ne (F a, F b)                { return vmvnq_u32 (vceqq_f32 (a, b)); }
+  static M and_m (M a, M b)             { return vandq_u32 (a, b); }
+  static F select (M m, F a, F b)       { return vbslq_f32 (m, a, b); }
+  static I as_int (F a)                 { return vreinterpretq_u32_f32 (a); }
+  static F as_float (I a)               { return vreinterpretq_f32_u32 (a); }
+  static F cvt (I a)                    { return vcvtq_f32_s32 (vreinterpretq_s32_u32 (a)); }
+  static I cvt_i (F a)                  { return vreinterpretq_u32_s32 (vcvtq_s32_f32 (a)); }
+  static I and_i (I a, I b)             { return vandq_u32 (a, b); }
+  static I or_i (I a, I b)              { return vorrq_u32 (a, b); }
+  static I add_i (I a, I b)             { return vaddq_u32 (a, b); }
+  static I srl23 (I a)                  { return vshrq_n_u32 (a, 23); }
+  static I sll23 (I a)                  { return vshlq_n_u32 (a, 23); }
+
+  static void
+  deinterleave (F a, F b, F& even, F& odd)
+  {
+    even = vuzp1q_f32 (a, b);
+    odd  = vuzp2q_f32 (a, b);
+  }
+  static void
+  interleave (F even, F odd, F& a, F& b)
+  {
+    a = vzip1q_f32 (even, odd);
+    b = vzip2q_f32 (even, odd);
+  }
+  static F
+  gather (const float *base, const int *idx)
+  {
+    const float v[4] = { base[idx[0]], base[idx[1]], base[idx[2]], base[idx[3]] };
+    return vld1q_f32 (v);
+  }
+  static float
+  reduce_add (F a)
+  {
+    return vaddvq_f32 (a);
+  }
+  static float
+  reduce_max (F a)
+  {
+    return vmaxvq_f32 (a);
+  }
+};
+
+/* raw sample conversion: no neon specific code, use the scalar versions */
+using scalar::s16le_to_float;
+using scalar::s24le_to_float;
+using scalar::s32le_to_float;
+using scalar::float_to_s16le;
+using scalar::float_to_s24le;
+using scalar::float_to_s32le;
+using scalar::float_to_f32le;
+
+#include "dspkernelsimpl.hh"
+
+}
+
+#endif /* AUDIOWMARK_DSP_NEON */
+
+/* ---------------------------- runtime dispatch ---------------------------- */
+
+vector<const DSPKernels *>
+dsp_kernels_supported()
+{
+  vector<const DSPKernels *> result = { &scalar::kernels };
+
+#if AUDIOWMARK_DSP_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports ("sse4.1"))
+    result.push_back (&sse4::kernels);
+  if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma"))
+    result.push_back (&avx2::kernels);
+  if (__builtin_cpu_supports ("avx512f") && __builtin_cpu_supports ("avx2"))
+    result.push_back (&avx512::kernels);
+#endif
+
+#if AUDIOWMARK_DSP_NEON
+  result.push_back (&neon::kernels);
+#endif
+
+  return result;
+}
+
+const DSPKernels&
+dsp_kernels_scalar()
+{
+  return scalar::kernels;
+}
+
+const DSPKernels&
+dsp_kernels()
+{
+  /* last supported entry is the fastest */
+  static const DSPKernels *kernels = dsp_kernels_supported().back();
+  return *kernels;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIOWMARK_DSP_KERNELS_HH
+#define AUDIOWMARK_DSP_KERNELS_HH
+
+#include <vector>
+#include <stddef.h>
+
+/*
+ * DSPKernels contains the inner loops of the watermark detector/generator
+ * which are performance critical. There is one scalar implementation (which
+ * serves as reference) and one implementation for each supported SIMD
+ * instruction set (SSE4.1, AVX2+FMA, AVX-512 on x86; NEON on aarch64). The
+ * best implementation supported by the CPU is selected at runtime.
+ *
+ * The SIMD versions use fast approximations instead of log2f/powf:
+ *
+ *  - log2: |error| < 1e-6 * max (1, |log2 (x)|) for all positive normal and
+ *    subnormal x; log2 (0) must not be computed (callers handle this)
+ *  - pow (x, y) = exp2 (y * log2 (x)): relative error < 5e-7 + |y| * 7e-7
+ *    for exp2 arguments in [-125, 127]; results outside are clamped
+ *
+ * Summation order can differ between implementations, so sums are not
+ * bit-identical to the scalar version.
+ *
+ * The raw sample conversion functions (used by RawConverter for little
+ * endian formats) produce bit-identical results for all implementations.
+ */
+struct DSPKernels
+{
+  const char *name;
+
+  /* out[i] = in[i * stride] * window[i] */
+  void  (*window_deinterleave) (const float *in, size_t stride, const float *window, float *out, size_t n);
+
+  /* db_out[i] += 10 * log10 (abs (in[i])^2), or min_db for in[i] == 0 (in: n complex values) */
+  void  (*add_db_from_complex) (const float *in, float *db_out, size_t n, float min_db);
+
+  /* *umag += sum (db[up[i]]), *dmag += sum (db[down[i]]) */
+  void  (*sum_up_down) (const float *db, const int *up, const int *down, size_t n, float *umag, float *dmag);
+
+  /* in, out: n complex values; for each i with exponent[i] != 0 and abs (in[i]) > min_mag:
+   *   out[i] = in[i] * (pow (abs (in[i]), exponent[i]) - 1)
+   * other out[i] values are not modified
+   */
+  void  (*frame_mod_delta) (const float *in, const float *exponent, float *out, size_t n, float min_mag);
+
+  /* return max (init, max (abs (in[i]))) */
+  float (*abs_max) (const float *in, size_t n, float init);
+
+  /* interleaved frames: out[i * n_channels + c] = in[i * n_channels + c] * (scale_start + i * scale_step) */
+  void  (*scale_ramp) (const float *in, float *out, size_t n_frames, size_t n_channels, float scale_start, float scale_step);
+
+  /* out[i] += in[i] */
+  void  (*add) (float *out, const float *in, size_t n);
+
+  /* *power_a += sum (a[i]^2), *power_b += sum (b[i]^2) */
+  void  (*power_sum) (const float *a, const float *b, size_t n, double *power_a, double *power_b);
+
+  /* out[i] = log2 (in[i]) for in[i] > 0 */
+  void  (*log2_block) (const float *in, float *out, size_t n);
+
+  /* out[i] = pow (in[i], exponent) for in[i] > 0 */
+  void  (*pow_block) (const float *in, float exponent, float *out, size_t n);
+
+  /* n little endian signed 16/24/32 bit samples -> float in [-1, 1) */
+  void  (*s16le_to_float) (const unsigned char *in, float *out, size_t n);
+  void  (*s24le_to_float) (const unsigned char *in, float *out, size_t n);
+  void  (*s32le_to_float) (const unsigned char *in, float *out, size_t n);
+
+  /* n float samples -> little endian signed 16/24/32 bit samples, clipped and truncated like float_to_int_clip */
+  void  (*float_to_s16le) (const float *in, unsigned char *out, size_t n);
+  void  (*float_to_s24le) (const float *in, unsigned char *out, size_t n);
+  void  (*float_to_s32le) (const float *in, unsigned char *out, size_t n);
+
+  /* n float samples -> little endian float samples, clipped to [-1, 1] */
+  void  (*float_to_f32le) (const float *in, unsigned char *out, size_t n);
+};
+
+/* best implementation for this cpu */
+const DSPKernels& dsp_kernels();
+
+/* scalar reference implementation */
+const DSPKernels& dsp_kernels_scalar();
+
+/* all implementations supported by this cpu (scalar first) */
+std::vector<const DSPKernels *> dsp_kernels_supported();
+
+#endif /* AUDIOWMARK_DSP_KERNELS_HH */
@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Generic SIMD kernels - no include guard: this file is included by
+ * dspkernels.cc once for each instruction set, within a namespace that
+ * defines S (a wrapper for the instructions of this set) and with the
+ * compiler target set to this instruction set.
+ *
+ * S provides:
+ *  - S::W: number of floats per vector, S::F / S::I / S::M: float / int / mask vector
+ *  - load, store, set1, set1_i, min, max, abs, fmadd (a * b + c), round
+ *  - lt, gt, ne, and_m, select (mask ? a : b)
+ *  - as_int, as_float, cvt (int -> float), cvt_i (float -> int)
+ *  - and_i, or_i, add_i, srl23, sll23
+ *  - deinterleave (a, b, even, odd), interleave (even, odd, a, b)
+ *  - gather (base, idx), reduce_add, reduce_max
+ *
+ * The raw sample conversion functions need byte shuffles which are specific
+ * to the instruction set, so they are defined in the namespace before
+ * including this file.
+ */
+
+static inline S::F
+v_log2 (S::F x)
+{
+  /* log2 (m) = 2 / ln (2) * atanh ((m - 1) / (m + 1)), series up to t^7 */
+  const float c1 = 2.8853900817779268;
+  const float c3 = 0.9617966939259756;
+  const float c5 = 0.5770780163555854;
+  const float c7 = 0.4121985831111324;
+
+  /* scale subnormals to normal range */
+  const S::M small = S::lt (x, S::set1 (1.17549435e-38f));
+  x = S::select (small, x * S::set1 (8388608.f), x);
+
+  const S::I bits = S::as_int (x);
+  S::F e = S::cvt (S::srl23 (bits)) - S::select (small, S::set1 (150.f), S::set1 (127.f));
+  S::F m = S::as_float (S::or_i (S::and_i (bits, S::set1_i (0x7fffff)), S::set1_i (0x3f800000)));
+
+  /* m in [1, 2) -> m in [sqrt (0.5), sqrt (2)) */
+  const S::M big = S::gt (m, S::set1 (1.41421356f));
+  m = S::select (big, m * S::set1 (0.5f), m);
+  e = S::select (big, e + S::set1 (1.f), e);
+
+  const S::F t = (m - S::set1 (1.f)) / (m + S::set1 (1.f));
+  const S::F t2 = t * t;
+
+  S::F p = S::fmadd (t2, S::set1 (c7), S::set1 (c5));
+  p = S::fmadd (t2, p, S::set1 (c3));
+  p = S::fmadd (t2, p, S::set1 (c1));
+  return S::fmadd (t, p, e);
+}
+
+static inline S::F
+v_exp2 (S::F x)
+{
+  /* 2^f = exp (f * ln (2)), taylor series up to f^7 for f in [-0.5, 0.5] */
+  const float c1 = 0.6931471805599453;
+  const float c2 = 0.2402265069591007;
+  const float c3 = 0.05550410866482158;
+  const float c4 = 0.009618129107628477;
+  const float c5 = 0.0013333558146428443;
+  const float c6 = 0.00015403530393381608;
+  const float c7 = 1.525273380405984e-05;
+
+  x = S::min (S::max (x, S::set1 (-125.f)), S::set1 (127.f));
+
+  const S::F r = S::round (x);
+  const S::F f = x - r;
+
+  S::F p = S::fmadd (f, S::set1 (c7), S::set1 (c6));
+  p = S::fmadd (f, p, S::set1 (c5));
+  p = S::fmadd (f, p, S::set1 (c4));
+  p = S::fmadd (f, p, S::set1 (c3));
+  p = S::fmadd (f, p, S::set1 (c2));
+  p = S::fmadd (f, p, S::set1 (c1));
+  p = S::fmadd (f, p, S::set1 (1.f));
+
+  /* multiply by 2^r by adding r to the exponent */
+  return S::as_float (S::add_i (S::as_int (p), S::sll23 (S::cvt_i (r))));
+}
+
+static void
+window_deinterleave (const float *in, size_t stride, const float *window, float *out, size_t n)
+{
+  size_t i = 0;
+  if (stride == 1)
+    {
+      for (; i + S::W <= n; i += S::W)
+        S::store (out + i, S::load (in + i) * S::load (window + i));
+    }
+  else if (stride == 2)
+    {
+      /* i + W < n: don't read beyond in[(n - 1) * 2] */
+      for (; i + S::W < n; i += S::W)
+        {
+          S::F even, odd;
+          S::deinterleave (S::load (in + 2 * i), S::load (in + 2 * i + S::W), even, odd);
+          S::store (out + i, even * S::load (window + i));
+        }
+    }
+  for (; i < n; i++)
+    out[i] = in[i * stride] * window[i];
+}
+
+static void
+add_db_from_complex (const float *in, float *db_out, size_t n, float min_db)
+{
+  const float log2_db_factor = 3.01029995663981; // 10 / log2 (10)
+
+  size_t i = 0;
+  for (; i + S::W <= n; i += S::W)
+    {
+      S::F re, im;
+      S::deinterleave (S::load (in + 2 * i), S::load (in + 2 * i + S::W), re, im);
+
+      const S::F abs2 = S::fmadd (re, re, im * im);
+      const S::F db = S::select (S::gt (abs2, S::set1 (0.f)), v_log2 (abs2) * S::set1 (log2_db_factor), S::set1 (min_db));
+      S::store (db_out + i, S::load (db_out + i) + db);
+    }
+  for (; i < n; i++)
+    {
+      const float abs2 = in[2 * i] * in[2 * i] + in[2 * i + 1] * in[2 * i + 1];
+      db_out[i] += abs2 > 0 ? log2f (abs2) * log2_db_factor : min_db;
+    }
+}
+
+static void
+sum_up_down (const float *db, const int *up, const int *down, size_t n, float *umag, float *dmag)
+{
+  S::F usum = S::set1 (0);
+  S::F dsum = S::set1 (0);
+
+  size_t i = 0;
+  for (; i + S::W <= n; i += S::W)
+    {
+      usum = usum + S::gather (db, up + i);
+      dsum = dsum + S::gather (db, down + i);
+    }
+  float u = S::reduce_add (usum);
+  float d = S::reduce_add (dsum);
+  for (; i < n; i++)
+    {
+      u += db[up[i]];
+      d += db[down[i]];
+    }
+  *umag += u;
+  *dmag += d;
+}
+
+static void
+frame_mod_delta (const float *in, const float *exponent, float *out, size_t n, float min_mag)
+{
+  const S::F min_abs2 = S::set1 (min_mag * min_mag);
+
+  size_t i = 0;
+  for (; i + S::W <= n; i += S::W)
+    {
+      S::F re, im, old_re, old_im;
+      S::deinterleave (S::load (in + 2 * i), S::load (in + 2 * i + S::W), re, im);
+      S::deinterleave (S::load (out + 2 * i), S::load (out + 2 * i + S::W), old_re, old_im);
+
+      const S::F e = S::load (exponent + i);
+      const S::F abs2 = S::fmadd (re, re, im * im);
+
+      /* pow (mag, e) = exp2 (e * log2 (mag)) = exp2 (0.5 * e * log2 (abs2)) */
+      const S::F factor = v_exp2 (e * S::set1 (0.5f) * v_log2 (S::max (abs2, min_abs2))) - S::set1 (1.f);
+      const S::M active = S::and_m (S::gt (abs2, min_abs2), S::ne (e, S::set1 (0.f)));
+
+      S::F a, b;
+      S::interleave (S::select (active, re * factor, old_re), S::select (active, im * factor, old_im), a, b);
+      S::store (out + 2 * i, a);
+      S::store (out + 2 * i + S::W, b);
+    }
+  for (; i < n; i++)
+    {
+      const float mag = sqrtf (in[2 * i] * in[2 * i] + in[2 * i + 1] * in[2 * i + 1]);
+      if (exponent[i] != 0 && mag > min_mag)
+        {
+          const float factor = powf (mag, exponent[i]) - 1;
+          out[2 * i] = in[2 * i] * factor;
+          out[2 * i + 1] = in[2 * i + 1] * factor;
+        }
+    }
+}
+
+static float
+abs_max (const float *in, size_t n, float init)
+{
+  S::F vmax = S::set1 (init);
+
+  size_t i = 0;
+  for (; i + S::W <= n; i += S::W)
+    vmax = S::max (vmax, S::abs (S::load (in + i)));
+
+  float maximum = S::reduce_max (vmax);
+  for (; i < n; i++)
+    maximum = std::max (maximum, fabsf (in[i]));
+  return maximum;
+}
+
+static void
+scale_ramp (const float *in, float *out, size_t n_frames, size_t n_channels, float scale_start, float scale_step)
+{
+  const size_t n = n_frames * n_channels;
+
+  size_t j = 0;
+  if (S::W % n_channels == 0)
+    {
+      float lane_frame[S::W];
+      for (int l = 0; l < S::W; l++)
+        lane_frame[l] = l / n_channels;
+
+      const S::F vlane_frame = S::load (lane_frame);
+      for (; j + S::W <= n; j += S::W)
+        {
+          const S::F frame = S::set1 (j / n_channels) + vlane_frame;
+          S::store (out + j, S::load (in + j) * S::fmadd (frame, S::set1 (scale_step), S::set1 (scale_start)));
+        }
+    }
+  for (; j < n; j++)
+    out[j] = in[j] * (scale_start + (j / n_channels) * scale_step);
+}
+
+static void
+add (float *out, const float *in, size_t n)
+{
+  size_t i = 0;
+  for (; i + S::W <= n; i += S::W)
+    S::store (out + i, S::load (out + i) + S::load (in + i));
+  for (; i < n; i++)
+    out[i] += in[i];
+}
+
+static void
+power_sum (const float *a, const float *b, size_t n, double *power_a, double *power_b)
+{
+  S::F asum = S::set1 (0);
+  S::F bsum = S::set1 (0);
+
+  size_t i = 0;
+  for (; i + S::W <= n; i += S::W)
+    {
+      const S::F va = S::load (a + i);
+      const S::F vb = S::load (b + i);
+      asum = S::fmadd (va, va, asum);
+      bsum = S::fmadd (vb, vb, bsum);
+    }
+  double pa = S::reduce_add (asum);
+  double pb = S::reduce_add (bsum);
+  for (; i < n; i++)
+    {
+      pa += double (a[i]) * a[i];
+      pb += double (b[i]) * b[i];
+    }
+  *power_a += pa;
+  *power_b += pb;
+}
+
+static void
+log2_block (const float *in, float *out, size_t n)
+{
+  size_t i = 0;
+  for (; i + S::W <= n; i += S::W)
+    S::store (out + i, v_log2 (S::load (in + i)));
+  for (; i < n; i++)
+    out[i] = log2f (in[i]);
+}
+
+static void
+pow_block (const float *in, float exponent, float *out, size_t n)
+{
+  size_t i = 0;
+  for (; i + S::W <= n; i += S::W)
+    S::store (out + i, v_exp2 (S::set1 (exponent) * v_log2 (S::load (in + i))));
+  for (; i < n; i++)
+    out[i] = powf (in[i], exponent);
+}
+
+static const DSPKernels kernels =
+{
+  .name                = S::name,
+  .window_deinterleave = window_deinterleave,
+  .add_db_from_complex = add_db_from_complex,
+  .sum_up_down         = sum_up_down,
+  .frame_mod_delta     = frame_mod_delta,
+  .abs_max             = abs_max,
+  .scale_ramp          = scale_ramp,
+  .add                 = add,
+  .power_sum           = power_sum,
+  .log2_block          = log2_block,
+  .pow_block           = pow_block,
+  .s16le_to_float      = s16le_to_float,
+  .s24le_to_float      = s24le_to_float,
+  .s32le_to_float      = s32le_to_float,
+  .float_to_s16le      = float_to_s16le,
+  .float_to_s24le      = float_to_s24le,
+  .float_to_s32le      = float_to_s32le,
+  .float_to_f32le      = float_to_f32le,
+};
@@ -0,0 +1,424 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ffinputstream.hh"
+
+#include <algorithm>
+
+#include <assert.h>
+#include <string.h>
+
+extern "C" {
+#include <libavutil/opt.h>
+}
+
+#undef av_err2str
+#define av_err2str(errnum) av_make_error_string((char*)__builtin_alloca(AV_ERROR_MAX_STRING_SIZE), AV_ERROR_MAX_STRING_SIZE, errnum)
+
+using std::string;
+using std::min;
+
+FFInputStream::~FFInputStream()
+{
+  close();
+}
+
+Error
+FFInputStream::open (const string& filename, const string& format)
+{
+  assert (m_state == State::NEW);
+
+  av_log_set_level (AV_LOG_ERROR);
+
+  m_state = State::OPEN; // close() frees everything, even if open fails later on
+
+  /* format can be used to force a container format (like ffmpeg -f), otherwise it is detected */
+  const AVInputFormat *input_format = nullptr;
+  if (format != "")
+    {
+      input_format = av_find_input_format (format.c_str());
+      if (!input_format)
+        return Error (string_printf ("ffmpeg input: unknown format '%s'", format.c_str()));
+    }
+
+  const string url = filename == "-" ? "pipe:0" : filename;
+  int ret = avformat_open_input (&m_fmt_ctx, url.c_str(), input_format, nullptr);
+  if (ret < 0)
+    return Error (string_printf ("ffmpeg input: could not open '%s': %s", filename.c_str(), av_err2str (ret)));
+
+  m_own_fmt_ctx = true;
+
+  ret = avformat_find_stream_info (m_fmt_ctx, nullptr);
+  if (ret < 0)
+    return Error (string_printf ("ffmpeg input: could not find stream info: %s", av_err2str (ret)));
+
+  ret = av_find_best_stream (m_fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+  if (ret < 0)
+    return Error ("ffmpeg input: no audio stream found");
+
+  return open_decoder (ret);
+}
+
+/* fmt_ctx is not owned by FFInputStream, it must be closed by the caller after closing this stream */
+Error
+FFInputStream::open (AVFormatContext *fmt_ctx, int stream_index, std::function<Error (AVPacket *)> other_packet_func)
+{
+  assert (m_state == State::NEW);
+
+  av_log_set_level (AV_LOG_ERROR);
+
+  m_state = State::OPEN;
+  m_fmt_ctx = fmt_ctx;
+  m_other_packet_func = other_packet_func;
+
+  return open_decoder (stream_index);
+}
+
+Error
+FFInputStream::open_decoder (int stream_index)
+{
+  m_stream_index = stream_index;
+
+  const AVCodec *codec = avcodec_find_decoder (m_fmt_ctx->streams[m_stream_index]->codecpar->codec_id);
+  if (!codec)
+    return Error ("ffmpeg input: no decoder found for audio stream");
+
+  m_dec_ctx = avcodec_alloc_context3 (codec);
+  if (!m_dec_ctx)
+    return Error ("ffmpeg input: could not alloc a decoding context");
+
+  int ret = avcodec_parameters_to_context (m_dec_ctx, m_fmt_ctx->streams[m_stream_index]->codecpar);
+  if (ret < 0)
+    return Error ("ffmpeg input: could not copy the stream parameters");
+
+  /* threaded decoding: thread_count = 0 selects the number of threads automatically */
+  m_dec_ctx->thread_count = 0;
+  m_dec_ctx->thread_type  = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+  ret = avcodec_open2 (m_dec_ctx, codec, nullptr);
+  if (ret < 0)
+    return Error (string_printf ("ffmpeg input: could not open audio codec: %s", av_err2str (ret)));
+
+  m_n_channels  = m_dec_ctx->ch_layout.nb_channels;
+  m_sample_rate = m_dec_ctx->sample_rate;
+  if (m_n_channels < 1 || m_sample_rate < 1)
+    return Error ("ffmpeg input: unsupported audio stream parameters");
+
+  /* lossless codecs know their bit depth, lossy codecs are decoded to float */
+  m_bit_depth = m_dec_ctx->bits_per_raw_sample > 0 ? m_dec_ctx->bits_per_raw_sample : 24;
+
+  m_packet = av_packet_alloc();
+  m_frame  = av_frame_alloc();
+  if (!m_packet || !m_frame)
+    return Error ("ffmpeg input: could not allocate packet/frame");
+
+  return Error::Code::NONE;
+}
+
+/* convert decoded frame to interleaved float samples at the end of m_read_buffer */
+Error
+FFInputStream::append_frame()
+{
+  if (m_frame->ch_layout.nb_channels != m_n_channels || m_frame->sample_rate != m_sample_rate)
+    return Error ("ffmpeg input: audio format changed during decoding");
+
+  const size_t old_size = m_read_buffer.size();
+  m_read_buffer.resize (old_size + size_t (m_frame->nb_samples) * m_n_channels);
+  float *out = m_read_buffer.data() + old_size;
+
+  if (m_frame->format == AV_SAMPLE_FMT_FLT)
+    {
+      memcpy (out, m_frame->extended_data[0], m_frame->nb_samples * m_n_channels * sizeof (float));
+      return Error::Code::NONE;
+    }
+  if (m_frame->format == AV_SAMPLE_FMT_FLTP) /* aac, opus, vorbis, mp3 decoders */
+    {
+      for (int ch = 0; ch < m_n_channels; ch++)
+        {
+          const float *in = reinterpret_cast<const float *> (m_frame->extended_data[ch]);
+          for (int i = 0; i < m_frame->nb_samples; i++)
+            out[i * m_n_channels + ch] = in[i];
+        }
+      return Error::Code::NONE;
+    }
+
+  /* other sample formats: use libswresample for the conversion */
+  if (m_swr_format != m_frame->format)
+    {
+      swr_free (&m_swr_ctx);
+
+      m_swr_ctx = swr_alloc();
+      if (!m_swr_ctx)
+        return Error ("ffmpeg input: could not allocate resampler context");
+
+      av_opt_set_chlayout   (m_swr_ctx, "in_chlayout",     &m_frame->ch_layout, 0);
+      av_opt_set_int        (m_swr_ctx, "in_sample_rate",  m_sample_rate,       0);
+      av_opt_set_sample_fmt (m_swr_ctx, "in_sample_fmt",   AVSampleFormat (m_frame->format), 0);
+      av_opt_set_chlayout   (m_swr_ctx, "out_chlayout",    &m_frame->ch_layout, 0);
+      av_opt_set_int        (m_swr_ctx, "out_sample_rate", m_sample_rate,       0);
+      av_opt_set_sample_fmt (m_swr_ctx, "out_sample_fmt",  AV_SAMPLE_FMT_FLT,   0);
+
+      if (swr_init (m_swr_ctx) < 0)
+        return Error ("ffmpeg input: failed to initialize the resampling context");
+
+      m_swr_format = m_frame->format;
+    }
+  uint8_t *out_data[1] = { reinterpret_cast<uint8_t *> (out) };
+  int ret = swr_convert (m_swr_ctx, out_data, m_frame->nb_samples, const_cast<const uint8_t **> (m_frame->extended_data), m_frame->nb_samples);
+  if (ret < 0)
+    return Error (string_printf ("ffmpeg input: error while converting: %s", av_err2str (ret)));
+
+  m_read_buffer.resize (old_size + size_t (ret) * m_n_channels);
+  return Error::Code::NONE;
+}
+
+/* decode at least one frame (or reach eof) */
+Error
+FFInputStream::decode_frames()
+{
+  while (!m_eof)
+    {
+      int ret = avcodec_receive_frame (m_dec_ctx, m_frame);
+      if (ret == 0 && m_prime_frames)
+        {
+          /* output of the priming packet (see prime_decoder) */
+          av_frame_unref (m_frame);
+          m_prime_frames--;
+        }
+      else if (ret == 0)
+        {
+          Error err = m_seek_pending ? skip_to_seek_frame() : Error::Code::NONE;
+          if (!err)
+            err = append_frame();
+          av_frame_unref (m_frame);
+          if (!err && m_skip_frames)
+            {
+              const size_t n_skip = min (m_skip_frames, m_read_buffer.size() / m_n_channels);
+              m_read_buffer.erase (m_read_buffer.begin(), m_read_buffer.begin() + n_skip * m_n_channels);
+              m_skip_frames -= n_skip;
+            }
+          return err;
+        }
+      else if (ret == AVERROR_EOF)
+        {
+          m_eof = true;
+        }
+      else if (ret != AVERROR (EAGAIN))
+        {
+          return Error (string_printf ("ffmpeg input: error while decoding: %s", av_err2str (ret)));
+        }
+      else if (m_demux_eof)
+        {
+          /* should not happen after flushing, but avoid an endless loop */
+          m_eof = true;
+        }
+      else
+        {
+          /* decoder needs more input */
+          ret = av_read_frame (m_fmt_ctx, m_packet);
+          if (ret == AVERROR_EOF)
+            {
+              m_demux_eof = true;
+              ret = avcodec_send_packet (m_dec_ctx, nullptr); // flush decoder
+            }
+          else if (ret >= 0)
+            {
+              if (m_packet->stream_index == m_stream_index)
+                {
+                  m_n_packets++;
+                  m_n_packet_bytes += m_packet->size;
+                  ret = avcodec_send_packet (m_dec_ctx, m_packet);
+                }
+              else if (m_other_packet_func)
+                {
+                  Error err = m_other_packet_func (m_packet);
+                  if (err)
+                    return err;
+                }
+              av_packet_unref (m_packet);
+            }
+          if (ret < 0 && ret != AVERROR_INVALIDDATA)
+            return Error (string_printf ("ffmpeg input: error while reading: %s", av_err2str (ret)));
+        }
+    }
+  return Error::Code::NONE;
+}
+
+Error
+FFInputStream::read_frames (float *samples, size_t count, size_t& n_frames_read)
+{
+  assert (m_state == State::OPEN);
+
+  n_frames_read = 0;
+  while (!m_eof && m_read_buffer.size() < count * m_n_channels)
+    {
+      Error err = decode_frames();
+      if (err)
+        return err;
+    }
+
+  const auto begin = m_read_buffer.begin();
+  const auto end   = begin + min (count * m_n_channels, m_read_buffer.size());
+  std::copy (begin, end, samples);
+  n_frames_read = (end - begin) / m_n_channels;
+  m_read_buffer.erase (begin, end);
+  return Error::Code::NONE;
+}
+
+/*
+ * seeking is sample accurate: the demuxer seeks to a position before the
+ * requested frame, and the decoded frames before the requested frame are
+ * discarded (using the timestamp of the first frame decoded after seeking)
+ */
+Error
+FFInputStream::seek (size_t frame)
+{
+  assert (m_state == State::OPEN);
+
+  /* streams that share the format context with other streams (video) and pipes can't seek */
+  if (!m_own_fmt_ctx || !m_fmt_ctx->pb || !(m_fmt_ctx->pb->seekable & AVIO_SEEKABLE_NORMAL))
+    return Error ("ffmpeg input: seek not supported for this input stream");
+
+  const AVStream *st = m_fmt_ctx->streams[m_stream_index];
+  const int64_t start_ts = st->start_time != AV_NOPTS_VALUE ? st->start_time : 0;
+  const int64_t ts = start_ts + av_rescale_q (frame, AVRational { 1, m_sample_rate }, st->time_base);
+
+  int ret = avformat_seek_file (m_fmt_ctx, m_stream_index, INT64_MIN, ts, ts, 0);
+  if (ret < 0)
+    return Error (string_printf ("ffmpeg input: seek failed: %s", av_err2str (ret)));
+
+  avcodec_flush_buffers (m_dec_ctx);
+  m_read_buffer.clear();
+  m_demux_eof    = false;
+  m_eof          = false;
+  m_seek_pending = true;
+  m_seek_frame   = frame;
+  m_skip_frames  = 0;
+  return Error::Code::NONE;
+}
+
+/*
+ * decode the last audio packet of prev_filename (i.e. the previous segment of an hls
+ * playlist) before the first packet of this stream and discard its output: lapped
+ * transform codecs like aac need the previous frame to reconstruct the first frame
+ */
+Error
+FFInputStream::prime_decoder (const string& prev_filename)
+{
+  assert (m_state == State::OPEN);
+
+  AVFormatContext *fmt_ctx = nullptr;
+  int ret = avformat_open_input (&fmt_ctx, prev_filename.c_str(), nullptr, nullptr);
+  if (ret < 0)
+    return Error (string_printf ("ffmpeg input: could not open '%s': %s", prev_filename.c_str(), av_err2str (ret)));
+
+  AVPacket *last_packet = av_packet_alloc();
+
+  ret = avformat_find_stream_info (fmt_ctx, nullptr);
+  if (ret >= 0)
+    ret = av_find_best_stream (fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+
+  /* only demux, the previous stream is not decoded */
+  const int stream_index = ret;
+  if (last_packet && stream_index >= 0 && fmt_ctx->streams[stream_index]->codecpar->codec_id == m_dec_ctx->codec_id)
+    {
+      while (av_read_frame (fmt_ctx, m_packet) >= 0)
+        {
+          if (m_packet->stream_index == stream_index)
+            {
+              av_packet_unref (last_packet);
+              av_packet_move_ref (last_packet, m_packet);
+            }
+          av_packet_unref (m_packet);
+        }
+    }
+  avformat_close_input (&fmt_ctx);
+
+  /* if there is no suitable packet, the stream is decoded without priming */
+  if (last_packet && last_packet->size > 0 && avcodec_send_packet (m_dec_ctx, last_packet) >= 0)
+    m_prime_frames++;
+
+  av_packet_free (&last_packet);
+  return Error::Code::NONE;
+}
+
+/* first frame after seeking: compute how many frames need to be discarded */
+Error
+FFInputStream::skip_to_seek_frame()
+{
+  m_seek_pending = false;
+
+  const AVStream *st = m_fmt_ctx->streams[m_stream_index];
+  const int64_t start_ts = st->start_time != AV_NOPTS_VALUE ? st->start_time : 0;
+  const int64_t ts = m_frame->best_effort_timestamp;
+  if (ts == AV_NOPTS_VALUE)
+    return Error ("ffmpeg input: seek failed: decoded frame has no timestamp");
+
+  const int64_t pos = av_rescale_q (ts - start_ts, st->time_base, AVRational { 1, m_sample_rate });
+  if (pos > int64_t (m_seek_frame))
+    return Error ("ffmpeg input: seek failed: demuxer position is after seek position");
+
+  m_skip_frames = m_seek_frame - pos;
+  return Error::Code::NONE;
+}
+
+void
+FFInputStream::close()
+{
+  if (m_state == State::OPEN)
+    {
+      swr_free (&m_swr_ctx);
+      av_frame_free (&m_frame);
+      av_packet_free (&m_packet);
+      avcodec_free_context (&m_dec_ctx);
+      if (m_own_fmt_ctx)
+        avformat_close_input (&m_fmt_ctx);
+      m_fmt_ctx = nullptr;
+
+      m_state = State::CLOSED;
+    }
+}
+
+int
+FFInputStream::bit_depth() const
+{
+  return m_bit_depth;
+}
+
+int
+FFInputStream::sample_rate() const
+{
+  return m_sample_rate;
+}
+
+int
+FFInputStream::n_channels() const
+{
+  return m_n_channels;
+}
+
+size_t
+FFInputStream::n_frames() const
+{
+  return N_FRAMES_UNKNOWN;
+}
+
+Encoding
+FFInputStream::encoding() const
+{
+  return Encoding::SIGNED;
+}
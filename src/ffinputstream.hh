@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIOWMARK_FF_INPUT_STREAM_HH
+#define AUDIOWMARK_FF_INPUT_STREAM_HH
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "audiostream.hh"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswresample/swresample.h>
+}
+
+/*
+ * FFInputStream decodes compressed audio (aac, m4a, opus, ogg, ...) in-process
+ * using the ffmpeg libraries, so no temporary wav file needs to be written by
+ * an external ffmpeg process. The decoder uses multiple threads if the codec
+ * supports it. The number of frames is not known in advance, since container
+ * durations are only estimates.
+ *
+ * For video files, the audio stream of an already opened input can be decoded;
+ * packets of all other streams are passed to a callback (for remuxing).
+ */
+class FFInputStream : public AudioInputStream
+{
+  enum class State {
+    NEW,
+    OPEN,
+    CLOSED
+  };
+  State             m_state = State::NEW;
+
+  AVFormatContext  *m_fmt_ctx = nullptr;
+  bool              m_own_fmt_ctx = false;
+  AVCodecContext   *m_dec_ctx = nullptr;
+  AVPacket         *m_packet = nullptr;
+  AVFrame          *m_frame = nullptr;
+  SwrContext       *m_swr_ctx = nullptr;
+  int               m_swr_format = -1;
+  int               m_stream_index = -1;
+
+  int               m_n_channels = 0;
+  int               m_sample_rate = 0;
+  int               m_bit_depth = 0;
+  bool              m_demux_eof = false;
+  bool              m_eof = false;
+  bool              m_seek_pending = false;
+  size_t            m_seek_frame = 0;
+  size_t            m_skip_frames = 0;
+  size_t            m_prime_frames = 0;
+  size_t            m_n_packets = 0;
+  size_t            m_n_packet_bytes = 0;
+
+  std::vector<float> m_read_buffer;
+
+  std::function<Error (AVPacket *)> m_other_packet_func;
+
+  Error open_decoder (int stream_index);
+  Error decode_frames();
+  Error append_frame();
+  Error skip_to_seek_frame();
+public:
+  using AudioInputStream::read_frames;
+
+  ~FFInputStream();
+
+  Error   open (const std::string& filename, const std::string& format = "");
+  Error   open (AVFormatContext *fmt_ctx, int stream_index, std::function<Error (AVPacket *)> other_packet_func);
+  Error   read_frames (float *samples, size_t count, size_t& n_frames_read) override;
+  Error   seek (size_t frame) override;
+  Error   prime_decoder (const std::string& prev_filename);
+  void    close();
+
+  int     bit_depth() const override;
+  int     sample_rate() const override;
+  int     n_channels() const override;
+  size_t  n_frames() const override;
+  Encoding encoding() const override;
+
+  /* compressed audio packets that were decoded so far (i.e. for bit rate estimation) */
+  size_t  n_packets() const       { return m_n_packets; }
+  size_t  n_packet_bytes() const  { return m_n_packet_bytes; }
+};
+
+#endif /* AUDIOWMARK_FF_INPUT_STREAM_HH */
@@ -16,20 +16,28 @@
  */
 
 #include "fft.hh"
+#include "utils.hh"
+#include "stats.hh"
 
 #include <fftw3.h>
 
 #include <map>
+#include <memory>
 #include <mutex>
 
+#include <stdio.h>
+#include <unistd.h>
+
 using std::vector;
 using std::complex;
 using std::map;
+using std::string;
 
 static struct FFTPlanMap
 {
   std::map<size_t, fftwf_plan> fft_plan;
   std::map<size_t, fftwf_plan> ifft_plan;
+  std::map<std::pair<size_t, size_t>, fftwf_plan> batch_fft_plan;
 
   ~FFTPlanMap()
   {
@@ -43,10 +51,52 @@ static struct FFTPlanMap
       };
     free_plans (fft_plan);
     free_plans (ifft_plan);
+    free_plans (batch_fft_plan);
   }
 } fft_plan_map;
 
 static std::mutex fft_planner_mutex;
+static unsigned   fft_planner_flags = FFTW_ESTIMATE;
+static string     fft_wisdom_filename;
+
+void
+fft_set_planning (FFTPlanning planning, const string& wisdom_filename)
+{
+  std::lock_guard<std::mutex> lg (fft_planner_mutex);
+
+  switch (planning)
+    {
+      case FFTPlanning::ESTIMATE: fft_planner_flags = FFTW_ESTIMATE;
+                                  break;
+      case FFTPlanning::MEASURE:  fft_planner_flags = FFTW_MEASURE;
+                                  break;
+      case FFTPlanning::PATIENT:  fft_planner_flags = FFTW_PATIENT;
+                                  break;
+    }
+  fft_wisdom_filename = wisdom_filename;
+  if (!fft_wisdom_filename.empty())
+    {
+      /* a missing wisdom file is not an error: it will be created once we have new plans */
+      if (!fftwf_import_wisdom_from_filename (fft_wisdom_filename.c_str()))
+        debug ("fft: no wisdom loaded from '%s'\n", fft_wisdom_filename.c_str());
+    }
+}
+
+/* needs to be called with fft_planner_mutex locked */
+static void
+save_wisdom()
+{
+  if (fft_wisdom_filename.empty() || fft_planner_flags == FFTW_ESTIMATE)
+    return;
+
+  /* write wisdom to temp file and rename to avoid partial files if two processes save at the same time */
+  string tmp_filename = string_printf ("%s.tmp%d", fft_wisdom_filename.c_str(), int (getpid()));
+  if (fftwf_export_wisdom_to_filename (tmp_filename.c_str()) && rename (tmp_filename.c_str(), fft_wisdom_filename.c_str()) == 0)
+    return;
+
+  unlink (tmp_filename.c_str());
+  warning ("audiowmark: unable to save fft wisdom to '%s'\n", fft_wisdom_filename.c_str());
+}
 
 FFTProcessor::FFTProcessor (size_t N)
 {
@@ -58,19 +108,38 @@ FFTProcessor::FFTProcessor (size_t N)
   m_out = static_cast<float *> (fftwf_malloc (sizeof (float) * N_2));
 
   /* plan if not done already */
+  bool new_plans = false;
   fftwf_plan& pfft = fft_plan_map.fft_plan[N];
   if (!pfft)
-    pfft = fftwf_plan_dft_r2c_1d (N, m_in, (fftwf_complex *) m_out, FFTW_ESTIMATE | FFTW_PRESERVE_INPUT);
+    {
+      pfft = fftwf_plan_dft_r2c_1d (N, m_in, (fftwf_complex *) m_out, fft_planner_flags | FFTW_PRESERVE_INPUT);
+      new_plans = true;
+    }
 
   fftwf_plan& pifft = fft_plan_map.ifft_plan[N];
   if (!pifft)
-    pifft = fftwf_plan_dft_c2r_1d (N, (fftwf_complex *) m_in, m_out, FFTW_ESTIMATE | FFTW_PRESERVE_INPUT);
+    {
+      pifft = fftwf_plan_dft_c2r_1d (N, (fftwf_complex *) m_in, m_out, fft_planner_flags | FFTW_PRESERVE_INPUT);
+      new_plans = true;
+    }
 
   /* store plan for size N as member variables */
   plan_fft = pfft;
   plan_ifft = pifft;
 
-  // we could add code for saving plans here, and use patient planning
+  if (new_plans)
+    save_wisdom();
+}
+
+FFTProcessor&
+FFTProcessor::thread_local_instance (size_t N)
+{
+  thread_local map<size_t, std::unique_ptr<FFTProcessor>> processors;
+
+  auto& processor = processors[N];
+  if (!processor)
+    processor = std::make_unique<FFTProcessor> (N);
+  return *processor;
 }
 
 FFTProcessor::~FFTProcessor()
@@ -82,12 +151,14 @@ FFTProcessor::~FFTProcessor()
 void
 FFTProcessor::fft()
 {
+  Stats::count (Stat::FFT);
   fftwf_execute_dft_r2c (plan_fft, m_in, (fftwf_complex *) m_out);
 }
 
 void
 FFTProcessor::ifft()
 {
+  Stats::count (Stat::FFT);
   fftwf_execute_dft_c2r (plan_ifft, (fftwf_complex *) m_in, m_out);
 }
 
@@ -116,3 +187,51 @@ FFTProcessor::fft (const vector<float>& in)
 
   return out;
 }
+
+FFTBatchProcessor::FFTBatchProcessor (size_t N, size_t howmany) :
+  m_howmany (howmany)
+{
+  std::lock_guard<std::mutex> lg (fft_planner_mutex);
+
+  const size_t N_2 = N + 2; /* extra space for r2c extra complex output */
+
+  m_in  = static_cast<float *> (fftwf_malloc (sizeof (float) * N * howmany));
+  m_out = static_cast<float *> (fftwf_malloc (sizeof (float) * N_2 * howmany));
+
+  fftwf_plan& pfft = fft_plan_map.batch_fft_plan[{ N, howmany }];
+  if (!pfft)
+    {
+      const int n = N;
+      pfft = fftwf_plan_many_dft_r2c (1, &n, howmany,
+                                      m_in, nullptr, 1, N,
+                                      (fftwf_complex *) m_out, nullptr, 1, N_2 / 2,
+                                      fft_planner_flags | FFTW_PRESERVE_INPUT);
+      save_wisdom();
+    }
+  plan_fft = pfft;
+}
+
+FFTBatchProcessor::~FFTBatchProcessor()
+{
+  fftwf_free (m_in);
+  fftwf_free (m_out);
+}
+
+void
+FFTBatchProcessor::fft()
+{
+  Stats::count (Stat::FFT, m_howmany);
+  fftwf_execute_dft_r2c (plan_fft, m_in, (fftwf_complex *) m_out);
+}
+
+FFTBatchProcessor&
+FFTBatchProcessor::thread_local_instance (size_t N, size_t howmany)
+{
+  thread_local map<std::pair<size_t, size_t>, std::unique_ptr<FFTBatchProcessor>> processors;
+
+  auto& processor = processors[{ N, howmany }];
+  if (!processor)
+    processor = std::make_unique<FFTBatchProcessor> (N, howmany);
+  return *processor;
+}
+
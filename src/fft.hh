@@ -20,6 +20,7 @@
 
 #include <complex>
 #include <vector>
+#include <string>
 #include <fftw3.h>
 
 class FFTProcessor
@@ -41,6 +42,35 @@ public:
   /* high level (convenient) */
   std::vector<std::complex<float>> fft (const std::vector<float>& in);
   std::vector<float>               ifft (const std::vector<std::complex<float>>& in);
+
+  /* reusable processor owned by the calling thread (no planner lock / allocation after first use) */
+  static FFTProcessor& thread_local_instance (size_t N);
 };
 
+/*
+ * FFTBatchProcessor performs howmany real-to-complex FFTs of size N with one
+ * plan: input i starts at in() + i * N, output i starts at out() + i * (N + 2).
+ */
+class FFTBatchProcessor
+{
+  fftwf_plan plan_fft;
+  float *m_in = nullptr;
+  float *m_out = nullptr;
+  size_t m_howmany = 0;
+public:
+  FFTBatchProcessor (size_t N, size_t howmany);
+  ~FFTBatchProcessor();
+
+  void   fft();
+  float *in()  { return m_in; }
+  float *out() { return m_out; };
+
+  static FFTBatchProcessor& thread_local_instance (size_t N, size_t howmany);
+};
+
+enum class FFTPlanning { ESTIMATE, MEASURE, PATIENT };
+
+/* call before the first FFT is created; wisdom_filename can be empty (don't load/save wisdom) */
+void fft_set_planning (FFTPlanning planning, const std::string& wisdom_filename);
+
 #endif /* AUDIOWMARK_FFT_HH */
@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+
+# test how long hls-add takes until the first transport stream packets / the first audio packet are available
+#
+# usage: hls-ttfb-test.py <prepared_ts> [ <extra audiowmark options> ]
+
+import subprocess
+import shlex
+import time
+import sys
+
+TS_PACKET_SIZE = 188
+
+# PIDs used by ffmpeg for tables (PAT, SDT, PMT) - everything else is audio
+TABLE_PIDS = [ 0x0000, 0x0011, 0x1000 ]
+
+cmd = [ "audiowmark", "hls-add", sys.argv[1], "-", "0123456789abcdef0011223344556677" ] + shlex.split (" ".join (sys.argv[2:]))
+
+first_byte_ms = 0
+first_audio_ms = 0
+total_ms = 0
+runs = 10
+
+for i in range (runs):
+    start_time = time.time() * 1000
+    proc = subprocess.Popen (cmd, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+
+    first_byte_time = None
+    first_audio_time = None
+    while True:
+        packet = proc.stdout.read (TS_PACKET_SIZE)
+        if len (packet) < TS_PACKET_SIZE:
+            break
+
+        now = time.time() * 1000
+        if first_byte_time is None:
+            first_byte_time = now
+
+        pid = ((packet[1] & 0x1f) << 8) + packet[2]
+        if first_audio_time is None and pid not in TABLE_PIDS:
+            first_audio_time = now
+    proc.wait()
+    end_time = time.time() * 1000
+
+    if first_byte_time is None or first_audio_time is None:
+        print ("hls-add did not produce any audio packets (exit code %d)" % proc.returncode)
+        sys.exit (1)
+
+    first_byte_ms += first_byte_time - start_time
+    first_audio_ms += first_audio_time - start_time
+    total_ms += end_time - start_time
+    print ("first byte %.2f  first audio %.2f  total %.2f" % (first_byte_time - start_time, first_audio_time - start_time, end_time - start_time))
+
+print ("first byte %.2f  first audio %.2f  total %.2f avg" % (first_byte_ms / runs, first_audio_ms / runs, total_ms / runs))
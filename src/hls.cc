@@ -18,8 +18,8 @@
 #include <string>
 #include <regex>
 
+#include <assert.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -27,8 +27,11 @@
 #include "mpegts.hh"
 #include "sfinputstream.hh"
 #include "sfoutputstream.hh"
+#include "rawinputstream.hh"
+#include "rawconverter.hh"
 #include "wmcommon.hh"
 #include "wavdata.hh"
+#include "hls.hh"
 
 #include "config.h"
 
@@ -52,9 +55,26 @@ hls_add (const Key& key, const string& infile, const string& outfile, const stri
   error ("audiowmark: hls support is not available in this build of audiowmark\n");
   return 1;
 }
+
+int
+hls_prepare_ab (const Key& key, const string& in_dir, const string& out_dir, const string& filename)
+{
+  error ("audiowmark: hls support is not available in this build of audiowmark\n");
+  return 1;
+}
+
+int
+hls_get (const vector<Key>& key_list, const string& playlist, const string& orig_pattern)
+{
+  error ("audiowmark: hls support is not available in this build of audiowmark\n");
+  return 1;
+}
 #else
 
 #include "hlsoutputstream.hh"
+#include "hlsinputstream.hh"
+#include "ffinputstream.hh"
+#include "threadpool.hh"
 
 static bool
 file_exists (const string& filename)
@@ -68,136 +88,107 @@ file_exists (const string& filename)
   return false;
 }
 
-static string
-args2string (const vector<string>& args)
+/* encode audio context (samples including pre-/post-context) as configured by --context */
+Error
+hls_encode_context (HLSContext context, const vector<float>& samples, int n_channels, int sample_rate,
+                    string& entry_name, vector<unsigned char>& data, map<string, string>& vars)
 {
-  string result;
-  bool first = true;
+  /* 16 bit pcm is sufficient for the context, since it will be encoded as AAC afterwards */
+  const int context_bit_depth = 16;
 
-  for (auto a : args)
+  if (context == HLSContext::RAW)
     {
-      if (!first)
-        result += " ";
-      first = false;
-      result += a;
-    }
-  return result;
-}
+      /* no decoding required in hls-add, but about twice the size of flac */
+      RawFormat format (n_channels, sample_rate, context_bit_depth);
 
-static Error
-run (const vector<string>& args, vector<string> *pipe_out = nullptr)
-{
-  auto report_error = [=] { error ("audiowmark: failed to execute %s\n", args2string (args).c_str()); };
+      Error err;
+      std::unique_ptr<RawConverter> raw_converter (RawConverter::create (format, err));
+      if (err)
+        return err;
 
-  char *argv[args.size() + 1];
-  for (size_t i = 0; i < args.size(); i++)
-    argv[i] = (char *) args[i].c_str();
-  argv[args.size()] = nullptr;
+      data.resize (samples.size() * context_bit_depth / 8);
+      raw_converter->to_raw (samples.data(), data.data(), samples.size());
 
-  int pipe_fds[2];
-  if (pipe_out)
-    {
-      if (pipe (pipe_fds) == -1)
-        {
-          report_error();
-          return Error ("pipe() failed");
-        }
+      vars["context_channels"] = string_printf ("%d", n_channels);
+      vars["context_sample_rate"] = string_printf ("%d", sample_rate);
+      vars["context_bit_depth"] = string_printf ("%d", context_bit_depth);
+      entry_name = "full.raw";
+      return Error::Code::NONE;
     }
-  pid_t pid = fork();
-  if (pid < 0)
-    {
-      if (pipe_out)
-        {
-          close (pipe_fds[0]);
-          close (pipe_fds[1]);
-        }
-      report_error();
-      return Error ("fork() failed");
-    }
-  if (pid == 0) /* child process */
-    {
-      if (pipe_out)
-        {
-          // replace stdout with pipe
-          if (dup2 (pipe_fds[1], STDOUT_FILENO) == -1)
-            {
-              perror ("audiowmark: dup2() failed");
-              exit (127);
-            }
 
-          // close remaining pipe fds
-          close (pipe_fds[0]);
-          close (pipe_fds[1]);
-        }
-      execvp (argv[0], argv);
-      perror ("audiowmark: execvp() failed");
+  SFOutputStream out_stream;
+  if (context == HLSContext::FLAC_FAST)
+    out_stream.set_compression_level (0);
 
-      // should not be reached in normal operation, so exec failed
-      exit (127);
-    }
+  Error err = out_stream.open (&data,
+                               n_channels, sample_rate, context_bit_depth,
+                               Encoding::SIGNED, /* flac does not support floating point audio */
+                               SFOutputStream::OutFormat::FLAC);
+  if (err)
+    return Error (string_printf ("open context flac failed: %s", err.message()));
 
-  /* parent process */
-  if (pipe_out) /* capture child stdout */
-    {
-      close (pipe_fds[1]); // close pipe write fd
+  err = out_stream.write_frames (samples);
+  if (err)
+    return Error (string_printf ("write context flac failed: %s", err.message()));
 
-      FILE *f = fdopen (pipe_fds[0], "r");
-      if (!f)
-        {
-          close (pipe_fds[0]);
-          report_error();
-          return Error ("fdopen() pipe failed");
-        }
-      char buffer[1024];
-      while (fgets (buffer, 1024, f))
-        {
-          if (strlen (buffer) && buffer[strlen (buffer) - 1] == '\n')
-            buffer[strlen (buffer) - 1] = 0;
-          if (pipe_out)
-            pipe_out->push_back (buffer);
-        }
-      fclose (f);        // close pipe read fd
-    }
-  int status;
-  pid_t exited = waitpid (pid, &status, 0);
-  if (exited < 0)
-    {
-      report_error();
-      return Error ("waitpid() failed");
-    }
-  if (WIFEXITED (status))
+  err = out_stream.close();
+  if (err)
+    return Error (string_printf ("close context flac failed: %s", err.message()));
+
+  entry_name = "full.flac";
+  return Error::Code::NONE;
+}
+
+/* open audio context of a prepared segment (any format hls_encode_context supports) */
+Error
+hls_open_context (const TSReader::Entry& entry, const map<string, string>& vars, std::unique_ptr<AudioInputStream>& in_stream)
+{
+  if (entry.filename == "full.flac")
     {
-      int exit_status = WEXITSTATUS (status);
-      if (exit_status != 0)
-        {
-          report_error();
-          return Error (string_printf ("subprocess failed / exit status %d", exit_status));
-        }
+      SFInputStream *sf_in_stream = new SFInputStream();
+      in_stream.reset (sf_in_stream);
+
+      return sf_in_stream->open (&entry.data);
     }
-  else
+  if (entry.filename == "full.raw")
     {
-      report_error();
-      return Error ("child didn't exit normally");
+      auto get_int_var = [&] (const string& var) {
+        auto it = vars.find (var);
+        return it != vars.end() ? atoi (it->second.c_str()) : 0;
+      };
+      RawFormat format (get_int_var ("context_channels"), get_int_var ("context_sample_rate"), get_int_var ("context_bit_depth"));
+
+      RawInputStream *raw_in_stream = new RawInputStream();
+      in_stream.reset (raw_in_stream);
+
+      return raw_in_stream->open (&entry.data, format);
     }
-  return Error::Code::NONE;
+  return Error (string_printf ("unsupported context format: %s", entry.filename.c_str()));
 }
 
+/* open the context of a prepared segment, independent of the context encoding */
 Error
-ff_decode (const string& filename, WavData& out_wav_data)
+hls_open_context (const TSReader& reader, const map<string, string>& vars, std::unique_ptr<AudioInputStream>& in_stream)
 {
-  FILE *tmp_file = tmpfile();
-  ScopedFile tmp_file_s (tmp_file);
-  string tmp_file_name = string_printf ("/dev/fd/%d", fileno (tmp_file));
+  const TSReader::Entry *entry = reader.find ("full.flac");
+  if (!entry)
+    entry = reader.find ("full.raw");
+  if (!entry)
+    return Error ("no embedded context found");
 
-  if (!tmp_file)
-    return Error ("failed to create temp file");
+  return hls_open_context (*entry, vars, in_stream);
+}
+
+Error
+ff_decode (const string& filename, WavData& out_wav_data)
+{
+  FFInputStream in_stream;
 
-  Error err = run ({"ffmpeg", "-v", "error", "-nostdin", "-y", "-f",  "mpegts", "-i", filename, "-f", "wav", tmp_file_name});
+  Error err = in_stream.open (filename, "mpegts");
   if (err)
     return err;
 
-  err = out_wav_data.load (tmp_file_name);
-  return err;
+  return out_wav_data.load (&in_stream);
 }
 
 int
@@ -212,22 +203,15 @@ hls_add (const Key& key, const string& infile, const string& outfile, const stri
       return 1;
     }
 
-  const TSReader::Entry *full_flac = reader.find ("full.flac");
-  if (!full_flac)
-    {
-      error ("hls: no embedded context found in %s\n", infile.c_str());
-      return 1;
-    }
+  map<string, string> vars = reader.parse_vars ("vars");
 
-  SFInputStream in_stream;
-  err = in_stream.open (&full_flac->data);
+  std::unique_ptr<AudioInputStream> in_stream;
+  err = hls_open_context (reader, vars, in_stream);
   if (err)
     {
-      error ("hls: %s\n", err.message());
+      error ("hls: %s: %s\n", infile.c_str(), err.message());
       return 1;
     }
-
-  map<string, string> vars = reader.parse_vars ("vars");
   bool missing_vars = false;
 
   auto get_var = [&] (const std::string& var) {
@@ -256,7 +240,7 @@ hls_add (const Key& key, const string& infile, const string& outfile, const stri
   if (Params::hls_bit_rate)  // command line option overrides vars bit-rate
     bit_rate = Params::hls_bit_rate;
 
-  HLSOutputStream out_stream (in_stream.n_channels(), in_stream.sample_rate(), in_stream.bit_depth());
+  HLSOutputStream out_stream (in_stream->n_channels(), in_stream->sample_rate(), in_stream->bit_depth());
 
   out_stream.set_bit_rate (bit_rate);
   out_stream.set_channel_layout (channel_layout);
@@ -276,7 +260,7 @@ hls_add (const Key& key, const string& infile, const string& outfile, const stri
       return 1;
     }
 
-  int wm_rc = add_stream_watermark (key, &in_stream, &out_stream, bits, start_pos - prev_size);
+  int wm_rc = add_stream_watermark (key, in_stream.get(), &out_stream, bits, start_pos - prev_size);
   if (wm_rc != 0)
     return wm_rc;
 
@@ -284,104 +268,298 @@ hls_add (const Key& key, const string& infile, const string& outfile, const stri
   return 0;
 }
 
-Error
-bit_rate_from_m3u8 (const string& m3u8, const WavData& wav_data, int& bit_rate)
+/*
+ * sequential reader for the audio master: instead of loading the whole (possibly huge)
+ * audio master into memory, only the samples needed for the current segment + context
+ * are kept, so memory usage doesn't depend on the length of the audio master
+ */
+class AudioMasterReader
 {
-  FILE *tmp_file = tmpfile();
-  ScopedFile tmp_file_s (tmp_file);
-  string tmp_file_name = string_printf ("/dev/fd/%d", fileno (tmp_file));
+  std::unique_ptr<AudioInputStream> m_in_stream;
+  string        m_filename;
+  vector<float> m_samples;     // interleaved samples, starting at frame m_offset
+  size_t        m_offset = 0;
+  bool          m_eof = false;
+
+  size_t
+  n_buffered() const
+  {
+    return m_samples.size() / m_in_stream->n_channels();
+  }
+  void
+  discard_before (size_t pos)
+  {
+    const size_t n = min (pos - m_offset, n_buffered());
+
+    m_samples.erase (m_samples.begin(), m_samples.begin() + n * m_in_stream->n_channels());
+    m_offset += n;
+  }
+public:
+  Error
+  open (const string& filename)
+  {
+    /* decode in-process, without extracting a (possibly huge) temporary wav file */
+    FFInputStream *ff_stream = new FFInputStream();
+    m_in_stream.reset (ff_stream);
+    m_filename = filename;
+    return ff_stream->open (filename);
+  }
+  int
+  n_channels() const
+  {
+    return m_in_stream->n_channels();
+  }
+  int
+  sample_rate() const
+  {
+    return m_in_stream->sample_rate();
+  }
+  /* skip frames before pos: seek if the audio master supports it, otherwise decode and discard */
+  Error
+  skip_to (size_t pos)
+  {
+    assert (m_offset == 0 && m_samples.empty());
+
+    if (pos)
+      {
+        if (!m_in_stream->seek (pos))
+          {
+            m_offset = pos;
+            return Error::Code::NONE;
+          }
+        /* the decoder position is undefined after a failed seek, so start again (stdin never gets that far) */
+        if (m_filename != "-")
+          {
+            Error err = open (m_filename);
+            if (err)
+              return err;
+          }
+      }
+    vector<float> samples;
+    return read_window (pos, 0, samples);
+  }
+  /* read frames [start, start + count) - the result is shorter if the audio master ends
+   * before that; start must not be smaller than in the previous call
+   */
+  Error
+  read_window (size_t start, size_t count, vector<float>& out_samples)
+  {
+    assert (start >= m_offset);
 
-  if (!tmp_file)
-    return Error ("failed to create temp file");
+    const int block_size = 64 * 1024;
 
-  Error err = run ({"ffmpeg", "-v", "error", "-nostdin", "-y", "-i", m3u8, "-c:a", "copy", "-f", "adts", tmp_file_name});
+    vector<float> block;
+    while (!m_eof && m_offset + n_buffered() < start + count)
+      {
+        Error err = m_in_stream->read_frames (block, block_size);
+        if (err)
+          return err;
+
+        m_eof = block.empty();
+        m_samples.insert (m_samples.end(), block.begin(), block.end());
+        discard_before (start);
+      }
+    discard_before (start);
+
+    if (m_offset < start) /* audio master ended before start */
+      out_samples.clear();
+    else
+      out_samples.assign (m_samples.begin(), m_samples.begin() + min (count, n_buffered()) * m_in_stream->n_channels());
+    return Error::Code::NONE;
+  }
+};
+
+struct Segment
+{
+  string              name;
+  size_t              size = 0;
+  int                 sample_rate = 0;
+  size_t              n_adts_bytes = 0;
+  map<string, string> params;
+  map<string, string> vars;
+  Error               err;
+};
+
+/* in-process replacement for ffprobe -show_streams + ffmpeg decoding:
+ *  - params contains the stream properties we need for validation
+ *  - the audio stream is decoded to get the exact number of samples
+ */
+static Error
+analyze_input_segment (const string& filename, Segment& segment)
+{
+  TSReader reader;
+
+  Error err = reader.load (filename);
+  if (err)
+    return Error (string_printf ("failed to read mpegts input file: %s", filename.c_str()));
+
+  if (reader.entries().size())
+    return Error (string_printf ("file appears to be already prepared: %s (input for hls-prepare must not contain context)", filename.c_str()));
+
+  /* close demuxer after decoder */
+  std::unique_ptr<AVFormatContext, void (*) (AVFormatContext *)> fmt_ctx (nullptr, [] (AVFormatContext *ctx) { avformat_close_input (&ctx); });
+
+  AVFormatContext *ctx = nullptr;
+  int ret = avformat_open_input (&ctx, filename.c_str(), av_find_input_format ("mpegts"), nullptr);
+  if (ret < 0)
+    return Error (string_printf ("failed to validate input file: %s", filename.c_str()));
+  fmt_ctx.reset (ctx);
+
+  ret = avformat_find_stream_info (ctx, nullptr);
+  if (ret < 0)
+    return Error (string_printf ("failed to validate input file: %s", filename.c_str()));
+
+  for (unsigned int i = 0; i < ctx->nb_streams; i++)
+    {
+      const AVStream *st = ctx->streams[i];
+
+      char layout[256] = "";
+      av_channel_layout_describe (&st->codecpar->ch_layout, layout, sizeof (layout));
+
+      segment.params["index"] = string_printf ("%u", i);
+      segment.params["codec_name"] = avcodec_get_name (st->codecpar->codec_id);
+      segment.params["channels"] = string_printf ("%d", st->codecpar->ch_layout.nb_channels);
+      segment.params["channel_layout"] = layout;
+      if (st->start_time != AV_NOPTS_VALUE)
+        segment.params["start_time"] = string_printf ("%f", st->start_time * av_q2d (st->time_base));
+    }
+  if (ctx->nb_streams != 1 || ctx->streams[0]->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
+    return Error::Code::NONE; // hls_prepare reports this
+
+  FFInputStream in_stream;
+  err = in_stream.open (ctx, 0, nullptr);
   if (err)
     return err;
 
-  struct stat stat_buf;
-  if (stat (tmp_file_name.c_str(), &stat_buf) != 0)
+  vector<float> samples;
+  do
     {
-      return Error (string_printf ("failed to stat temporary aac file: %s", strerror (errno)));
+      err = in_stream.read_frames (samples, 16 * 1024);
+      if (err)
+        return err;
+
+      segment.size += samples.size() / in_stream.n_channels();
     }
-  double seconds = double (wav_data.n_frames()) / wav_data.sample_rate();
-  bit_rate = stat_buf.st_size / seconds * 8;
+  while (samples.size());
+
+  segment.sample_rate = in_stream.sample_rate();
+
+  /* size of this segment as adts stream (ffmpeg -c:a copy -f adts): 7 byte header per packet */
+  segment.n_adts_bytes = in_stream.n_packet_bytes() + 7 * in_stream.n_packets();
   return Error::Code::NONE;
 }
 
-Error
-load_audio_master (const string& filename, WavData& audio_master_data)
+/* write context + vars into a copy of the input segment */
+static Error
+write_output_segment (const string& in_segment, const string& out_segment, vector<float>& samples, int n_channels, int sample_rate,
+                      size_t segment_size_with_ctx, map<string, string>& vars)
 {
-  FILE *tmp_file = tmpfile();
-  ScopedFile tmp_file_s (tmp_file);
-  string tmp_file_name = string_printf ("/dev/fd/%d", fileno (tmp_file));
-
-  if (!tmp_file)
-    return Error ("failed to create temp file");
-
-  /* extract wav */
-  Error err = run ({"ffmpeg", "-v", "error", "-nostdin", "-y", "-i", filename, "-f", "wav", tmp_file_name});
+  /* append zeros if the audio master is too short to provide segment with context */
+  const size_t n_frames = samples.size() / n_channels;
+  if (n_frames < segment_size_with_ctx)
+    samples.resize (segment_size_with_ctx * n_channels);
+
+  string entry_name;
+  vector<unsigned char> context_data;
+  Error err = hls_encode_context (Params::hls_context, samples, n_channels, sample_rate, entry_name, context_data, vars);
   if (err)
     return err;
 
-  err = audio_master_data.load (tmp_file_name);
-  if (err)
-    return err;
+  /* store everything we need in a mpegts file */
+  TSWriter writer;
 
-  return Error::Code::NONE;
+  writer.append_data (entry_name, std::move (context_data));
+  writer.append_vars ("vars", vars);
+
+  return writer.process (in_segment, out_segment);
 }
 
-Error
-probe_input_segment (const string& filename, map<string, string>& params)
+/*
+ * state of incremental hls-prepare (--state), for live or event playlists that grow
+ * over time: each hls-prepare run only processes the segments that were appended to
+ * the playlist after the last run, starting at the saved audio master position
+ *
+ * segments are identified by their media sequence number (#EXT-X-MEDIA-SEQUENCE +
+ * index in the playlist), so sliding window playlists which drop old segments work
+ */
+struct HLSPrepareState
 {
-  TSReader reader;
+  string last_segment;      // name of the last prepared segment
+  size_t next_sequence = 0; // media sequence number of the next segment
+  size_t start_pos = 0;     // audio master position of the next segment
+  int    bit_rate = 0;
+  string channel_layout;
+};
+
+/* write to a temporary file + rename, so readers never see a partially written file */
+static Error
+write_file_atomic (const string& filename, const string& contents)
+{
+  const string tmp_filename = filename + ".tmp";
 
-  Error err = reader.load (filename);
-  if (err)
+  FILE *file = fopen (tmp_filename.c_str(), "w");
+  if (!file)
+    return Error (string_printf ("error opening %s: %s", tmp_filename.c_str(), strerror (errno)));
+
+  bool ok = fwrite (contents.data(), 1, contents.size(), file) == contents.size();
+  ok = (fclose (file) == 0) && ok;
+  if (!ok)
     {
-      error ("audiowmark: hls: failed to read mpegts input file: %s\n", filename.c_str());
-      return err;
+      unlink (tmp_filename.c_str());
+      return Error (string_printf ("error writing %s", tmp_filename.c_str()));
     }
-
-  if (reader.entries().size())
+  if (rename (tmp_filename.c_str(), filename.c_str()) != 0)
     {
-      error ("audiowmark: hls: file appears to be already prepared: %s\n", filename.c_str());
-      return Error ("input for hls-prepare must not contain context");
+      Error err (string_printf ("error renaming %s: %s", tmp_filename.c_str(), strerror (errno)));
+      unlink (tmp_filename.c_str());
+      return err;
     }
+  return Error::Code::NONE;
+}
 
-  vector<string> format_out;
-  err = run ({"ffprobe", "-v", "error", "-print_format", "compact", "-show_streams", filename}, &format_out);
-  if (err)
+static Error
+save_state (const string& filename, const HLSPrepareState& state)
+{
+  string contents;
+  contents += "last_segment=" + state.last_segment + "\n";
+  contents += string_printf ("next_sequence=%zd\n", state.next_sequence);
+  contents += string_printf ("start_pos=%zd\n", state.start_pos);
+  contents += string_printf ("bit_rate=%d\n", state.bit_rate);
+  contents += "channel_layout=" + state.channel_layout + "\n";
+
+  return write_file_atomic (filename, contents);
+}
+
+static Error
+load_state (const string& filename, HLSPrepareState& state)
+{
+  FILE *file = fopen (filename.c_str(), "r");
+  ScopedFile file_s (file);
+  if (!file)
+    return Error (string_printf ("error opening state file %s: %s", filename.c_str(), strerror (errno)));
+
+  map<string, string> vars;
+  char buffer[1024];
+  while (fgets (buffer, 1024, file))
     {
-      error ("audiowmark: hls: failed to validate input file: %s\n", filename.c_str());
-      return err;
+      string s = buffer;
+      while (s.size() && (s.back() == '\n' || s.back() == '\r'))
+        s.pop_back();
+
+      size_t eq = s.find ('=');
+      if (eq != string::npos)
+        vars[s.substr (0, eq)] = s.substr (eq + 1);
     }
-  for (auto o : format_out)
+  for (auto key : { "last_segment", "next_sequence", "start_pos", "bit_rate", "channel_layout" })
     {
-      /* parse assignments stream|index=0|codec_name=aac|... */
-      string key, value;
-      bool in_key = true;
-      for (char c : '|' + o + '|')
-        {
-          if (c == '=')
-            {
-              in_key = false;
-            }
-          else if (c == '|')
-            {
-              params[key] = value;
-              in_key = true;
-              key = "";
-              value = "";
-            }
-          else
-            {
-              if (in_key)
-                key += c;
-              else
-                value += c;
-            }
-        }
+      if (!vars.count (key))
+        return Error (string_printf ("state file %s is missing value for '%s'", filename.c_str(), key));
     }
+  state.last_segment   = vars["last_segment"];
+  state.next_sequence  = atoll (vars["next_sequence"].c_str());
+  state.start_pos      = atoll (vars["start_pos"].c_str());
+  state.bit_rate       = atoi (vars["bit_rate"].c_str());
+  state.channel_layout = vars["channel_layout"];
   return Error::Code::NONE;
 }
 
@@ -405,36 +583,44 @@ hls_prepare (const string& in_dir, const string& out_dir, const string& filename
       return 1;
     }
 
-  string out_name = out_dir + "/" + filename;
-  if (file_exists (out_name))
+  const bool incremental = !Params::hls_state_file.empty();
+
+  HLSPrepareState state;
+  bool have_state = false;
+  if (incremental && file_exists (Params::hls_state_file))
     {
-      error ("audiowmark: output file already exists: %s\n", out_name.c_str());
-      return 1;
+      Error err = load_state (Params::hls_state_file, state);
+      if (err)
+        {
+          error ("audiowmark: %s\n", err.message());
+          return 1;
+        }
+      have_state = true;
     }
-  FILE *out_file = fopen (out_name.c_str(), "w");
-  ScopedFile out_file_s (out_file);
 
-  if (!out_file)
+  /* the output playlist is only updated by runs that continue from a state file */
+  string out_name = out_dir + "/" + filename;
+  if (!have_state && file_exists (out_name))
     {
-      error ("audiowmark: error opening output playlist %s\n", out_name.c_str());
+      error ("audiowmark: output file already exists: %s\n", out_name.c_str());
       return 1;
     }
 
-  WavData audio_master_data;
-  Error err = load_audio_master (audio_master, audio_master_data);
+  AudioMasterReader audio_master_reader;
+  Error err = audio_master_reader.open (audio_master);
   if (err)
     {
       error ("audiowmark: failed to load audio master: %s\n", audio_master.c_str());
       return 1;
     }
 
-  struct Segment
-  {
-    string              name;
-    size_t              size;
-    map<string, string> vars;
-  };
+  vector<string> lines;
   vector<Segment> segments;
+  vector<size_t> segment_lines;   // playlist line of each segment
+  int last_prepared_line = -1;    // last line of the playlist that refers to a prepared segment
+  bool playlist_ended = false;
+  size_t sequence = 0;            // media sequence number of the next segment in the playlist
+  size_t first_sequence = 0;      // media sequence number of the first segment in the playlist
   char buffer[1024];
   const regex blank_re (R"(\s*(#.*)?)");
   while (fgets (buffer, 1024, in_file))
@@ -445,30 +631,73 @@ hls_prepare (const string& in_dir, const string& out_dir, const string& filename
         buffer[last--] = 0;
 
       string s = buffer;
+      lines.push_back (s);
 
       std::smatch match;
       if (regex_match (s, blank_re))
         {
           /* blank line or comment */
-          fprintf (out_file, "%s\n", s.c_str());
+          if (s.compare (0, 14, "#EXT-X-ENDLIST") == 0)
+            playlist_ended = true;
+          if (s.compare (0, 22, "#EXT-X-MEDIA-SEQUENCE:") == 0)
+            first_sequence = sequence = atoll (s.substr (22).c_str());
+        }
+      else if (have_state && sequence < state.next_sequence)
+        {
+          /* segment that has been prepared by a previous run */
+          if (sequence + 1 == state.next_sequence && s != state.last_segment)
+            {
+              error ("audiowmark: playlist %s has segment '%s' where the last prepared segment '%s' was expected\n",
+                     in_name.c_str(), s.c_str(), state.last_segment.c_str());
+              return 1;
+            }
+          last_prepared_line = lines.size() - 1;
+          sequence++;
         }
       else
         {
-          fprintf (out_file, "%s\n", s.c_str());
           Segment segment;
           segment.name = s;
           segments.push_back (segment);
+          segment_lines.push_back (lines.size() - 1);
+          sequence++;
         }
     }
+  if (have_state && first_sequence > state.next_sequence)
+    {
+      /* we can't continue without the audio master position of the next segment */
+      error ("audiowmark: segments after last prepared segment '%s' are no longer contained in playlist %s\n",
+             state.last_segment.c_str(), in_name.c_str());
+      return 1;
+    }
+  if (have_state && sequence < state.next_sequence)
+    {
+      error ("audiowmark: last prepared segment '%s' is no longer contained in playlist %s\n", state.last_segment.c_str(), in_name.c_str());
+      return 1;
+    }
+  if (!have_state)
+    state.next_sequence = first_sequence;
+  /* analyze (probe + decode) all input segments in parallel */
+  ThreadPool thread_pool;
+  for (auto& segment : segments)
+    {
+      thread_pool.add_job ([&segment, &in_dir]()
+        {
+          segment.err = analyze_input_segment (in_dir + "/" + segment.name, segment);
+        });
+    }
+  thread_pool.wait_all();
+
+  size_t n_adts_bytes = 0;
+  double n_segment_seconds = 0;
   for (auto& segment : segments)
     {
-      map<string, string> params;
       string segname = in_dir + "/" + segment.name;
+      auto& params = segment.params;
 
-      Error err = probe_input_segment (segname, params);
-      if (err)
+      if (segment.err)
         {
-          error ("audiowmark: hls: %s\n", err.message());
+          error ("audiowmark: hls: %s\n", segment.err.message());
           return 1;
         }
       /* validate input segment */
@@ -483,10 +712,10 @@ hls_prepare (const string& in_dir, const string& out_dir, const string& filename
           return 1;
         }
       int segment_channels = atoi (params["channels"].c_str());
-      if (segment_channels != audio_master_data.n_channels())
+      if (segment_channels != audio_master_reader.n_channels())
         {
           error ("audiowmark: number of channels mismatch:\n - hls segment '%s' has %d channels\n - audio master '%s' has %d channels\n",
-                 segname.c_str(), segment_channels, audio_master.c_str(), audio_master_data.n_channels());
+                 segname.c_str(), segment_channels, audio_master.c_str(), audio_master_reader.n_channels());
           return 1;
         }
 
@@ -496,6 +725,12 @@ hls_prepare (const string& in_dir, const string& out_dir, const string& filename
           error ("audiowmark: hls segment '%s' has no channel_layout entry\n", segname.c_str());
           return 1;
         }
+      if (have_state && params["channel_layout"] != state.channel_layout)
+        {
+          error ("audiowmark: hls segment '%s' has channel layout '%s', previous segments have '%s'\n",
+                 segname.c_str(), params["channel_layout"].c_str(), state.channel_layout.c_str());
+          return 1;
+        }
       segment.vars["channel_layout"] = params["channel_layout"];
 
       /* get start pts */
@@ -505,47 +740,68 @@ hls_prepare (const string& in_dir, const string& out_dir, const string& filename
           return 1;
         }
       segment.vars["pts_start"] = params["start_time"];
+
+      if ((segment.size % 1024) != 0)
+        {
+          error ("audiowmark: hls input segments need 1024-sample alignment (due to AAC)\n");
+          return 1;
+        }
+      n_adts_bytes += segment.n_adts_bytes;
+      n_segment_seconds += double (segment.size) / segment.sample_rate;
+
+      string out_segment = out_dir + "/" + segment.name;
+      if (file_exists (out_segment))
+        {
+          error ("audiowmark: output file already exists: %s\n", out_segment.c_str());
+          return 1;
+        }
     }
 
   /* find bitrate for AAC encoder */
   int bit_rate = 0;
-  if (!Params::hls_bit_rate)
+  if (Params::hls_bit_rate)
     {
-      err = bit_rate_from_m3u8 (in_dir + "/" + filename, audio_master_data, bit_rate);
-      if (err)
-        {
-          error ("audiowmark: bit-rate detection failed: %s\n", err.message());
-          return 1;
-         }
-      info ("AAC Bitrate:  %d (detected)\n", bit_rate);
+      bit_rate = Params::hls_bit_rate;
+      info ("AAC Bitrate:  %d\n", bit_rate);
     }
-  else
+  else if (have_state)
     {
-      bit_rate = Params::hls_bit_rate;
+      /* all segments of an incremental playlist use the same bit rate */
+      bit_rate = state.bit_rate;
       info ("AAC Bitrate:  %d\n", bit_rate);
     }
-
-  info ("Segments:     %zd\n", segments.size());
-  size_t start_pos = 0;
-  for (auto& segment : segments)
+  else
     {
-      WavData out;
-      Error err = ff_decode (in_dir + "/" + segment.name, out);
-      if (err)
+      /* average bit rate of the input segments */
+      if (n_segment_seconds <= 0)
         {
-          error ("audiowmark: hls: ff_decode failed: %s\n", err.message());
+          error ("audiowmark: bit-rate detection failed: input segments are empty\n");
           return 1;
         }
-      segment.size = out.n_values() / out.n_channels();
+      bit_rate = n_adts_bytes / n_segment_seconds * 8;
+      info ("AAC Bitrate:  %d (detected)\n", bit_rate);
+    }
 
-      if ((segment.size % 1024) != 0)
+  info ("Segments:     %zd\n", segments.size());
+
+  /* start positions are known once all segment sizes are known */
+  size_t start_pos = state.start_pos;
+  if (segments.size())
+    {
+      /* incremental mode: only the new region of the audio master (plus context) is read */
+      err = audio_master_reader.skip_to (start_pos - min<size_t> (start_pos, 3 * segments[0].sample_rate));
+      if (err)
         {
-          error ("audiowmark: hls input segments need 1024-sample alignment (due to AAC)\n");
+          error ("audiowmark: hls: failed to read audio master: %s\n", err.message());
           return 1;
         }
-
+    }
+  size_t n_jobs = 0;
+  size_t n_prepared = 0;
+  for (auto& segment : segments)
+    {
       /* store 3 seconds of the context before this segment and after this segment (if available) */
-      const size_t ctx_3sec = 3 * out.sample_rate();
+      const size_t ctx_3sec = 3 * segment.sample_rate;
       const size_t prev_size = min<size_t> (start_pos, ctx_3sec);
       const size_t segment_size_with_ctx = prev_size + segment.size + ctx_3sec;
 
@@ -554,66 +810,272 @@ hls_prepare (const string& in_dir, const string& out_dir, const string& filename
       segment.vars["prev_size"] = string_printf ("%zd", prev_size);
       segment.vars["bit_rate"] = string_printf ("%d", bit_rate);
 
+      const string out_segment = out_dir + "/" + segment.name;
+
       /* write audio segment with context */
-      const size_t start_point = min (start_pos - prev_size, audio_master_data.n_frames());
-      const size_t end_point = min (start_point + segment_size_with_ctx, audio_master_data.n_frames());
+      vector<float> samples;
+      err = audio_master_reader.read_window (start_pos - prev_size, segment_size_with_ctx, samples);
+      if (err)
+        {
+          error ("audiowmark: hls: failed to read audio master: %s\n", err.message());
+          return 1;
+        }
+      const int n_channels = audio_master_reader.n_channels();
+      const int sample_rate = audio_master_reader.sample_rate();
 
-      vector<float> out_signal (audio_master_data.samples().begin() + start_point * audio_master_data.n_channels(),
-                                audio_master_data.samples().begin() + end_point * audio_master_data.n_channels());
+      /* live playlist: the audio master doesn't contain the context for this segment yet, prepare it during the next run */
+      if (incremental && !playlist_ended && samples.size() < segment_size_with_ctx * n_channels)
+        break;
 
-      // append zeros if audio master is too short to provide segment with context
-      out_signal.resize (segment_size_with_ctx * audio_master_data.n_channels());
+      thread_pool.add_job ([&segment, &in_dir, out_segment, samples = std::move (samples), n_channels, sample_rate, segment_size_with_ctx]() mutable
+        {
+          segment.err = write_output_segment (in_dir + "/" + segment.name, out_segment, samples, n_channels, sample_rate,
+                                              segment_size_with_ctx, segment.vars);
+        });
+      /* limit the number of segment windows in memory */
+      if (++n_jobs % thread_pool.n_threads() == 0)
+        thread_pool.wait_all();
 
-      vector<unsigned char> full_flac_mem;
-      SFOutputStream out_stream;
-      err = out_stream.open (&full_flac_mem,
-                             audio_master_data.n_channels(), audio_master_data.sample_rate(), audio_master_data.bit_depth(),
-                             Encoding::SIGNED, /* flac does not support floating point audio */
-                             SFOutputStream::OutFormat::FLAC);
-      if (err)
+      /* start position for the next segment */
+      start_pos += segment.size;
+      n_prepared++;
+    }
+  thread_pool.wait_all();
+
+  for (size_t i = 0; i < n_prepared; i++)
+    {
+      if (segments[i].err)
         {
-          error ("audiowmark: hls: open context flac failed: %s\n", err.message());
+          error ("audiowmark: processing hls segment %s failed: %s\n", segments[i].name.c_str(), segments[i].err.message());
           return 1;
         }
+    }
+  if (incremental)
+    info ("Prepared:     %zd\n", n_prepared);
+
+  if (n_prepared)
+    last_prepared_line = segment_lines[n_prepared - 1];
 
-      err = out_stream.write_frames (out_signal);
+  if (incremental && last_prepared_line < 0)
+    {
+      /* writing a live playlist without segments would be pointless */
+      info ("Waiting for audio master to provide the first segment\n");
+      return 0;
+    }
+
+  /* output playlist: all segments that are prepared (and everything else if the input playlist is complete) */
+  const size_t n_out_lines = n_prepared == segments.size() ? lines.size() : last_prepared_line + 1;
+  string playlist;
+  for (size_t l = 0; l < n_out_lines; l++)
+    playlist += lines[l] + "\n";
+
+  err = write_file_atomic (out_name, playlist);
+  if (err)
+    {
+      error ("audiowmark: error writing output playlist: %s\n", err.message());
+      return 1;
+    }
+
+  if (incremental)
+    {
+      if (n_prepared)
+        {
+          state.last_segment   = segments[n_prepared - 1].name;
+          state.next_sequence += n_prepared;
+          state.start_pos      = start_pos;
+          state.bit_rate       = bit_rate;
+          state.channel_layout = segments[0].vars["channel_layout"];
+        }
+      err = save_state (Params::hls_state_file, state);
       if (err)
         {
-          error ("audiowmark: hls: write context flac failed: %s\n", err.message());
+          error ("audiowmark: error writing state file: %s\n", err.message());
           return 1;
         }
+    }
+  int orig_seconds = start_pos / audio_master_reader.sample_rate();
+  info ("Time:         %d:%02d\n", orig_seconds / 60, orig_seconds % 60);
+  return 0;
+}
 
-      err = out_stream.close();
-      if (err)
+/*
+ * A/B segment variants: each prepared segment is watermarked twice, once with
+ * payload bit 0 and once with payload bit 1 (plus the index of the payload bit),
+ * so that delivering a watermarked stream only requires picking one of the two
+ * files for each segment, depending on the viewer id bit for this segment.
+ *
+ * Consecutive segments are grouped so that each group is at least two data
+ * blocks long; all segments of a group carry the same payload bit, which
+ * ensures that each group contains at least one complete data block that can
+ * be decoded on its own (see get-ab).
+ */
+int
+hls_prepare_ab (const Key& key, const string& in_dir, const string& out_dir, const string& filename)
+{
+  if (Params::hls_ab_bits < 1 || Params::hls_ab_bits > (1 << ab_index_bits))
+    {
+      error ("audiowmark: number of A/B payload bits must be in range [1, %d]\n", 1 << ab_index_bits);
+      return 1;
+    }
+  if (Params::payload_size <= ab_index_bits || Params::payload_size % 4 != 0)
+    {
+      error ("audiowmark: payload size %zd is not supported for A/B segment variants\n", Params::payload_size);
+      return 1;
+    }
+
+  string in_name = in_dir + "/" + filename;
+  FILE *in_file = fopen (in_name.c_str(), "r");
+  ScopedFile in_file_s (in_file);
+
+  if (!in_file)
+    {
+      error ("audiowmark: error opening input playlist %s\n", in_name.c_str());
+      return 1;
+    }
+
+  /* out_dir/0 and out_dir/1 contain the segments (and a copy of the playlist) for payload bit 0 and 1 */
+  for (string dir : { out_dir, out_dir + "/0", out_dir + "/1" })
+    {
+      int mkret = mkdir (dir.c_str(), 0755);
+      if (mkret == -1 && errno != EEXIST)
         {
-          error ("audiowmark: hls: close context flac failed: %s\n", err.message());
+          error ("audiowmark: unable to create directory %s: %s\n", dir.c_str(), strerror (errno));
           return 1;
         }
+    }
+  string out_names[2];
+  for (int bit = 0; bit < 2; bit++)
+    {
+      out_names[bit] = string_printf ("%s/%d/%s", out_dir.c_str(), bit, filename.c_str());
+      if (file_exists (out_names[bit]))
+        {
+          error ("audiowmark: output file already exists: %s\n", out_names[bit].c_str());
+          return 1;
+        }
+    }
+  FILE *out_file0 = fopen (out_names[0].c_str(), "w");
+  ScopedFile out_file0_s (out_file0);
+  FILE *out_file1 = fopen (out_names[1].c_str(), "w");
+  ScopedFile out_file1_s (out_file1);
+
+  if (!out_file0 || !out_file1)
+    {
+      error ("audiowmark: error opening output playlist %s\n", (out_file0 ? out_names[1] : out_names[0]).c_str());
+      return 1;
+    }
+  string manifest_name = out_dir + "/manifest.json";
+  if (file_exists (manifest_name))
+    {
+      error ("audiowmark: output file already exists: %s\n", manifest_name.c_str());
+      return 1;
+    }
+
+  vector<string> segments;
+  char buffer[1024];
+  const regex blank_re (R"(\s*(#.*)?)");
+  while (fgets (buffer, 1024, in_file))
+    {
+      /* kill newline chars at end */
+      int last = strlen (buffer) - 1;
+      while (last > 0 && (buffer[last] == '\n' || buffer[last] == '\r'))
+        buffer[last--] = 0;
 
-      /* store everything we need in a mpegts file */
-      TSWriter writer;
+      string s = buffer;
+      fprintf (out_file0, "%s\n", s.c_str());
+      fprintf (out_file1, "%s\n", s.c_str());
 
-      writer.append_data ("full.flac", full_flac_mem);
-      writer.append_vars ("vars", segment.vars);
+      if (!regex_match (s, blank_re))
+        segments.push_back (s);
+    }
 
-      string out_segment = out_dir + "/" + segment.name;
-      if (file_exists (out_segment))
+  const double block_seconds = double ((mark_sync_frame_count() + mark_data_frame_count()) * Params::frame_size) / Params::mark_sample_rate;
+
+  string manifest = string_printf ("{\n  \"payload_bits\": %d,\n  \"segments\": [\n", Params::hls_ab_bits);
+  int    group = 0;
+  double group_seconds = 0;
+  for (size_t i = 0; i < segments.size(); i++)
+    {
+      const string& segment = segments[i];
+      string segname = in_dir + "/" + segment;
+
+      /* segment length is required for grouping */
+      TSReader reader;
+      Error err = reader.load (segname);
+      if (err)
         {
-          error ("audiowmark: output file already exists: %s\n", out_segment.c_str());
+          error ("audiowmark: hls: failed to read mpegts input file: %s\n", segname.c_str());
           return 1;
         }
-      err = writer.process (in_dir + "/" + segment.name, out_segment);
+      map<string, string> vars = reader.parse_vars ("vars");
+
+      std::unique_ptr<AudioInputStream> ctx_stream;
+      err = hls_open_context (reader, vars, ctx_stream);
       if (err)
         {
-          error ("audiowmark: processing hls segment %s failed: %s\n", segment.name.c_str(), err.message());
+          error ("audiowmark: hls: %s: %s\n", segname.c_str(), err.message());
           return 1;
         }
+      const double seconds = atof (vars["size"].c_str()) / ctx_stream->sample_rate();
 
-      /* start position for the next segment */
-      start_pos += segment.size;
+      if (group_seconds >= 2 * block_seconds)
+        {
+          group++;
+          group_seconds = 0;
+        }
+      group_seconds += seconds;
+
+      const int index = group % Params::hls_ab_bits;
+      for (int bit = 0; bit < 2; bit++)
+        {
+          string out_segment = string_printf ("%s/%d/%s", out_dir.c_str(), bit, segment.c_str());
+          if (file_exists (out_segment))
+            {
+              error ("audiowmark: output file already exists: %s\n", out_segment.c_str());
+              return 1;
+            }
+          int rc = hls_add (key, segname, out_segment, bit_vec_to_str (ab_message (index, bit)));
+          if (rc != 0)
+            return rc;
+        }
+
+      string json_name;
+      for (char c : segment)
+        {
+          if (c == '"' || c == '\\')
+            json_name += '\\';
+          json_name += c;
+        }
+      manifest += string_printf ("    { \"name\": \"%s\", \"bit_index\": %d }%s\n", json_name.c_str(), index, i + 1 < segments.size() ? "," : "");
     }
-  int orig_seconds = start_pos / audio_master_data.sample_rate();
-  info ("Time:         %d:%02d\n", orig_seconds / 60, orig_seconds % 60);
+  manifest += "  ]\n}\n";
+
+  FILE *manifest_file = fopen (manifest_name.c_str(), "w");
+  ScopedFile manifest_file_s (manifest_file);
+  if (!manifest_file || fputs (manifest.c_str(), manifest_file) < 0)
+    {
+      error ("audiowmark: error writing manifest %s\n", manifest_name.c_str());
+      return 1;
+    }
+  info ("Segments:     %zd\n", segments.size());
+  info ("Groups:       %d\n", group + 1);
   return 0;
 }
+/* get watermark from a (local) hls playlist, without concatenating the segments to a wav file first */
+int
+hls_get (const vector<Key>& key_list, const string& playlist, const string& orig_pattern)
+{
+  HLSInputStream *hls_stream = new HLSInputStream();
+  std::unique_ptr<AudioInputStream> in_stream (hls_stream);
+
+  Error err = hls_stream->open (playlist);
+  if (err)
+    {
+      error ("audiowmark: hls: %s: %s\n", playlist.c_str(), err.message());
+      return 1;
+    }
+  info ("Segments:     %zd\n", hls_stream->n_segments());
+
+  return get_watermark (key_list, std::move (in_stream), playlist, orig_pattern);
+}
+
 #endif
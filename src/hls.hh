@@ -19,10 +19,24 @@
 #define AUDIOWMARK_HLS_HH
 
 #include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include "mpegts.hh"
+#include "audiostream.hh"
+#include "wmcommon.hh"
 
 int hls_add (const Key& key, const std::string& infile, const std::string& outfile, const std::string& bits);
 int hls_prepare (const std::string& in_dir, const std::string& out_dir, const std::string& filename, const std::string& audio_master);
+int hls_prepare_ab (const Key& key, const std::string& in_dir, const std::string& out_dir, const std::string& filename);
+int hls_get (const std::vector<Key>& key_list, const std::string& playlist, const std::string& orig_pattern);
 
 Error ff_decode (const std::string& filename, WavData& out_wav_data);
 
+Error hls_encode_context (HLSContext context, const std::vector<float>& samples, int n_channels, int sample_rate,
+                          std::string& entry_name, std::vector<unsigned char>& data, std::map<std::string, std::string>& vars);
+Error hls_open_context (const TSReader::Entry& entry, const std::map<std::string, std::string>& vars, std::unique_ptr<AudioInputStream>& in_stream);
+Error hls_open_context (const TSReader& reader, const std::map<std::string, std::string>& vars, std::unique_ptr<AudioInputStream>& in_stream);
+
 #endif /* AUDIOWMARK_MPEGTS_HH */
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hlsinputstream.hh"
+#include "ffinputstream.hh"
+
+#include <algorithm>
+
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+using std::string;
+using std::vector;
+using std::min;
+
+Error
+HLSInputStream::open (const string& playlist)
+{
+  assert (m_state == State::NEW);
+
+  FILE *file = fopen (playlist.c_str(), "r");
+  ScopedFile file_s (file);
+  if (!file)
+    return Error (string_printf ("error opening playlist %s: %s", playlist.c_str(), strerror (errno)));
+
+  /* segment filenames are relative to the directory of the playlist */
+  string dir;
+  size_t slash = playlist.rfind ('/');
+  if (slash != string::npos)
+    dir = playlist.substr (0, slash + 1);
+
+  char buffer[1024];
+  while (fgets (buffer, 1024, file))
+    {
+      string s = buffer;
+      while (s.size() && (s.back() == '\n' || s.back() == '\r'))
+        s.pop_back();
+
+      if (s.compare (0, 18, "#EXT-X-STREAM-INF:") == 0)
+        return Error ("playlist is a master playlist, please use one of the media playlists it refers to");
+
+      if (s.empty() || s[0] == '#') /* blank line or comment */
+        continue;
+
+      if (s.find ("://") != string::npos)
+        return Error (string_printf ("only local segments are supported, not '%s'", s.c_str()));
+
+      m_segment_files.push_back (s[0] == '/' ? s : dir + s);
+    }
+  if (m_segment_files.empty())
+    return Error ("playlist contains no segments");
+
+  Error err = decode_segments();
+  if (err)
+    return err;
+
+  m_state = State::OPEN;
+  return Error::Code::NONE;
+}
+
+/* decode the next segments in parallel (one segment per thread) */
+Error
+HLSInputStream::decode_segments()
+{
+  const size_t n_decode = min (m_thread_pool.n_threads(), m_segment_files.size() - m_next_segment);
+
+  size_t first = m_segments.size();
+  for (size_t i = 0; i < n_decode; i++)
+    {
+      m_segments.emplace_back();
+      if (m_next_segment > 0)
+        m_segments.back().prev_filename = m_segment_files[m_next_segment - 1];
+      m_segments.back().filename = m_segment_files[m_next_segment++];
+    }
+  for (size_t i = first; i < m_segments.size(); i++)
+    {
+      Segment& segment = m_segments[i];
+      m_thread_pool.add_job ([&segment]()
+        {
+          FFInputStream in_stream;
+
+          segment.err = in_stream.open (segment.filename);
+          if (segment.err)
+            return;
+
+          if (!segment.prev_filename.empty())
+            {
+              segment.err = in_stream.prime_decoder (segment.prev_filename);
+              if (segment.err)
+                return;
+            }
+
+          segment.n_channels  = in_stream.n_channels();
+          segment.sample_rate = in_stream.sample_rate();
+          segment.bit_depth   = in_stream.bit_depth();
+
+          vector<float> samples;
+          do
+            {
+              segment.err = in_stream.read_frames (samples, 16 * 1024);
+              if (segment.err)
+                return;
+
+              segment.samples.insert (segment.samples.end(), samples.begin(), samples.end());
+            }
+          while (samples.size());
+        });
+    }
+  m_thread_pool.wait_all();
+
+  for (size_t i = first; i < m_segments.size(); i++)
+    {
+      Segment& segment = m_segments[i];
+      if (segment.err)
+        return Error (string_printf ("%s: %s", segment.filename.c_str(), segment.err.message()));
+
+      /* the first segment determines the stream properties */
+      if (!m_n_channels)
+        {
+          m_n_channels  = segment.n_channels;
+          m_sample_rate = segment.sample_rate;
+          m_bit_depth   = segment.bit_depth;
+        }
+      if (segment.n_channels != m_n_channels || segment.sample_rate != m_sample_rate)
+        return Error (string_printf ("%s: segment has %d channels at %d Hz, expected %d channels at %d Hz", segment.filename.c_str(),
+                                     segment.n_channels, segment.sample_rate, m_n_channels, m_sample_rate));
+    }
+  return Error::Code::NONE;
+}
+
+Error
+HLSInputStream::read_frames (float *samples, size_t count, size_t& n_frames_read)
+{
+  assert (m_state == State::OPEN);
+
+  n_frames_read = 0;
+  while (n_frames_read < count)
+    {
+      if (m_segments.empty())
+        {
+          if (m_next_segment == m_segment_files.size())
+            break; /* eof */
+
+          Error err = decode_segments();
+          if (err)
+            return err;
+        }
+      const vector<float>& seg_samples = m_segments.front().samples;
+
+      const size_t n_values = min ((count - n_frames_read) * m_n_channels, seg_samples.size() - m_read_pos);
+      std::copy (seg_samples.begin() + m_read_pos, seg_samples.begin() + m_read_pos + n_values, samples + n_frames_read * m_n_channels);
+      m_read_pos += n_values;
+      n_frames_read += n_values / m_n_channels;
+
+      if (m_read_pos == seg_samples.size())
+        {
+          m_segments.pop_front();
+          m_read_pos = 0;
+        }
+    }
+  return Error::Code::NONE;
+}
+
+void
+HLSInputStream::close()
+{
+  if (m_state == State::OPEN)
+    {
+      m_segments.clear();
+      m_state = State::CLOSED;
+    }
+}
+
+int
+HLSInputStream::bit_depth() const
+{
+  return m_bit_depth;
+}
+
+int
+HLSInputStream::sample_rate() const
+{
+  return m_sample_rate;
+}
+
+int
+HLSInputStream::n_channels() const
+{
+  return m_n_channels;
+}
+
+size_t
+HLSInputStream::n_frames() const
+{
+  return N_FRAMES_UNKNOWN;
+}
+
+Encoding
+HLSInputStream::encoding() const
+{
+  return Encoding::FLOAT;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIOWMARK_HLS_INPUT_STREAM_HH
+#define AUDIOWMARK_HLS_INPUT_STREAM_HH
+
+#include <string>
+#include <vector>
+#include <deque>
+
+#include "audiostream.hh"
+#include "threadpool.hh"
+
+/*
+ * HLSInputStream reads the audio of a (local) HLS media playlist as one
+ * continuous stream, without concatenating the segments into a temporary
+ * file first. The segments are decoded in-process, several segments in
+ * parallel, and returned in playlist order, so the position in the stream
+ * is the time since the start of the playlist.
+ *
+ * Each segment is decoded by its own decoder. To get the same samples as
+ * decoding the whole stream with one decoder, the decoder is primed with the
+ * last packet of the previous segment (whose output is discarded), so that
+ * the first AAC frame of each segment gets the correct overlap.
+ */
+class HLSInputStream : public AudioInputStream
+{
+  enum class State {
+    NEW,
+    OPEN,
+    CLOSED
+  };
+  State             m_state = State::NEW;
+
+  struct Segment
+  {
+    std::string        filename;
+    std::string        prev_filename;      // for priming the decoder, empty for the first segment
+    std::vector<float> samples;
+    int                n_channels = 0;
+    int                sample_rate = 0;
+    int                bit_depth = 0;
+    Error              err;
+  };
+  std::vector<std::string> m_segment_files;
+  size_t                   m_next_segment = 0;  // next segment to decode
+  std::deque<Segment>      m_segments;          // decoded segments, not yet read completely
+  size_t                   m_read_pos = 0;      // read position (in samples) in first decoded segment
+
+  int               m_n_channels = 0;
+  int               m_sample_rate = 0;
+  int               m_bit_depth = 0;
+
+  ThreadPool        m_thread_pool;
+
+  Error decode_segments();
+public:
+  using AudioInputStream::read_frames;
+
+  Error   open (const std::string& playlist);
+  Error   read_frames (float *samples, size_t count, size_t& n_frames_read) override;
+  void    close();
+
+  size_t  n_segments() const { return m_segment_files.size(); }
+
+  int     bit_depth() const override;
+  int     sample_rate() const override;
+  int     n_channels() const override;
+  size_t  n_frames() const override;
+  Encoding encoding() const override;
+};
+
+#endif /* AUDIOWMARK_HLS_INPUT_STREAM_HH */
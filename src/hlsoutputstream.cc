@@ -241,9 +241,7 @@ HLSOutputStream::get_audio_frame()
   if (m_audio_buffer.can_read_frames() < size_t (frame->nb_samples))
     return nullptr;
 
-  vector<float> samples = m_audio_buffer.read_frames (frame->nb_samples);
-
-  std::copy (samples.begin(), samples.end(), (float *)frame->data[0]);
+  m_audio_buffer.read_frames ((float *)frame->data[0], frame->nb_samples);
 
   frame->pts = m_next_pts;
   m_next_pts  += frame->nb_samples;
@@ -392,6 +390,16 @@ HLSOutputStream::open (const string& out_filename, size_t cut_aac_frames, size_t
   if (ret < 0)
     return Error (av_err2str (ret));
 
+  /*
+   * When writing to stdout, the segment is typically streamed to the player
+   * while it is being encoded, so we pass each muxed packet on immediately
+   * instead of waiting for the I/O buffer to fill up (this improves the time
+   * to first byte, the bytes written are the same).
+   */
+  const bool streaming = out_filename == "-";
+  if (streaming)
+    m_fmt_ctx->flush_packets = 1;
+
   AVDictionary *opt = nullptr;
   const AVCodec *audio_codec;
   Error err = add_stream (&audio_codec, AV_CODEC_ID_AAC);
@@ -409,6 +417,8 @@ HLSOutputStream::open (const string& out_filename, size_t cut_aac_frames, size_t
       error ("Error occurred when writing output file: %s\n",  av_err2str(ret));
       return Error ("avformat_write_header failed\n");
     }
+  if (streaming)
+    avio_flush (m_fmt_ctx->pb);
 
   m_delete_input_start = delete_input_start;
   m_cut_aac_frames = cut_aac_frames;
@@ -451,18 +461,18 @@ HLSOutputStream::close()
 }
 
 Error
-HLSOutputStream::write_frames (const std::vector<float>& frames)
+HLSOutputStream::write_frames (const float *frames, size_t n_frames)
 {
   // if we don't need any more aac frames, just throw away samples (save cpu cycles)
   if (m_keep_aac_frames == 0)
     return Error::Code::NONE;
 
-  m_audio_buffer.write_frames (frames);
+  m_audio_buffer.write_frames (frames, n_frames);
 
   size_t delete_input = min (m_delete_input_start, m_audio_buffer.can_read_frames());
   if (delete_input)
     {
-      m_audio_buffer.read_frames (delete_input);
+      m_audio_buffer.skip_frames (delete_input);
       m_delete_input_start -= delete_input;
     }
 
@@ -80,6 +80,8 @@ class HLSOutputStream : public AudioOutputStream {
 
   int write_frame (const AVRational *time_base, AVStream *st, AVPacket *pkt);
 public:
+  using AudioOutputStream::write_frames;
+
   HLSOutputStream (int n_channels, int sample_rate, int bit_depth);
   ~HLSOutputStream();
 
@@ -90,7 +92,7 @@ public:
   int bit_depth() const override;
   int sample_rate() const override;
   int n_channels() const override;
-  Error write_frames (const std::vector<float>& frames) override;
+  Error write_frames (const float *frames, size_t n_frames) override;
   Error close() override;
 };
 
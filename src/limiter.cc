@@ -16,6 +16,8 @@
  */
 
 #include "limiter.hh"
+#include "dspkernels.hh"
+#include "stats.hh"
 
 #include <assert.h>
 #include <math.h>
@@ -45,6 +47,8 @@ Limiter::set_ceiling (float new_ceiling)
 vector<float>
 Limiter::process (const vector<float>& samples)
 {
+  ScopedStat stat (Stat::LIMITER);
+
   assert (block_size >= 1);
   assert (samples.size() % n_channels == 0);    // process should be called with whole frames
 
@@ -90,10 +94,7 @@ Limiter::skip (size_t zeros)
 float
 Limiter::block_max (const float *in)
 {
-  float maximum = ceiling;
-  for (uint x = 0; x < block_size * n_channels; x++)
-    maximum = max (maximum, fabs (in[x]));
-  return maximum;
+  return dsp_kernels().abs_max (in, block_size * n_channels, ceiling);
 }
 
 void
@@ -109,14 +110,8 @@ Limiter::process_block (const float *in, float *out)
   const float scale_start = ceiling / max (block_max_last, block_max_current);
   const float scale_end = ceiling / max (block_max_current, block_max_next);
   const float scale_step = (scale_end - scale_start) / block_size;
-  for (size_t i = 0; i < block_size; i++)
-    {
-      const float scale = scale_start + i * scale_step;
 
-      // debug_scale (scale);
-      for (uint c = 0; c < n_channels; c++)
-        out[i * n_channels + c] = in[i * n_channels + c] * scale;
-    }
+  dsp_kernels().scale_ramp (in, out, block_size, n_channels, scale_start, scale_step);
 
   block_max_last = block_max_current;
   block_max_current = block_max_next;
@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "mmapwavinputstream.hh"
+#include "rawconverter.hh"
+
+#include <array>
+#include <algorithm>
+
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+using std::string;
+using std::vector;
+using std::min;
+
+MmapWavInputStream::~MmapWavInputStream()
+{
+  close();
+}
+
+static string
+header_get_4cc (const unsigned char *bytes)
+{
+  return string (reinterpret_cast<const char *> (bytes), 4);
+}
+
+static uint16_t
+header_get_u16 (const unsigned char *bytes)
+{
+  return bytes[0] + (bytes[1] << 8);
+}
+
+static uint32_t
+header_get_u32 (const unsigned char *bytes)
+{
+  return bytes[0] + (bytes[1] << 8) + (bytes[2] << 16) + (uint32_t (bytes[3]) << 24);
+}
+
+static uint64_t
+header_get_u64 (const unsigned char *bytes)
+{
+  return header_get_u32 (bytes) + (uint64_t (header_get_u32 (bytes + 4)) << 32);
+}
+
+Error
+MmapWavInputStream::open (const string& filename)
+{
+  assert (m_state == State::NEW);
+
+#if HAVE_SYS_MMAN_H
+  if (filename == "-")
+    return Error ("mmap wav input: can't map stdin");
+
+  m_fd = ::open (filename.c_str(), O_RDONLY);
+  if (m_fd < 0)
+    return Error (strerror (errno));
+
+  struct stat st;
+  if (fstat (m_fd, &st) != 0 || !S_ISREG (st.st_mode) || st.st_size < 12)
+    {
+      close();
+      return Error ("mmap wav input: not a regular wav file");
+    }
+
+  void *map = mmap (nullptr, st.st_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+  if (map == MAP_FAILED)
+    {
+      Error err (string_printf ("mmap wav input: mmap failed: %s", strerror (errno)));
+      close();
+      return err;
+    }
+  m_map = static_cast<const unsigned char *> (map);
+  m_map_size = st.st_size;
+  m_state = State::OPEN;
+
+  Error err = parse_header();
+  if (err)
+    {
+      close();
+      return err;
+    }
+
+  /* we read the file from start to end */
+  madvise (const_cast<unsigned char *> (m_map), m_map_size, MADV_SEQUENTIAL);
+
+  return Error::Code::NONE;
+#else
+  return Error ("mmap wav input: not supported on this platform");
+#endif
+}
+
+Error
+MmapWavInputStream::parse_header()
+{
+  const unsigned char *riff = m_map;
+
+  const bool rf64 = header_get_4cc (riff) == "RF64";
+  if ((header_get_4cc (riff) != "RIFF" && !rf64) || header_get_4cc (riff + 8) != "WAVE")
+    return Error ("input file is not a valid wav file");
+
+  RawFormat format;
+  uint64_t  ds64_data_size = 0;
+  bool      have_ds64 = false;
+  bool      have_fmt_chunk = false;
+  int       block_align = 0;
+
+  size_t pos = 12;
+  while (pos + 8 <= m_map_size)
+    {
+      const unsigned char *chunk = m_map + pos;
+      const uint32_t chunk_size = header_get_u32 (chunk + 4);
+      const size_t   chunk_data = pos + 8;
+
+      if (header_get_4cc (chunk) == "ds64" && chunk_size >= 24 && chunk_data + 24 <= m_map_size)
+        {
+          ds64_data_size = header_get_u64 (m_map + chunk_data + 8);
+          have_ds64 = true;
+        }
+      else if (header_get_4cc (chunk) == "fmt " && chunk_size >= 16 && chunk_data + chunk_size <= m_map_size && !have_fmt_chunk)
+        {
+          const unsigned char *fmt = m_map + chunk_data;
+
+          int format_type = header_get_u16 (fmt);
+          if (format_type == 0xFFFE && chunk_size >= 40) /* extended: subformat guid */
+            {
+              static const std::array<unsigned char, 14> guid_tail
+                {
+                  0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+                  0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71
+                };
+              if (!std::equal (guid_tail.begin(), guid_tail.end(), fmt + 26))
+                return Error ("mmap wav input: unsupported extended format type");
+
+              format_type = header_get_u16 (fmt + 24);
+            }
+          if (format_type == 3) // float encoding
+            format.set_encoding (Encoding::FLOAT);
+          else if (format_type != 1)
+            return Error (string_printf ("mmap wav input: unsupported format type (%d)", format_type));
+
+          format.set_channels (header_get_u16 (fmt + 2));
+          format.set_sample_rate (header_get_u32 (fmt + 4));
+          format.set_bit_depth (header_get_u16 (fmt + 14));
+          block_align = header_get_u16 (fmt + 12);
+
+          // 8-bit wav files are always unsigned
+          if (format.bit_depth() == 8)
+            format.set_encoding (Encoding::UNSIGNED);
+
+          have_fmt_chunk = true;
+        }
+      else if (header_get_4cc (chunk) == "data")
+        {
+          if (!have_fmt_chunk)
+            return Error ("mmap wav input: data chunk before fmt chunk");
+
+          uint64_t data_size = chunk_size;
+          if (rf64 && chunk_size == 0xFFFFFFFF)
+            {
+              if (!have_ds64)
+                return Error ("mmap wav input: rf64 file without ds64 chunk");
+              data_size = ds64_data_size;
+            }
+
+          /* truncated files or streamed wav files with a bogus size: use what we have */
+          data_size = min<uint64_t> (data_size, m_map_size - chunk_data);
+
+          /* like libsndfile: a wav file that was not closed properly has data size 0, and its RIFF size
+           * was never patched (0, 8 or only the header), so the rest of the file is audio data; otherwise
+           * an empty data chunk really is empty (and may be followed by other chunks, like LIST)
+           */
+          const uint32_t riff_size = header_get_u32 (riff + 4);
+          if (!rf64 && chunk_size == 0 && (riff_size == 0 || riff_size == 8 || riff_size + 8 <= chunk_data))
+            data_size = m_map_size - chunk_data;
+
+          const int frame_bytes = format.n_channels() * format.bit_depth() / 8;
+          if (format.n_channels() < 1 || format.bit_depth() % 8 || frame_bytes < 1 || format.sample_rate() < 1)
+            return Error ("mmap wav input: invalid fmt chunk");
+
+          /* padded frames (i.e. 24 bit samples in 32 bit containers) are left to libsndfile */
+          if (block_align != frame_bytes)
+            return Error (string_printf ("mmap wav input: unsupported block align (%d)", block_align));
+
+          Error err;
+          m_raw_converter.reset (RawConverter::create (format, err));
+          if (err)
+            return err;
+
+          m_format      = format;
+          m_data_offset = chunk_data;
+          m_n_frames    = data_size / frame_bytes;
+          return Error::Code::NONE;
+        }
+      /* chunks are padded to an even number of bytes */
+      pos = chunk_data + chunk_size + (chunk_size & 1);
+    }
+  return Error ("mmap wav input: no data chunk found");
+}
+
+int
+MmapWavInputStream::sample_rate() const
+{
+  return m_format.sample_rate();
+}
+
+int
+MmapWavInputStream::bit_depth() const
+{
+  return m_format.bit_depth();
+}
+
+size_t
+MmapWavInputStream::n_frames() const
+{
+  return m_n_frames;
+}
+
+int
+MmapWavInputStream::n_channels() const
+{
+  return m_format.n_channels();
+}
+
+Encoding
+MmapWavInputStream::encoding() const
+{
+  return m_format.encoding();
+}
+
+Error
+MmapWavInputStream::read_frames (float *samples, size_t count, size_t& n_frames_read)
+{
+  assert (m_state == State::OPEN);
+
+  const int    n_channels  = m_format.n_channels();
+  const size_t frame_bytes = n_channels * m_format.bit_depth() / 8;
+
+  count = min (count, m_n_frames - m_frame_pos);
+
+  /* convert directly from the mapped file */
+  const unsigned char *bytes = m_map + m_data_offset + m_frame_pos * frame_bytes;
+
+  /* RawConverter needs aligned input for native access, which we only get if all chunks have a suitable size */
+  const size_t sample_width = m_format.bit_depth() / 8;
+  if (sample_width != 3 && (uintptr_t (bytes) & (sample_width - 1)))
+    {
+      m_unaligned_bytes.assign (bytes, bytes + count * frame_bytes);
+      bytes = m_unaligned_bytes.data();
+    }
+  m_raw_converter->from_raw (bytes, samples, count * n_channels);
+  m_frame_pos += count;
+  n_frames_read = count;
+
+  release_pages();
+  return Error::Code::NONE;
+}
+
+/* give pages we've already read back to the kernel (they remain in the page cache) */
+void
+MmapWavInputStream::release_pages()
+{
+#if HAVE_SYS_MMAN_H
+  const size_t release_block = 16 * 1024 * 1024;
+  const size_t page_size = sysconf (_SC_PAGESIZE);
+
+  const size_t frame_bytes = m_format.n_channels() * m_format.bit_depth() / 8;
+  const size_t read_bytes  = (m_data_offset + m_frame_pos * frame_bytes) / page_size * page_size;
+
+  if (read_bytes >= m_released_bytes + release_block)
+    {
+      madvise (const_cast<unsigned char *> (m_map) + m_released_bytes, read_bytes - m_released_bytes, MADV_DONTNEED);
+      m_released_bytes = read_bytes;
+    }
+#endif
+}
+
+void
+MmapWavInputStream::close()
+{
+#if HAVE_SYS_MMAN_H
+  if (m_map)
+    {
+      munmap (const_cast<unsigned char *> (m_map), m_map_size);
+      m_map = nullptr;
+      m_map_size = 0;
+    }
+#endif
+  if (m_fd >= 0)
+    {
+      ::close (m_fd);
+      m_fd = -1;
+    }
+  if (m_state == State::OPEN)
+    m_state = State::CLOSED;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIOWMARK_MMAP_WAV_INPUT_STREAM_HH
+#define AUDIOWMARK_MMAP_WAV_INPUT_STREAM_HH
+
+#include <string>
+#include <memory>
+#include <vector>
+
+#include "audiostream.hh"
+#include "rawinputstream.hh"
+
+/*
+ * MmapWavInputStream reads uncompressed WAV/RF64 files by mapping them into
+ * memory. The header is parsed directly, and the sample data is converted
+ * from the mapped file without intermediate copies. Pages that have been
+ * read already are released again, so that large files don't increase the
+ * resident memory of the process.
+ *
+ * open() fails for anything other than a regular, uncompressed PCM/float
+ * WAV/RF64 file; AudioInputStream::create() falls back to libsndfile then.
+ */
+class MmapWavInputStream : public AudioInputStream
+{
+  enum class State {
+    NEW,
+    OPEN,
+    CLOSED
+  };
+  State                 m_state = State::NEW;
+  RawFormat             m_format;
+  int                   m_fd = -1;
+  const unsigned char  *m_map = nullptr;
+  size_t                m_map_size = 0;
+  size_t                m_data_offset = 0;
+  size_t                m_n_frames = 0;
+  size_t                m_frame_pos = 0;
+  size_t                m_released_bytes = 0;
+
+  std::vector<unsigned char>    m_unaligned_bytes;
+
+  std::unique_ptr<RawConverter> m_raw_converter;
+
+  Error parse_header();
+  void  release_pages();
+
+public:
+  using AudioInputStream::read_frames;
+
+  ~MmapWavInputStream();
+
+  Error   open (const std::string& filename);
+  Error   read_frames (float *samples, size_t count, size_t& n_frames_read) override;
+  void    close();
+
+  int     bit_depth() const override;
+  int     sample_rate() const override;
+  size_t  n_frames() const override;
+  int     n_channels() const override;
+  Encoding encoding() const override;
+};
+
+#endif /* AUDIOWMARK_MMAP_WAV_INPUT_STREAM_HH */
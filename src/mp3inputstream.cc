@@ -20,6 +20,12 @@
 #include <mpg123.h>
 #include <assert.h>
 
+#include <algorithm>
+#include <memory>
+
+#include <stdio.h>
+#include <string.h>
+
 using std::min;
 using std::string;
 
@@ -44,8 +50,63 @@ MP3InputStream::~MP3InputStream()
   close();
 }
 
+/* check if the first frame of the mp3 file is a Xing/Info frame
+ *
+ * this frame contains the number of frames of the file, so mpg123 knows the
+ * exact length without scanning the whole file (encoder delay and padding
+ * are taken from the LAME extension, if present); mpg123 doesn't use the
+ * frame count of VBRI headers, so for these the length would only be a guess
+ */
+static bool
+mp3_has_length_header (const string& filename)
+{
+  std::unique_ptr<FILE, decltype (&fclose)> file (fopen (filename.c_str(), "rb"), fclose);
+  if (!file)
+    return false;
+
+  unsigned char buffer[4096];
+  size_t n_bytes = fread (buffer, 1, sizeof (buffer), file.get());
+
+  /* skip ID3v2 tag */
+  if (n_bytes >= 10 && memcmp (buffer, "ID3", 3) == 0)
+    {
+      long tag_size = 10 + ((buffer[6] & 0x7f) << 21) + ((buffer[7] & 0x7f) << 14) + ((buffer[8] & 0x7f) << 7) + (buffer[9] & 0x7f);
+      if (buffer[5] & 0x10) // footer present
+        tag_size += 10;
+
+      if (fseek (file.get(), tag_size, SEEK_SET) != 0)
+        return false;
+      n_bytes = fread (buffer, 1, sizeof (buffer), file.get());
+    }
+
+  /* find first layer III frame header */
+  for (size_t pos = 0; pos + 4 <= n_bytes; pos++)
+    {
+      const unsigned char *header = buffer + pos;
+      const int version  = (header[1] >> 3) & 3;   // 3: MPEG 1, 2: MPEG 2, 0: MPEG 2.5
+      const int layer    = (header[1] >> 1) & 3;   // 1: layer III
+      const int bitrate  = header[2] >> 4;
+      const int rate_idx = (header[2] >> 2) & 3;
+
+      if (header[0] != 0xff || (header[1] & 0xe0) != 0xe0 || version == 1 || layer != 1 || bitrate == 15 || rate_idx == 3)
+        continue;
+
+      /* Xing/Info header is stored after the side info */
+      const bool   mono      = (header[3] >> 6) == 3;
+      const size_t side_info = version == 3 ? (mono ? 17 : 32) : (mono ? 9 : 17);
+      const size_t xing_pos  = pos + 4 + side_info;
+      if (xing_pos + 8 <= n_bytes &&
+          (memcmp (buffer + xing_pos, "Xing", 4) == 0 || memcmp (buffer + xing_pos, "Info", 4) == 0))
+        {
+          return buffer[xing_pos + 7] & 1; // number of frames present?
+        }
+      return false;
+    }
+  return false;
+}
+
 Error
-MP3InputStream::open (const string& filename)
+MP3InputStream::open (const string& filename, Scan scan)
 {
   int err = 0;
 
@@ -55,6 +116,8 @@ MP3InputStream::open (const string& filename)
   if (err != MPG123_OK)
     return Error ("mpg123_new failed");
 
+  m_state = State::OPEN; // close() frees the handle, even if open fails later on
+
   err = mpg123_param (m_handle, MPG123_ADD_FLAGS, MPG123_QUIET, 0);
   if (err != MPG123_OK)
     return Error ("setting quiet mode failed");
@@ -64,6 +127,13 @@ MP3InputStream::open (const string& filename)
   if (err != MPG123_OK)
     return Error ("setting resync limit parameter failed");
 
+  /* decode frames before the seek position, so that seeking is sample exact: the layer III bit reservoir
+   * can reach back 511 bytes, which is up to 22 frames for the smallest frames (8 kbit/s, 24 kHz)
+   */
+  err = mpg123_param (m_handle, MPG123_PREFRAMES, 24, 0);
+  if (err != MPG123_OK)
+    return Error ("setting preframes parameter failed");
+
   // force floating point output
   {
     const long *rates;
@@ -85,11 +155,15 @@ MP3InputStream::open (const string& filename)
     return Error (mpg123_strerror (m_handle));
 
   m_need_close = true;
+  m_filename = filename;
 
-  /* scan headers to get best possible length estimate */
-  err = mpg123_scan (m_handle);
-  if (err != MPG123_OK)
-    return Error (mpg123_strerror (m_handle));
+  if (scan == Scan::FULL)
+    {
+      /* scan headers to get best possible length estimate */
+      err = mpg123_scan (m_handle);
+      if (err != MPG123_OK)
+        return Error (mpg123_strerror (m_handle));
+    }
 
   long rate;
   int channels;
@@ -103,30 +177,38 @@ MP3InputStream::open (const string& filename)
   mpg123_format_none (m_handle);
   mpg123_format (m_handle, rate, channels, encoding);
 
-  m_n_values = mpg123_length (m_handle) * channels;
+  /* without scan, mpg123_length() would only be a guess based on the file size and the first frame */
+  off_t length = -1;
+  if (scan == Scan::FULL || mp3_has_length_header (filename))
+    length = mpg123_length (m_handle);
+
+  m_n_frames = length >= 0 ? length : N_FRAMES_UNKNOWN;
   m_n_channels = channels;
   m_sample_rate = rate;
-  m_frames_left = m_n_values / m_n_channels;
+  m_frames_left = m_n_frames;
 
   return Error::Code::NONE;
 }
 
 Error
-MP3InputStream::read_frames (std::vector<float>& samples, size_t count)
+MP3InputStream::read_frames (float *samples, size_t count, size_t& n_frames_read)
 {
+  n_frames_read = 0;
   while (!m_eof && m_read_buffer.size() < count * m_n_channels)
     {
       size_t buffer_bytes = mpg123_outblock (m_handle);
       assert (buffer_bytes % sizeof (float) == 0);
 
-      std::vector<float> buffer (buffer_bytes / sizeof (float));
+      /* decode directly to the end of the read buffer */
+      const size_t old_size = m_read_buffer.size();
+      m_read_buffer.resize (old_size + buffer_bytes / sizeof (float));
 
-      size_t done;
-      int err = mpg123_read (m_handle, reinterpret_cast<unsigned char *> (&buffer[0]), buffer_bytes, &done);
+      size_t done = 0;
+      int err = mpg123_read (m_handle, reinterpret_cast<unsigned char *> (&m_read_buffer[old_size]), buffer_bytes, &done);
+      m_read_buffer.resize (old_size + (err == MPG123_OK ? done / sizeof (float) : 0));
       if (err == MPG123_OK)
         {
-          const size_t n_values = done / sizeof (float);
-          m_read_buffer.insert (m_read_buffer.end(), buffer.begin(), buffer.begin() + n_values);
+          // decoded samples are already in m_read_buffer
         }
       else if (err == MPG123_DONE)
         {
@@ -142,19 +224,83 @@ MP3InputStream::read_frames (std::vector<float>& samples, size_t count)
           return Error (mpg123_strerror (m_handle));
         }
     }
-  /* pad zero samples at end if necessary to match the number of frames we promised to deliver */
-  if (m_eof && m_read_buffer.size() < m_frames_left * m_n_channels)
-    m_read_buffer.resize (m_frames_left * m_n_channels);
+  if (m_n_frames != N_FRAMES_UNKNOWN)
+    {
+      /* pad zero samples at end if necessary to match the number of frames we promised to deliver */
+      if (m_eof && m_read_buffer.size() < m_frames_left * m_n_channels)
+        m_read_buffer.resize (m_frames_left * m_n_channels);
 
-  /* never read past the promised number of frames */
-  if (count > m_frames_left)
-    count = m_frames_left;
+      /* never read past the promised number of frames */
+      if (count > m_frames_left)
+        count = m_frames_left;
+    }
 
   const auto begin = m_read_buffer.begin();
   const auto end   = begin + min (count * m_n_channels, m_read_buffer.size());
-  samples.assign (begin, end);
+  std::copy (begin, end, samples);
+  n_frames_read = (end - begin) / m_n_channels;
   m_read_buffer.erase (begin, end);
-  m_frames_left -= count;
+  if (m_n_frames != N_FRAMES_UNKNOWN)
+    m_frames_left -= count;
+  return Error::Code::NONE;
+}
+
+bool
+MP3InputStream::can_reopen() const
+{
+  return m_handle && m_filename != "-" && m_n_frames != N_FRAMES_UNKNOWN;
+}
+
+std::unique_ptr<AudioInputStream>
+MP3InputStream::reopen (Error& err) const
+{
+  if (!can_reopen())
+    {
+      err = Error ("reopen not supported for this input stream");
+      return nullptr;
+    }
+
+  std::unique_ptr<MP3InputStream> in_stream (new MP3InputStream());
+  err = in_stream->open (m_filename, Scan::HEADER);
+  if (err)
+    return nullptr;
+
+  if (in_stream->n_channels() != m_n_channels || in_stream->sample_rate() != m_sample_rate)
+    {
+      err = Error ("reopen: input file changed");
+      return nullptr;
+    }
+
+  /* share the frame index of this stream, so that seeking is exact without scanning the file again */
+  off_t  *offsets;
+  off_t   step;
+  size_t  fill;
+  if (mpg123_index (m_handle, &offsets, &step, &fill) != MPG123_OK ||
+      mpg123_set_index (in_stream->m_handle, offsets, step, fill) != MPG123_OK)
+    {
+      err = Error ("reopen: copying mp3 frame index failed");
+      return nullptr;
+    }
+  in_stream->m_n_frames    = m_n_frames;
+  in_stream->m_frames_left = m_n_frames;
+  return std::move (in_stream);
+}
+
+/* mpg123 decodes frames before the seek position (MPG123_PREFRAMES, see open()), so that
+ * the layer III bit reservoir and the synthesis filter state match those of continuous decoding
+ */
+Error
+MP3InputStream::seek (size_t frame)
+{
+  if (m_n_frames == N_FRAMES_UNKNOWN || frame > m_n_frames)
+    return Error ("mp3 seek: invalid position");
+
+  if (mpg123_seek (m_handle, frame, SEEK_SET) < 0)
+    return Error (mpg123_strerror (m_handle));
+
+  m_read_buffer.clear();
+  m_eof = false;
+  m_frames_left = m_n_frames - frame;
   return Error::Code::NONE;
 }
 
@@ -202,7 +348,7 @@ MP3InputStream::n_channels() const
 size_t
 MP3InputStream::n_frames() const
 {
-  return m_n_values / m_n_channels;
+  return m_n_frames;
 }
 
 /* there is no really simple way of detecting if something is an mp3
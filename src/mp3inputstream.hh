@@ -30,7 +30,8 @@ class MP3InputStream : public AudioInputStream
     OPEN,
     CLOSED
   };
-  int         m_n_values = 0;
+  std::string m_filename;
+  size_t      m_n_frames = 0;
   int         m_n_channels = 0;
   int         m_sample_rate = 0;
   size_t      m_frames_left = 0;
@@ -41,12 +42,28 @@ class MP3InputStream : public AudioInputStream
   mpg123_handle     *m_handle = nullptr;
   std::vector<float> m_read_buffer;
 public:
+  using AudioInputStream::read_frames;
+
+  /* how to determine the length of the stream during open()
+   *
+   *  - FULL:   scan all frames of the file (exact, but reads the whole file once before decoding)
+   *  - HEADER: use Xing/Info header if available, otherwise n_frames() is N_FRAMES_UNKNOWN
+   */
+  enum class Scan {
+    FULL,
+    HEADER
+  };
+
   ~MP3InputStream();
 
-  Error   open (const std::string& filename);
-  Error   read_frames (std::vector<float>& samples, size_t count) override;
+  Error   open (const std::string& filename, Scan scan = Scan::FULL);
+  Error   read_frames (float *samples, size_t count, size_t& n_frames_read) override;
   void    close();
 
+  bool    can_reopen() const override;
+  std::unique_ptr<AudioInputStream> reopen (Error& err) const override;
+  Error   seek (size_t frame) override;
+
   int     bit_depth() const override;
   int     sample_rate() const override;
   int     n_channels()  const override;
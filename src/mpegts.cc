@@ -15,105 +15,145 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "config.h"
+
 #include <array>
-#include <regex>
+#include <algorithm>
 
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#if HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
 #include "utils.hh"
 #include "mpegts.hh"
 
 using std::string;
 using std::vector;
 using std::map;
-using std::regex;
+using std::min;
 
-class TSPacket
+/*
+ * awmk entries are stored in private transport stream packets: a 12 byte
+ * packet id (ts header + "AWMK" + "file" for the first packet of an entry,
+ * "data" for the remaining packets) followed by 176 payload bytes
+ */
+namespace
 {
-public:
-  enum class ID { awmk_file, awmk_data, unknown };
-
-private:
-  std::array<unsigned char, 188> m_data;
-
-  std::array<unsigned char, 12>
-  get_id_bytes (ID type)
-  {
-    if (type == ID::awmk_file)
-     return { 'G', 0x1F, 0xFF, 0x10, 'A', 'W', 'M', 'K', 'f', 'i', 'l', 'e' };
-    if (type == ID::awmk_data)
-      return { 'G', 0x1F, 0xFF, 0x10, 'A', 'W', 'M', 'K', 'd', 'a', 't', 'a' };
-    return {0,};
-  }
-public:
-  bool
-  read (FILE *file, Error& err)
-  {
-    size_t bytes_read = fread (m_data.data(), 1, m_data.size(), file);
-    if (bytes_read == 0) /* probably eof */
-      return false;
-
-    if (bytes_read == m_data.size()) /* successful read */
-      {
-        if (m_data[0] == 'G')
-          return true;
-
-        err = Error ("bad packet sync while reading transport (.ts) packet");
-        return false;
-      }
-
-    err = Error ("short read while reading transport stream (.ts) packet");
-    return false;
-  }
-  Error
-  write (FILE *file)
-  {
-    size_t bytes_written = fwrite (m_data.data(), 1, m_data.size(), file);
-    if (bytes_written != m_data.size())
-      return Error ("short write while writing transport stream (.ts) packet");
-
-    return Error::Code::NONE;
-  }
-  void
-  clear (ID type)
-  {
-    std::fill (m_data.begin(), m_data.end(), 0);
-    auto id = get_id_bytes (type);
-    std::copy (id.begin(), id.end(), m_data.begin());
-  }
-  unsigned char&
-  operator[] (size_t n)
-  {
-    return m_data[n];
-  }
-  bool
-  id_eq (size_t offset, unsigned char a, unsigned char b, unsigned char c, unsigned char d)
-  {
-    return m_data[offset] == a && m_data[offset + 1] == b && m_data[offset + 2] == c && m_data[offset + 3] == d;
-  }
-  ID
-  get_id()
-  {
-    if (id_eq (0, 'G', 0x1F, 0xFF, 0x10) && id_eq (4, 'A', 'W', 'M', 'K'))
-      {
-        if (id_eq (8, 'f', 'i', 'l', 'e'))
-          return ID::awmk_file;
-        if (id_eq (8, 'd', 'a', 't', 'a'))
-          return ID::awmk_data;
-      }
-    return ID::unknown;
-  }
-  constexpr size_t
-  size()
-  {
-    return m_data.size(); // is constant
-  }
-  const std::array<unsigned char, 188>&
-  data()
-  {
-    return m_data;
-  }
+
+constexpr size_t ts_packet_size  = 188;
+constexpr size_t ts_id_size      = 12;
+constexpr size_t ts_payload_size = ts_packet_size - ts_id_size;
+
+const std::array<unsigned char, ts_id_size> awmk_file_id { 'G', 0x1F, 0xFF, 0x10, 'A', 'W', 'M', 'K', 'f', 'i', 'l', 'e' };
+const std::array<unsigned char, ts_id_size> awmk_data_id { 'G', 0x1F, 0xFF, 0x10, 'A', 'W', 'M', 'K', 'd', 'a', 't', 'a' };
+
+enum class PacketID { awmk_file, awmk_data, unknown };
+
+PacketID
+packet_id (const unsigned char *packet)
+{
+  if (std::equal (awmk_file_id.begin(), awmk_file_id.end(), packet))
+    return PacketID::awmk_file;
+  if (std::equal (awmk_data_id.begin(), awmk_data_id.end(), packet))
+    return PacketID::awmk_data;
+  return PacketID::unknown;
+}
+
+/* read the whole file using large blocks */
+Error
+read_file (FILE *file, vector<unsigned char>& data)
+{
+  const size_t block_size = 256 * 1024;
+
+  struct stat st;
+  if (fstat (fileno (file), &st) == 0 && S_ISREG (st.st_mode))
+    data.reserve (st.st_size);
+
+  size_t pos = 0;
+  for (;;)
+    {
+      data.resize (pos + block_size);
+
+      size_t bytes_read = fread (data.data() + pos, 1, block_size, file);
+      pos += bytes_read;
+      if (bytes_read < block_size)
+        break;
+    }
+  data.resize (pos);
+
+  if (ferror (file))
+    return Error (string_printf ("read error: %s", strerror (errno)));
+
+  return Error::Code::NONE;
+}
+
+/* check that data consists of complete transport stream packets */
+Error
+check_packets (const vector<unsigned char>& data)
+{
+  for (size_t pos = 0; pos < data.size(); pos += ts_packet_size)
+    {
+      if (pos + ts_packet_size > data.size())
+        return Error ("short read while reading transport stream (.ts) packet");
+
+      if (data[pos] != 'G')
+        return Error ("bad packet sync while reading transport (.ts) packet");
+    }
+  return Error::Code::NONE;
+}
+
+struct Buffer
+{
+  const unsigned char *data;
+  size_t               size;
 };
 
+/* scatter/gather write of all buffers */
+Error
+write_buffers (FILE *file, const vector<Buffer>& buffers)
+{
+#if HAVE_SYS_UIO_H
+  vector<iovec> iov;
+  for (const auto& b : buffers)
+    iov.push_back ({ const_cast<unsigned char *> (b.data), b.size });
+
+  size_t i = 0;
+  while (i < iov.size())
+    {
+      ssize_t n = writev (fileno (file), &iov[i], min<size_t> (iov.size() - i, IOV_MAX));
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          return Error (string_printf ("error writing transport stream (.ts): %s", strerror (errno)));
+        }
+      /* skip buffers that have been written completely, adjust partially written buffer */
+      while (i < iov.size() && size_t (n) >= iov[i].iov_len)
+        n -= iov[i++].iov_len;
+      if (n > 0)
+        {
+          iov[i].iov_base = static_cast<char *> (iov[i].iov_base) + n;
+          iov[i].iov_len -= n;
+        }
+    }
+#else
+  for (const auto& b : buffers)
+    {
+      if (fwrite (b.data, 1, b.size, file) != b.size)
+        return Error ("short write while writing transport stream (.ts) packet");
+    }
+#endif
+  return Error::Code::NONE;
+}
+
+}
+
 Error
 TSWriter::append_file (const string& name, const string& filename)
 {
@@ -122,11 +162,12 @@ TSWriter::append_file (const string& name, const string& filename)
   ScopedFile datafile_s (datafile);
   if (!datafile)
     return Error ("unable to open data file");
-  int c;
-  while ((c = fgetc (datafile)) >= 0)
-    data.push_back (c);
 
-  entries.push_back ({name, data});
+  Error err = read_file (datafile, data);
+  if (err)
+    return err;
+
+  entries.push_back ({name, std::move (data)});
   return Error::Code::NONE;
 }
 
@@ -134,32 +175,28 @@ void
 TSWriter::append_vars (const string& name, const map<string, string>& vars)
 {
   vector<unsigned char> data;
-  for (auto kv : vars)
+  for (const auto& kv : vars)
     {
-      for (auto k : kv.first)
-        data.push_back (k);
+      data.insert (data.end(), kv.first.begin(), kv.first.end());
       data.push_back ('=');
-      for (auto v : kv.second)
-        data.push_back (v);
+      data.insert (data.end(), kv.second.begin(), kv.second.end());
       data.push_back (0);
     }
 
-  entries.push_back ({name, data});
+  entries.push_back ({name, std::move (data)});
 }
 
 void
-TSWriter::append_data (const string& name, const vector<unsigned char>& data)
+TSWriter::append_data (const string& name, vector<unsigned char> data)
 {
-  entries.push_back ({name, data});
+  entries.push_back ({name, std::move (data)});
 }
 
 Error
 TSWriter::process (const string& inname, const string& outname)
 {
   FILE *infile = fopen (inname.c_str(), "r");
-  FILE *outfile = fopen (outname.c_str(), "w");
   ScopedFile infile_s (infile);
-  ScopedFile outfile_s (outfile);
 
   if (!infile)
     {
@@ -167,90 +204,96 @@ TSWriter::process (const string& inname, const string& outname)
       return Error (strerror (errno));
     }
 
+  vector<unsigned char> in_data;
+  Error err = read_file (infile, in_data);
+  if (err)
+    return err;
+
+  err = check_packets (in_data);
+  if (err)
+    return err;
+
+  FILE *outfile = fopen (outname.c_str(), "w");
+  ScopedFile outfile_s (outfile);
+
   if (!outfile)
     {
       error ("audiowmark: unable to open %s for writing\n", outname.c_str());
       return Error (strerror (errno));
     }
 
-  while (!feof (infile))
-    {
-      TSPacket p;
-      Error err;
-      bool read_ok = p.read (infile, err);
-      if (!read_ok)
-        {
-          if (err)
-            return err;
-        }
-      else
-        {
-          err = p.write (outfile);
-          if (err)
-            return err;
-        }
-    }
+  /* input packets are copied unchanged, followed by awmk packets for each entry,
+   * which are written directly from the entry data (without copying)
+   */
+  static const std::array<unsigned char, ts_payload_size> zeros {};
+
+  vector<string> headers;
+  for (const auto& entry : entries)
+    headers.push_back (string_printf ("%zd:%s", entry.data.size(), entry.name.c_str()) + '\0');
 
-  for (auto entry : entries)
+  vector<Buffer> buffers;
+  buffers.push_back ({ in_data.data(), in_data.size() });
+
+  for (size_t e = 0; e < entries.size(); e++)
     {
-      string header = string_printf ("%zd:%s", entry.data.size(), entry.name.c_str()) + '\0';
-      vector<unsigned char> data = entry.data;
-      for (size_t i = 0; i < header.size(); i++)
-        data.insert (data.begin() + i, header[i]);
-
-      TSPacket p_file;
-      p_file.clear (TSPacket::ID::awmk_file);
-      size_t data_pos = 0;
-      int pos = 12;
-      while (data_pos < data.size())
+      const string& header = headers[e];
+      const vector<unsigned char>& data = entries[e].data;
+
+      /* payload = header + data */
+      const size_t payload_size = header.size() + data.size();
+      for (size_t pos = 0; pos < payload_size; pos += ts_payload_size)
         {
-          p_file[pos++] = data[data_pos];
-          if (pos == 188)
-            {
-              Error err = p_file.write (outfile);
-              if (err)
-                return err;
+          const auto& id = pos == 0 ? awmk_file_id : awmk_data_id;
+          buffers.push_back ({ id.data(), id.size() });
 
-              p_file.clear (TSPacket::ID::awmk_data);
-              pos = 12;
+          const size_t end = min (pos + ts_payload_size, payload_size);
+          if (pos < header.size())
+            {
+              const size_t header_end = min (end, header.size());
+              buffers.push_back ({ reinterpret_cast<const unsigned char *> (header.data()) + pos, header_end - pos });
             }
-          data_pos++;
-        }
-
-      if (pos != 12)
-        {
-          Error err = p_file.write (outfile);
-          if (err)
-            return err;
+          if (end > header.size())
+            {
+              const size_t data_start = pos > header.size() ? pos - header.size() : 0;
+              buffers.push_back ({ data.data() + data_start, end - header.size() - data_start });
+            }
+          /* last packet is padded with zeros */
+          if (end - pos < ts_payload_size)
+            buffers.push_back ({ zeros.data(), ts_payload_size - (end - pos) });
         }
     }
+  err = write_buffers (outfile, buffers);
+  if (err)
+    return err;
+
+  if (fflush (outfile) != 0)
+    return Error (string_printf ("error writing transport stream (.ts): %s", strerror (errno)));
 
   return Error::Code::NONE;
 }
 
+/* parse header "<size>:<filename>\0" at start of data */
 bool
 TSReader::parse_header (Header& header, vector<unsigned char>& data)
 {
-  for (size_t i = 0; i < data.size(); i++)
-    {
-      if (data[i] == 0) // header is terminated with one single 0 byte
-        {
-          string s = (const char *) (&data[0]);
+  const auto end = std::find (data.begin(), data.end(), 0); // header is terminated with one single 0 byte
+  if (end == data.end())
+    return false;
 
-          static const regex header_re ("([0-9]*):(.*)");
-          std::smatch sm;
-          if (regex_match (s, sm, header_re))
-            {
-              header.data_size = atoi (sm[1].str().c_str());
-              header.filename = sm[2];
+  const auto colon = std::find (data.begin(), end, ':');
+  if (colon == end || !std::all_of (data.begin(), colon, [] (unsigned char c) { return c >= '0' && c <= '9'; }))
+    return false;
 
-              // erase header including null termination
-              data.erase (data.begin(), data.begin() + i + 1);
-              return true;
-            }
-        }
-    }
-  return false;
+  size_t data_size = 0;
+  for (auto it = data.begin(); it != colon; ++it)
+    data_size = data_size * 10 + (*it - '0');
+
+  header.data_size = data_size;
+  header.filename.assign (colon + 1, end);
+
+  // erase header including null termination
+  data.erase (data.begin(), end + 1);
+  return true;
 }
 
 Error
@@ -273,50 +316,50 @@ TSReader::load (const string& inname)
 Error
 TSReader::load (FILE *infile)
 {
+  vector<unsigned char> in_data;
+  Error err = read_file (infile, in_data);
+  if (err)
+    return err;
+
+  err = check_packets (in_data);
+  if (err)
+    return err;
+
   vector<unsigned char> awmk_stream;
   Header header;
   bool header_valid = false;
-  Error err;
-  while (!feof (infile))
+  for (size_t pos = 0; pos < in_data.size(); pos += ts_packet_size)
     {
-      TSPacket p;
-      bool read_ok = p.read (infile, err);
-      if (!read_ok)
+      const unsigned char *packet = &in_data[pos];
+
+      PacketID id = packet_id (packet);
+      if (id == PacketID::awmk_file)
         {
-          if (err)
-            return err;
+          /* new stream start, clear old contents */
+          header_valid = false;
+          awmk_stream.clear();
         }
-      else
+      if (id == PacketID::awmk_file || id == PacketID::awmk_data)
         {
-          TSPacket::ID id = p.get_id();
-          if (id == TSPacket::ID::awmk_file)
-            {
-              /* new stream start, clear old contents */
-              header_valid = false;
-              awmk_stream.clear();
-            }
-          if (id == TSPacket::ID::awmk_file || id == TSPacket::ID::awmk_data)
-            {
-              awmk_stream.insert (awmk_stream.end(), p.data().begin() + 12, p.data().end());
+          awmk_stream.insert (awmk_stream.end(), packet + ts_id_size, packet + ts_packet_size);
 
-              if (!header_valid)
+          if (!header_valid)
+            {
+              if (parse_header (header, awmk_stream))
                 {
-                  if (parse_header (header, awmk_stream))
-                    {
-                      awmk_stream.reserve (header.data_size + p.size());
-                      header_valid = true;
-                    }
+                  awmk_stream.reserve (header.data_size + ts_packet_size);
+                  header_valid = true;
                 }
-              // done? do we have enough bytes for the complete entry?
-              if (header_valid && awmk_stream.size() >= header.data_size)
-                {
-                  awmk_stream.resize (header.data_size);
+            }
+          // done? do we have enough bytes for the complete entry?
+          if (header_valid && awmk_stream.size() >= header.data_size)
+            {
+              awmk_stream.resize (header.data_size);
 
-                  m_entries.push_back ({ header.filename, std::move (awmk_stream)});
+              m_entries.push_back ({ header.filename, std::move (awmk_stream)});
 
-                  header_valid = false;
-                  awmk_stream.clear();
-                }
+              header_valid = false;
+              awmk_stream.clear();
             }
         }
     }
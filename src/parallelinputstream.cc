@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "parallelinputstream.hh"
+#include "mp3inputstream.hh"
+
+#include <algorithm>
+
+#include <assert.h>
+#include <string.h>
+
+using std::vector;
+using std::min;
+
+/* only worth the effort if there are at least two ranges to decode in parallel
+ *
+ * mp3 is not enabled yet: parallel decoding relies on sample exact seeking, which
+ * needs to be verified for all kinds of files (testmp3 parallel in parallel-decode-test.sh)
+ */
+bool
+ParallelInputStream::supported (const AudioInputStream *in_stream)
+{
+  if (dynamic_cast<const MP3InputStream *> (in_stream))
+    return false;
+
+  return in_stream->can_reopen() && in_stream->n_frames() >= 2 * range_frames && std::thread::hardware_concurrency() > 1;
+}
+
+Error
+ParallelInputStream::open (std::unique_ptr<AudioInputStream> in_stream)
+{
+  assert (m_decoders.empty() && in_stream->can_reopen());
+
+  const size_t n_decoders = min (m_thread_pool.n_threads(), (in_stream->n_frames() + range_frames - 1) / range_frames);
+
+  m_decoders.push_back (std::move (in_stream));
+  while (m_decoders.size() < n_decoders)
+    {
+      Error err;
+      auto decoder = m_decoders[0]->reopen (err);
+      if (err)
+        return err;
+
+      m_decoders.push_back (std::move (decoder));
+    }
+  return Error::Code::NONE;
+}
+
+Error
+ParallelInputStream::decode_next_ranges()
+{
+  const size_t total_frames = n_frames();
+  const int    n_channels   = this->n_channels();
+
+  const size_t n_ranges = min (m_decoders.size(), (total_frames - m_next_frame + range_frames - 1) / range_frames);
+
+  m_buffer.resize (n_ranges * range_frames * n_channels);
+  vector<size_t> range_len (n_ranges);
+  vector<size_t> range_read (n_ranges);
+  vector<Error>  range_err (n_ranges);
+
+  for (size_t r = 0; r < n_ranges; r++)
+    {
+      const size_t start = m_next_frame + r * range_frames;
+      range_len[r] = min (range_frames, total_frames - start);
+
+      m_thread_pool.add_job ([this, r, start, n_channels, &range_len, &range_read, &range_err]()
+        {
+          AudioInputStream *decoder = m_decoders[r].get();
+          float *samples = m_buffer.data() + r * range_frames * n_channels;
+
+          Error err = decoder->seek (start);
+          while (!err && range_read[r] < range_len[r])
+            {
+              size_t n_frames_read;
+              err = decoder->read_frames (samples + range_read[r] * n_channels, range_len[r] - range_read[r], n_frames_read);
+              if (n_frames_read == 0)
+                break;
+              range_read[r] += n_frames_read;
+            }
+          range_err[r] = err;
+        });
+    }
+  m_thread_pool.wait_all();
+
+  /* stitch ranges: stop at the first range that failed or is shorter than expected */
+  m_buffer_frames = 0;
+  m_buffer_pos = 0;
+  for (size_t r = 0; r < n_ranges; r++)
+    {
+      if (range_err[r])
+        {
+          /* the decoder of the previous (complete) range is positioned at the start of this range */
+          m_serial_decoder = r > 0 ? r - 1 : m_last_decoder;
+          if (m_serial_decoder < 0)
+            return range_err[r];
+          break;
+        }
+      m_buffer_frames += range_read[r];
+      if (range_read[r] < range_len[r])
+        {
+          /* file is shorter than n_frames(): this decoder is at the real end (or read error position) */
+          m_serial_decoder = r;
+          break;
+        }
+    }
+  if (m_serial_decoder >= 0)
+    {
+      m_next_frame += m_buffer_frames;
+      return Error::Code::NONE;
+    }
+  m_next_frame += n_ranges * range_frames;
+  m_last_decoder = n_ranges - 1;
+  return Error::Code::NONE;
+}
+
+Error
+ParallelInputStream::read_frames (float *samples, size_t count, size_t& n_frames_read)
+{
+  const int n_channels = this->n_channels();
+
+  /* fill the whole request (a short read means eof), even across range batches */
+  n_frames_read = 0;
+  while (n_frames_read < count)
+    {
+      if (m_buffer_pos == m_buffer_frames)
+        {
+          if (m_serial_decoder >= 0)
+            {
+              size_t n_serial = 0;
+              Error err = m_decoders[m_serial_decoder]->read_frames (samples + n_frames_read * n_channels, count - n_frames_read, n_serial);
+              n_frames_read += n_serial;
+              return err;
+            }
+          if (m_next_frame >= n_frames())
+            break;
+
+          Error err = decode_next_ranges();
+          if (err)
+            return err;
+          continue;
+        }
+      const size_t n = min (count - n_frames_read, m_buffer_frames - m_buffer_pos);
+      memcpy (samples + n_frames_read * n_channels, m_buffer.data() + m_buffer_pos * n_channels, n * n_channels * sizeof (float));
+      m_buffer_pos += n;
+      n_frames_read += n;
+    }
+  return Error::Code::NONE;
+}
+
+int
+ParallelInputStream::bit_depth() const
+{
+  return m_decoders[0]->bit_depth();
+}
+
+int
+ParallelInputStream::sample_rate() const
+{
+  return m_decoders[0]->sample_rate();
+}
+
+int
+ParallelInputStream::n_channels() const
+{
+  return m_decoders[0]->n_channels();
+}
+
+size_t
+ParallelInputStream::n_frames() const
+{
+  return m_decoders[0]->n_frames();
+}
+
+Encoding
+ParallelInputStream::encoding() const
+{
+  return m_decoders[0]->encoding();
+}
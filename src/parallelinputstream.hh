@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIOWMARK_PARALLEL_INPUT_STREAM_HH
+#define AUDIOWMARK_PARALLEL_INPUT_STREAM_HH
+
+#include <memory>
+#include <vector>
+
+#include "audiostream.hh"
+#include "threadpool.hh"
+
+/*
+ * ParallelInputStream decodes a seekable compressed input stream (flac, mp3)
+ * using all cpu cores. The file is split into ranges of range_frames frames;
+ * each worker thread has its own reader (AudioInputStream::reopen()), seeks
+ * to the start of its range and decodes it directly into the read buffer.
+ * Since the ranges are adjacent and each range is decoded sample exactly, the
+ * result is identical to decoding the file serially.
+ *
+ * The ranges are based on n_frames() from the file header. If the file turns
+ * out to be shorter (or a range can not be decoded), we keep the data up to
+ * that point and decode the rest of the file serially with the decoder that
+ * stopped there (without seeking), so that we get the same result (or error)
+ * as a serial decoder.
+ */
+class ParallelInputStream : public AudioInputStream
+{
+  std::vector<std::unique_ptr<AudioInputStream>> m_decoders;
+  ThreadPool                                     m_thread_pool;
+
+  std::vector<float> m_buffer;
+  size_t             m_buffer_frames = 0;
+  size_t             m_buffer_pos = 0;
+  size_t             m_next_frame = 0;
+  int                m_serial_decoder = -1;  // decoder used for serial decoding, or -1
+  int                m_last_decoder = -1;    // decoder which decoded the last range so far
+
+  Error decode_next_ranges();
+public:
+  static constexpr size_t range_frames = 256 * 1024;
+
+  using AudioInputStream::read_frames;
+
+  static bool supported (const AudioInputStream *in_stream);
+
+  Error   open (std::unique_ptr<AudioInputStream> in_stream);
+  Error   read_frames (float *samples, size_t count, size_t& n_frames_read) override;
+
+  int     bit_depth() const override;
+  int     sample_rate() const override;
+  int     n_channels() const override;
+  size_t  n_frames() const override;
+  Encoding encoding() const override;
+};
+
+#endif /* AUDIOWMARK_PARALLEL_INPUT_STREAM_HH */
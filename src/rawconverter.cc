@@ -16,6 +16,7 @@
  */
 
 #include "rawconverter.hh"
+#include "dspkernels.hh"
 #include "config.h"
 
 #include <array>
@@ -33,11 +34,44 @@ RawConverter::~RawConverter()
 template<int BIT_DEPTH, RawFormat::Endian ENDIAN, Encoding ENCODING>
 class RawConverterImpl final : public RawConverter
 {
+  /* SIMD versions for common formats (or nullptr) */
+  void (*m_to_raw_kernel) (const float *samples, unsigned char *bytes, size_t n_samples) = nullptr;
+  void (*m_from_raw_kernel) (const unsigned char *bytes, float *samples, size_t n_samples) = nullptr;
 public:
+  RawConverterImpl();
+
   void to_raw (const float *samples, unsigned char *bytes, size_t n_samples) override AUDIOWMARK_EXTRA_OPT;
   void from_raw (const unsigned char *bytes, float *samples, size_t n_samples) override AUDIOWMARK_EXTRA_OPT;
 };
 
+template<int BIT_DEPTH, RawFormat::Endian ENDIAN, Encoding ENCODING>
+RawConverterImpl<BIT_DEPTH, ENDIAN, ENCODING>::RawConverterImpl()
+{
+  const DSPKernels& dsp = dsp_kernels();
+
+  if (ENDIAN == RawFormat::LITTLE && ENCODING == Encoding::SIGNED)
+    {
+      if (BIT_DEPTH == 16)
+        {
+          m_to_raw_kernel   = dsp.float_to_s16le;
+          m_from_raw_kernel = dsp.s16le_to_float;
+        }
+      if (BIT_DEPTH == 24)
+        {
+          m_to_raw_kernel   = dsp.float_to_s24le;
+          m_from_raw_kernel = dsp.s24le_to_float;
+        }
+      if (BIT_DEPTH == 32)
+        {
+          m_to_raw_kernel   = dsp.float_to_s32le;
+          m_from_raw_kernel = dsp.s32le_to_float;
+        }
+    }
+  /* float input is just copied, so we only need clipping for float output */
+  if (ENDIAN == RawFormat::LITTLE && ENCODING == Encoding::FLOAT && BIT_DEPTH == 32)
+    m_to_raw_kernel = dsp.float_to_f32le;
+}
+
 template<int BIT_DEPTH, RawFormat::Endian ENDIAN>
 static RawConverter *
 create_with_bits_endian (const RawFormat& raw_format, Error& error)
@@ -156,6 +190,12 @@ template<int BIT_DEPTH, RawFormat::Endian ENDIAN, Encoding ENCODING>
 void
 RawConverterImpl<BIT_DEPTH, ENDIAN, ENCODING>::to_raw (const float *samples, unsigned char *output_bytes, size_t n_samples)
 {
+  if (m_to_raw_kernel)
+    {
+      m_to_raw_kernel (samples, output_bytes, n_samples);
+      return;
+    }
+
   constexpr int sample_width = BIT_DEPTH / 8;
   assert ((uintptr_t (output_bytes) & (sample_width - 1)) == 0); // ensure alignment for native access (16-bit, 32-bit and 64-bit version)
 
@@ -221,8 +261,15 @@ template<int BIT_DEPTH, RawFormat::Endian ENDIAN, Encoding ENCODING>
 void
 RawConverterImpl<BIT_DEPTH, ENDIAN, ENCODING>::from_raw (const unsigned char *input_bytes, float *samples, size_t n_samples)
 {
+  if (m_from_raw_kernel)
+    {
+      m_from_raw_kernel (input_bytes, samples, n_samples);
+      return;
+    }
+
   constexpr int sample_width = BIT_DEPTH / 8;
-  assert ((uintptr_t (input_bytes) & (sample_width - 1)) == 0); // ensure alignment for native access (16-bit, 32-bit and 64-bit version)
+  static_assert (sample_width == 3 || (sample_width & (sample_width - 1)) == 0, "unexpected sample width");
+  assert (sample_width == 3 || (uintptr_t (input_bytes) & (sample_width - 1)) == 0); // ensure alignment for native access (16-bit, 32-bit and 64-bit version)
 
   if (ENCODING == Encoding::FLOAT)
     {
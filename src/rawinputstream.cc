@@ -18,6 +18,8 @@
 #include "rawinputstream.hh"
 #include "rawconverter.hh"
 
+#include <algorithm>
+
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
@@ -71,11 +73,9 @@ RawInputStream::~RawInputStream()
   close();
 }
 
-Error
-RawInputStream::open (const string& filename, const RawFormat& format)
+static Error
+check_format (const RawFormat& format)
 {
-  assert (m_state == State::NEW);
-
   if (!format.n_channels())
     return Error ("RawInputStream: input format: missing number of channels");
   if (!format.bit_depth())
@@ -83,7 +83,18 @@ RawInputStream::open (const string& filename, const RawFormat& format)
   if (!format.sample_rate())
     return Error ("RawInputStream: input format: missing sample rate");
 
-  Error err = Error::Code::NONE;
+  return Error::Code::NONE;
+}
+
+Error
+RawInputStream::open (const string& filename, const RawFormat& format)
+{
+  assert (m_state == State::NEW);
+
+  Error err = check_format (format);
+  if (err)
+    return err;
+
   m_raw_converter.reset (RawConverter::create (format, err));
   if (err)
     return err;
@@ -107,6 +118,27 @@ RawInputStream::open (const string& filename, const RawFormat& format)
   return Error::Code::NONE;
 }
 
+/* read raw samples from memory (data must stay valid while the stream is open) */
+Error
+RawInputStream::open (const vector<unsigned char> *data, const RawFormat& format)
+{
+  assert (m_state == State::NEW);
+
+  Error err = check_format (format);
+  if (err)
+    return err;
+
+  m_raw_converter.reset (RawConverter::create (format, err));
+  if (err)
+    return err;
+
+  m_input_data = data;
+  m_input_pos  = 0;
+  m_format     = format;
+  m_state      = State::OPEN;
+  return Error::Code::NONE;
+}
+
 int
 RawInputStream::sample_rate() const
 {
@@ -122,6 +154,9 @@ RawInputStream::bit_depth() const
 size_t
 RawInputStream::n_frames() const
 {
+  if (m_input_data)
+    return m_input_data->size() / (m_format.n_channels() * m_format.bit_depth() / 8);
+
   return N_FRAMES_UNKNOWN;
 }
 
@@ -138,21 +173,39 @@ RawInputStream::encoding() const
 }
 
 Error
-RawInputStream::read_frames (vector<float>& samples, size_t count)
+RawInputStream::read_frames (float *samples, size_t count, size_t& n_frames_read)
 {
   assert (m_state == State::OPEN);
 
   const int n_channels   = m_format.n_channels();
   const int sample_width = m_format.bit_depth() / 8;
 
-  vector<unsigned char> input_bytes (count * n_channels * sample_width);
-  size_t r_count = fread (input_bytes.data(), n_channels * sample_width, count, m_input_file);
+  n_frames_read = 0;
+  if (m_input_data)
+    {
+      /* convert directly from memory */
+      const size_t frame_bytes = n_channels * sample_width;
+      const size_t r_count = std::min (count, (m_input_data->size() - m_input_pos) / frame_bytes);
+
+      const unsigned char *bytes = m_input_data->data() + m_input_pos;
+      if (sample_width != 3 && (uintptr_t (bytes) & (sample_width - 1))) /* RawConverter needs aligned input */
+        {
+          m_input_bytes.assign (bytes, bytes + r_count * frame_bytes);
+          bytes = m_input_bytes.data();
+        }
+      m_raw_converter->from_raw (bytes, samples, r_count * n_channels);
+      m_input_pos += r_count * frame_bytes;
+      n_frames_read = r_count;
+
+      return Error::Code::NONE;
+    }
+  m_input_bytes.resize (count * n_channels * sample_width);
+  size_t r_count = fread (m_input_bytes.data(), n_channels * sample_width, count, m_input_file);
   if (ferror (m_input_file))
     return Error ("error reading sample data");
 
-  samples.resize (r_count * n_channels);
-
-  m_raw_converter->from_raw (input_bytes.data(), samples.data(), r_count * n_channels);
+  m_raw_converter->from_raw (m_input_bytes.data(), samples, r_count * n_channels);
+  n_frames_read = r_count;
 
   return Error::Code::NONE;
 }
@@ -169,6 +222,7 @@ RawInputStream::close()
           m_close_file = false;
         }
 
+      m_input_data = nullptr;
       m_state = State::CLOSED;
     }
 }
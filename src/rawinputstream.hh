@@ -20,6 +20,7 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 
 #include <sndfile.h>
 
@@ -69,13 +70,20 @@ class RawInputStream : public AudioInputStream
   FILE       *m_input_file = nullptr;
   bool        m_close_file = false;
 
+  const std::vector<unsigned char> *m_input_data = nullptr;
+  size_t                            m_input_pos = 0;
+
   std::unique_ptr<RawConverter> m_raw_converter;
+  std::vector<unsigned char>    m_input_bytes;
 
 public:
+  using AudioInputStream::read_frames;
+
   ~RawInputStream();
 
   Error   open (const std::string& filename, const RawFormat& format);
-  Error   read_frames (std::vector<float>& samples, size_t count) override;
+  Error   open (const std::vector<unsigned char> *data, const RawFormat& format);
+  Error   read_frames (float *samples, size_t count, size_t& n_frames_read) override;
   void    close();
 
   int     bit_depth() const override;
@@ -84,17 +84,18 @@ RawOutputStream::n_channels() const
 }
 
 Error
-RawOutputStream::write_frames (const vector<float>& samples)
+RawOutputStream::write_frames (const float *samples, size_t n_frames)
 {
   assert (m_state == State::OPEN);
 
-  if (samples.empty())
+  if (!n_frames)
     return Error::Code::NONE;
 
-  vector<unsigned char> bytes (samples.size() * m_format.bit_depth() / 8);
-  m_raw_converter->to_raw (samples.data(), bytes.data(), samples.size());
+  const size_t n_values = n_frames * m_format.n_channels();
+  m_output_bytes.resize (n_values * m_format.bit_depth() / 8);
+  m_raw_converter->to_raw (samples, m_output_bytes.data(), n_values);
 
-  fwrite (&bytes[0], 1, bytes.size(), m_output_file);
+  fwrite (m_output_bytes.data(), 1, m_output_bytes.size(), m_output_file);
   if (ferror (m_output_file))
     return Error ("write sample data failed");
 
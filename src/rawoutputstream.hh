@@ -36,7 +36,10 @@ class RawOutputStream : public AudioOutputStream
   bool        m_close_file = false;
 
   std::unique_ptr<RawConverter> m_raw_converter;
+  std::vector<unsigned char>    m_output_bytes;
 public:
+  using AudioOutputStream::write_frames;
+
   ~RawOutputStream();
 
   int   bit_depth() const override;
@@ -44,7 +47,7 @@ public:
   int   n_channels()  const override;
 
   Error open (const std::string& filename, const RawFormat& format);
-  Error write_frames (const std::vector<float>& frames) override;
+  Error write_frames (const float *frames, size_t n_frames) override;
   Error close() override;
 };
 
@@ -17,6 +17,7 @@
 
 #include "resample.hh"
 #include "wmcommon.hh"
+#include "stats.hh"
 
 #include <assert.h>
 #include <math.h>
@@ -29,8 +30,10 @@ using std::min;
 
 template<class R>
 static void
-process_resampler (R& resampler, const float *in, size_t in_size, float *out, size_t out_size)
+process_resampler (R& resampler, const WavData& wav_data, size_t in_size, float *out, size_t out_size)
 {
+  ScopedStat stat (Stat::RESAMPLE);
+
   resampler.out_count = out_size / resampler.nchan();
   resampler.out_data = out;
 
@@ -39,9 +42,28 @@ process_resampler (R& resampler, const float *in, size_t in_size, float *out, si
   resampler.inp_data  = nullptr;
   resampler.process();
 
-  resampler.inp_count = in_size / resampler.nchan();
-  resampler.inp_data = (float *) in;
-  resampler.process();
+  if (wav_data.format() == WavData::Format::FLOAT)
+    {
+      resampler.inp_count = in_size / resampler.nchan();
+      resampler.inp_data = (float *) wav_data.samples().data();
+      resampler.process();
+    }
+  else
+    {
+      /* convert compact samples to float block by block */
+      const size_t block_size = 8192 * resampler.nchan();
+
+      vector<float> block;
+      for (size_t pos = 0; pos < in_size; pos += block_size)
+        {
+          block.resize (min (block_size, in_size - pos));
+          wav_data.get_samples (pos, block.size(), block.data());
+
+          resampler.inp_count = block.size() / resampler.nchan();
+          resampler.inp_data = block.data();
+          resampler.process();
+        }
+    }
 
   /* zita needs k/2 samples after the actual input */
   resampler.inp_count = resampler.inpsize() / 2;
@@ -60,11 +82,11 @@ resample (const WavData& wav_data, int rate)
   const int hlen = 16;
   const double ratio = double (rate) / wav_data.sample_rate();
 
-  const vector<float>& in = wav_data.samples();
+  const size_t in_size = wav_data.n_values();
 
   WavData wav_data_out ({}, wav_data.n_channels(), rate, wav_data.bit_depth());
   vector<float>& out_ref = wav_data_out.mutable_samples();
-  out_ref.resize (lrint (in.size() / wav_data.n_channels() * ratio) * wav_data.n_channels());
+  out_ref.resize (lrint (in_size / wav_data.n_channels() * ratio) * wav_data.n_channels());
 
   /* zita-resampler provides two resampling algorithms
    *
@@ -80,14 +102,14 @@ resample (const WavData& wav_data, int rate)
   Resampler resampler;
   if (resampler.setup (wav_data.sample_rate(), rate, wav_data.n_channels(), hlen) == 0)
     {
-      process_resampler (resampler, in.data(), in.size(), out_ref.data(), out_ref.size());
+      process_resampler (resampler, wav_data, in_size, out_ref.data(), out_ref.size());
       return wav_data_out;
     }
 
   VResampler vresampler;
   if (vresampler.setup (ratio, wav_data.n_channels(), hlen) == 0)
     {
-      process_resampler (vresampler, in.data(), in.size(), out_ref.data(), out_ref.size());
+      process_resampler (vresampler, wav_data, in_size, out_ref.data(), out_ref.size());
       return wav_data_out;
     }
   error ("audiowmark: resampling from rate %d to rate %d not supported.\n", wav_data.sample_rate(), rate);
@@ -98,8 +120,7 @@ WavData
 resample_ratio_truncate (const WavData& wav_data, double ratio, int new_rate, double max_in_seconds)
 {
   const int hlen = 16;
-  const vector<float>& in = wav_data.samples();
-  size_t in_size_truncate = in.size();
+  size_t in_size_truncate = wav_data.n_values();
   if (max_in_seconds > 0)
     in_size_truncate = min<size_t> (in_size_truncate, wav_data.n_channels() * lrint (wav_data.sample_rate() * max_in_seconds));
 
@@ -115,7 +136,7 @@ resample_ratio_truncate (const WavData& wav_data, double ratio, int new_rate, do
       exit (1);
     }
 
-  process_resampler (vresampler, in.data(), in_size_truncate, out_ref.data(), out_ref.size());
+  process_resampler (vresampler, wav_data, in_size_truncate, out_ref.data(), out_ref.size());
   return wav_data_out;
 }
 
@@ -168,6 +189,8 @@ public:
   void
   write_frames (const vector<float>& frames)
   {
+    ScopedStat stat (Stat::RESAMPLE);
+
     if (first_write)
       {
         /* avoid timeshift: zita needs k/2 - 1 samples before the actual input */
@@ -41,6 +41,7 @@ SFInputStream::open (const string& filename)
       }
     else
       {
+        m_filename = filename;
         return sf_open (filename.c_str(), SFM_READ, sfinfo);
       }
   });
@@ -71,6 +72,8 @@ SFInputStream::open (std::function<SNDFILE* (SF_INFO *)> open_func)
   m_n_channels  = sfinfo.channels;
   m_n_frames    = (sfinfo.frames == SF_COUNT_MAX) ? N_FRAMES_UNKNOWN : sfinfo.frames;
   m_sample_rate = sfinfo.samplerate;
+  m_sf_format   = sfinfo.format;
+  m_seekable    = sfinfo.seekable;
 
   switch (sfinfo.format & SF_FORMAT_SUBMASK)
     {
@@ -171,26 +174,25 @@ SFInputStream::encoding() const
 }
 
 Error
-SFInputStream::read_frames (vector<float>& samples, size_t count)
+SFInputStream::read_frames (float *samples, size_t count, size_t& n_frames_read)
 {
   assert (m_state == State::OPEN);
 
+  n_frames_read = 0;
   if (m_encoding == Encoding::FLOAT) /* float or double input */
     {
-      samples.resize (count * m_n_channels);
-
-      sf_count_t r_count = sf_readf_float (m_sndfile, &samples[0], count);
+      sf_count_t r_count = sf_readf_float (m_sndfile, samples, count);
 
       if (sf_error (m_sndfile))
         return Error (sf_strerror (m_sndfile));
 
-      samples.resize (r_count * m_n_channels);
+      n_frames_read = r_count;
     }
   else /* integer input */
     {
-      vector<int> isamples (count * m_n_channels);
+      m_isamples.resize (count * m_n_channels);
 
-      sf_count_t r_count = sf_readf_int (m_sndfile, &isamples[0], count);
+      sf_count_t r_count = sf_readf_int (m_sndfile, m_isamples.data(), count);
 
       if (sf_error (m_sndfile))
         return Error (sf_strerror (m_sndfile));
@@ -203,11 +205,53 @@ SFInputStream::read_frames (vector<float>& samples, size_t count)
        * and float manually - the important part is that the normalization factors
        * used during read and write are identical
        */
-      samples.resize (r_count * m_n_channels);
       const float norm = 1.0 / 0x80000000LL;
-      for (size_t i = 0; i < samples.size(); i++)
-        samples[i] = isamples[i] * norm;
+      for (sf_count_t i = 0; i < r_count * m_n_channels; i++)
+        samples[i] = m_isamples[i] * norm;
+
+      n_frames_read = r_count;
+    }
+
+  return Error::Code::NONE;
+}
+
+/* flac frames can be decoded independently, and libsndfile seeks in flac files sample exactly */
+bool
+SFInputStream::can_reopen() const
+{
+  return m_state == State::OPEN && !m_filename.empty() && m_seekable && m_n_frames != N_FRAMES_UNKNOWN &&
+         (m_sf_format & SF_FORMAT_TYPEMASK) == SF_FORMAT_FLAC;
+}
+
+std::unique_ptr<AudioInputStream>
+SFInputStream::reopen (Error& err) const
+{
+  if (!can_reopen())
+    {
+      err = Error ("reopen not supported for this input stream");
+      return nullptr;
+    }
+
+  std::unique_ptr<SFInputStream> in_stream (new SFInputStream());
+  err = in_stream->open (m_filename);
+  if (err)
+    return nullptr;
+
+  if (in_stream->n_frames() != m_n_frames || in_stream->n_channels() != m_n_channels)
+    {
+      err = Error ("reopen: input file changed");
+      return nullptr;
     }
+  return std::move (in_stream);
+}
+
+Error
+SFInputStream::seek (size_t frame)
+{
+  assert (m_state == State::OPEN);
+
+  if (sf_seek (m_sndfile, frame, SEEK_SET) < 0)
+    return Error (sf_strerror (m_sndfile));
 
   return Error::Code::NONE;
 }
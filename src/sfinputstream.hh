@@ -41,6 +41,9 @@ private:
   SFVirtualData m_virtual_data;
 
   SNDFILE    *m_sndfile = nullptr;
+  std::string m_filename;
+  int         m_sf_format = 0;
+  bool        m_seekable = false;
   int         m_n_channels = 0;
   size_t      m_n_frames = 0;
   int         m_bit_depth = 0;
@@ -48,6 +51,8 @@ private:
   Encoding    m_encoding = Encoding::SIGNED;
   bool        m_is_stdin = false;
 
+  std::vector<int> m_isamples;
+
   enum class State {
     NEW,
     OPEN,
@@ -57,13 +62,19 @@ private:
 
   Error open (std::function<SNDFILE* (SF_INFO *)> open_func);
 public:
+  using AudioInputStream::read_frames;
+
   ~SFInputStream();
 
   Error               open (const std::string& filename);
   Error               open (const std::vector<unsigned char> *data);
-  Error               read_frames (std::vector<float>& samples, size_t count) override AUDIOWMARK_EXTRA_OPT;
+  Error               read_frames (float *samples, size_t count, size_t& n_frames_read) override AUDIOWMARK_EXTRA_OPT;
   void                close();
 
+  bool                can_reopen() const override;
+  std::unique_ptr<AudioInputStream> reopen (Error& err) const override;
+  Error               seek (size_t frame) override;
+
   int
   n_channels() const override
   {
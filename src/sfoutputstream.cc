@@ -113,10 +113,21 @@ SFOutputStream::open (std::function<SNDFILE* (SF_INFO *)> open_func, int n_chann
 
       return Error (msg);
     }
+  if (m_compression_level >= 0)
+    sf_command (m_sndfile, SFC_SET_COMPRESSION_LEVEL, &m_compression_level, sizeof (m_compression_level));
+
   m_state       = State::OPEN;
   return Error::Code::NONE;
 }
 
+void
+SFOutputStream::set_compression_level (double level)
+{
+  assert (m_state == State::NEW);
+
+  m_compression_level = level;
+}
+
 Error
 SFOutputStream::close()
 {
@@ -132,26 +143,27 @@ SFOutputStream::close()
 }
 
 Error
-SFOutputStream::write_frames (const vector<float>& samples)
+SFOutputStream::write_frames (const float *samples, size_t n_frames)
 {
-  sf_count_t frames = samples.size() / m_n_channels;
+  sf_count_t frames = n_frames;
   sf_count_t count;
 
+  const size_t n_values = n_frames * m_n_channels;
   if (m_write_float_data)
     {
-      vector<float> fsamples (samples.size());
-      for (size_t i = 0; i < samples.size(); i++)
-        fsamples[i] = float_clip (samples[i]);
+      m_fsamples.resize (n_values);
+      for (size_t i = 0; i < n_values; i++)
+        m_fsamples[i] = float_clip (samples[i]);
 
-      count = sf_writef_float (m_sndfile, fsamples.data(), frames);
+      count = sf_writef_float (m_sndfile, m_fsamples.data(), frames);
     }
   else
     {
-      vector<int> isamples (samples.size());
-      for (size_t i = 0; i < samples.size(); i++)
-        isamples[i] = float_to_int_clip<32> (samples[i]);
+      m_isamples.resize (n_values);
+      for (size_t i = 0; i < n_values; i++)
+        m_isamples[i] = float_to_int_clip<32> (samples[i]);
 
-      count = sf_writef_int (m_sndfile, isamples.data(), frames);
+      count = sf_writef_int (m_sndfile, m_isamples.data(), frames);
     }
 
 
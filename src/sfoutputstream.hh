@@ -39,6 +39,10 @@ private:
   int         m_sample_rate = 0;
   int         m_n_channels = 0;
   bool        m_write_float_data = false;
+  double      m_compression_level = -1;
+
+  std::vector<float> m_fsamples;
+  std::vector<int>   m_isamples;
 
   enum class State {
     NEW,
@@ -49,12 +53,17 @@ private:
 
   Error open (std::function<SNDFILE* (SF_INFO *)> open_func, int n_channels, int sample_rate, int bit_depth, Encoding encoding, OutFormat out_format);
 public:
+  using AudioOutputStream::write_frames;
+
   ~SFOutputStream();
 
   Error  open (const std::string& filename, int n_channels, int sample_rate, int bit_depth, Encoding encoding, OutFormat out_format = OutFormat::WAV);
   Error  open (std::vector<unsigned char> *data, int n_channels, int sample_rate, int bit_depth, Encoding encoding, OutFormat out_format = OutFormat::WAV);
-  Error  write_frames (const std::vector<float>& frames) override AUDIOWMARK_EXTRA_OPT;
+  Error  write_frames (const float *frames, size_t n_frames) override AUDIOWMARK_EXTRA_OPT;
   Error  close() override;
+
+  /* flac compression level: 0 (fastest) ... 1 (best compression), must be set before open() */
+  void   set_compression_level (double level);
   int    bit_depth() const override;
   int    sample_rate() const override;
   int    n_channels() const override;
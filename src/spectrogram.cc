@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spectrogram.hh"
+#include "dspkernels.hh"
+
+#include <algorithm>
+#include <utility>
+#include <new>
+#include <fftw3.h>
+
+using std::complex;
+
+/* fftwf_malloc returns memory that is suitably aligned for SIMD */
+static void *
+aligned_malloc (size_t size)
+{
+  void *ptr = fftwf_malloc (size);
+  if (!ptr && size)
+    throw std::bad_alloc(); // like std::vector, which is used for the other large buffers
+  return ptr;
+}
+
+void
+Spectrogram::AlignedFree::operator() (void *ptr) const
+{
+  fftwf_free (ptr);
+}
+
+Spectrogram::Spectrogram (size_t n_frames, int n_channels, size_t n_bins) :
+  m_n_frames (n_frames),
+  m_n_channels (n_channels),
+  m_n_bins (n_bins)
+{
+  /* round up to 8 complex values = 64 bytes (8 floats = 32 bytes for dB values) */
+  m_stride = (n_bins + 7) / 8 * 8;
+
+  const size_t n_values = m_stride * n_frames * n_channels;
+  m_bins.reset (static_cast<complex<float> *> (aligned_malloc (sizeof (complex<float>) * n_values)));
+  std::fill (m_bins.get(), m_bins.get() + n_values, 0);
+}
+
+Spectrogram::Spectrogram (Spectrogram&& other) noexcept
+{
+  *this = std::move (other);
+}
+
+/* leave other empty */
+Spectrogram&
+Spectrogram::operator= (Spectrogram&& other) noexcept
+{
+  m_n_frames   = std::exchange (other.m_n_frames, 0);
+  m_n_channels = std::exchange (other.m_n_channels, 0);
+  m_n_bins     = std::exchange (other.m_n_bins, 0);
+  m_stride     = std::exchange (other.m_stride, 0);
+  m_bins       = std::move (other.m_bins);
+  m_db         = std::move (other.m_db);
+  return *this;
+}
+
+void
+Spectrogram::compute_db (float min_db)
+{
+  /* dB plane uses the same stride as bins, so each dB spectrum is aligned like the block */
+  const size_t n_values = m_stride * m_n_frames * m_n_channels;
+  m_db.reset (static_cast<float *> (aligned_malloc (sizeof (float) * n_values)));
+
+  const DSPKernels& dsp = dsp_kernels();
+  for (size_t i = 0; i < m_n_frames * m_n_channels; i++)
+    {
+      float *db = &m_db[i * m_stride];
+      std::fill (db, db + m_stride, 0);
+      dsp.add_db_from_complex (reinterpret_cast<const float *> (&m_bins[i * m_stride]), db, m_n_bins, min_db);
+    }
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIOWMARK_SPECTROGRAM_HH
+#define AUDIOWMARK_SPECTROGRAM_HH
+
+#include <complex>
+#include <memory>
+#include <assert.h>
+
+/*
+ * Spectrogram stores the complex FFT bins of n_frames x n_channels spectra in
+ * one contiguous block of memory (frame major, then channel). The block is
+ * allocated with fftwf_malloc (aligned for SIMD, 16 or 32 bytes depending on
+ * the fftw build), and each spectrum is padded to a multiple of 64 bytes (32
+ * bytes for dB values), so every spectrum is aligned like the block.
+ * Optionally, a plane of dB values (same layout) can be computed once from the
+ * bins, so that decoders don't need to compute dB values for the same bin again
+ * and again.
+ *
+ * A new Spectrogram is zero initialized. Spectrogram can be moved, but not
+ * copied.
+ */
+class Spectrogram
+{
+  struct AlignedFree
+  {
+    void operator() (void *ptr) const;
+  };
+
+  size_t m_n_frames   = 0;
+  int    m_n_channels = 0;
+  size_t m_n_bins     = 0;
+  size_t m_stride     = 0; // distance between two spectra in complex values (bins) or floats (dB)
+
+  std::unique_ptr<std::complex<float>[], AlignedFree> m_bins;
+  std::unique_ptr<float[], AlignedFree>               m_db;
+
+  size_t
+  offset (size_t frame, int ch) const
+  {
+    assert (frame < m_n_frames && ch >= 0 && ch < m_n_channels);
+    return (frame * m_n_channels + ch) * m_stride;
+  }
+public:
+  Spectrogram() = default;
+  Spectrogram (size_t n_frames, int n_channels, size_t n_bins);
+
+  Spectrogram (Spectrogram&& other) noexcept;
+  Spectrogram& operator= (Spectrogram&& other) noexcept;
+
+  size_t n_frames() const   { return m_n_frames; }
+  int    n_channels() const { return m_n_channels; }
+  size_t n_bins() const     { return m_n_bins; }
+  bool   empty() const      { return m_n_frames == 0; }
+
+  std::complex<float>       *bins (size_t frame, int ch)       { return &m_bins[offset (frame, ch)]; }
+  const std::complex<float> *bins (size_t frame, int ch) const { return &m_bins[offset (frame, ch)]; }
+
+  /* dB plane: db (frame, ch)[i] = 10 * log10 (abs (bins (frame, ch)[i])^2), or min_db for zero bins */
+  void compute_db (float min_db);
+  bool has_db() const { return m_db != nullptr; }
+
+  const float *
+  db (size_t frame, int ch) const
+  {
+    assert (m_db);
+    return &m_db[offset (frame, ch)];
+  }
+};
+
+#endif /* AUDIOWMARK_SPECTROGRAM_HH */
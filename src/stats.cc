@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stats.hh"
+#include "utils.hh"
+
+#include <atomic>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+using std::string;
+
+namespace
+{
+
+constexpr size_t n_stats = size_t (Stat::COUNT);
+
+struct StatInfo
+{
+  const char *name;
+  bool        timed;
+};
+
+const StatInfo stat_info[n_stats] =
+{
+  { "chunk_load",    true },
+  { "read",          true },
+  { "write",         true },
+  { "resample",      true },
+  { "sync_approx",   true },
+  { "sync_refine",   true },
+  { "fft",           false },
+  { "viterbi",       true },
+  { "speed_detect",  true },
+  { "speed_prepare", true },
+  { "speed_compare", true },
+  { "limiter",       true },
+};
+
+/* plain arrays (no destructors), so the values are still valid in the atexit handler */
+std::atomic<uint64_t> stat_count[n_stats];
+std::atomic<uint64_t> stat_ns[n_stats];
+
+string stats_filename;
+double stats_start_time = 0;
+
+double
+rusage_seconds (const timeval& tv)
+{
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void
+write_stats()
+{
+  FILE *out = stderr;
+  if (stats_filename != "-")
+    {
+      out = fopen (stats_filename.c_str(), "w");
+      if (!out)
+        {
+          error ("audiowmark: failed to write stats to %s: %s\n", stats_filename.c_str(), strerror (errno));
+          return;
+        }
+    }
+
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+
+  fprintf (out, "{ \"wall_seconds\": %.6f,\n", get_time() - stats_start_time);
+  fprintf (out, "  \"cpu_seconds\": %.6f,\n", rusage_seconds (usage.ru_utime) + rusage_seconds (usage.ru_stime));
+  fprintf (out, "  \"max_rss_kb\": %ld,\n", usage.ru_maxrss);
+  fprintf (out, "  \"phases\": {\n");
+  for (size_t i = 0; i < n_stats; i++)
+    {
+      fprintf (out, "    \"%s\": { \"count\": %" PRIu64, stat_info[i].name, stat_count[i].load());
+      if (stat_info[i].timed)
+        fprintf (out, ", \"seconds\": %.6f", stat_ns[i].load() * 1e-9);
+      fprintf (out, " }%s\n", i + 1 < n_stats ? "," : "");
+    }
+  fprintf (out, "  }\n");
+  fprintf (out, "}\n");
+
+  if (out != stderr)
+    fclose (out);
+}
+
+}
+
+bool Stats::s_enabled = false;
+
+void
+Stats::enable (const string& filename)
+{
+  s_enabled = true;
+  stats_filename = filename;
+  stats_start_time = get_time();
+
+  /* commands return from main or call exit() in many places, so write the stats from an exit handler */
+  if (!filename.empty())
+    atexit (write_stats);
+}
+
+void
+Stats::add_count (Stat stat, uint64_t n)
+{
+  stat_count[size_t (stat)].fetch_add (n, std::memory_order_relaxed);
+}
+
+void
+Stats::add_time (Stat stat, uint64_t ns)
+{
+  stat_count[size_t (stat)].fetch_add (1, std::memory_order_relaxed);
+  stat_ns[size_t (stat)].fetch_add (ns, std::memory_order_relaxed);
+}
+
+uint64_t
+Stats::get_count (Stat stat)
+{
+  return stat_count[size_t (stat)].load();
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIOWMARK_STATS_HH
+#define AUDIOWMARK_STATS_HH
+
+#include <string>
+#include <chrono>
+
+#include <stdint.h>
+
+/*
+ * Stats collects per phase counters and timings (--stats) to show where the
+ * time goes for a real input file. If stats are not enabled (the default), a
+ * ScopedStat or Stats::count costs only one predictable branch.
+ *
+ * Times are summed over all threads, so for phases which run in parallel
+ * (like viterbi decoding) the time can be larger than the wall clock time.
+ * Phases can be nested, for instance chunk_load includes read and resample.
+ */
+enum class Stat
+{
+  CHUNK_LOAD,
+  READ,
+  WRITE,
+  RESAMPLE,
+  SYNC_APPROX,
+  SYNC_REFINE,
+  FFT,            // count only
+  VITERBI,
+  SPEED_DETECT,
+  SPEED_PREPARE,
+  SPEED_COMPARE,
+  LIMITER,
+  COUNT
+};
+
+class Stats
+{
+  static bool s_enabled;
+
+  static void add_count (Stat stat, uint64_t n);
+public:
+  static bool
+  enabled()
+  {
+    return s_enabled;
+  }
+  /* write stats as json to filename ("-": stderr) when the program exits ("": don't write, for tests) */
+  static void enable (const std::string& filename);
+
+  static void add_time (Stat stat, uint64_t ns);
+  static uint64_t get_count (Stat stat);
+
+  static void
+  count (Stat stat, uint64_t n = 1)
+  {
+    if (s_enabled)
+      add_count (stat, n);
+  }
+};
+
+class ScopedStat
+{
+  const Stat m_stat;
+  const bool m_active;
+  std::chrono::steady_clock::time_point m_start;
+public:
+  explicit
+  ScopedStat (Stat stat) :
+    m_stat (stat),
+    m_active (Stats::enabled())
+  {
+    if (m_active)
+      m_start = std::chrono::steady_clock::now();
+  }
+  ~ScopedStat()
+  {
+    if (m_active)
+      Stats::add_time (m_stat, std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now() - m_start).count());
+  }
+};
+
+#endif /* AUDIOWMARK_STATS_HH */
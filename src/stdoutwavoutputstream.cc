@@ -146,20 +146,22 @@ StdoutWavOutputStream::open (int n_channels, int sample_rate, int bit_depth, Enc
 }
 
 Error
-StdoutWavOutputStream::write_frames (const vector<float>& samples)
+StdoutWavOutputStream::write_frames (const float *samples, size_t n_frames)
 {
-  if (samples.empty())
+  if (!n_frames)
     return Error::Code::NONE;
 
+  const size_t n_values = n_frames * m_n_channels;
+
   const size_t block_size = 8192 * m_n_channels;
   const int sample_width = m_bit_depth / 8;
 
   m_output_bytes.resize (sample_width * block_size);
   size_t pos = 0;
 
-  while (size_t todo = min (block_size, samples.size() - pos))
+  while (size_t todo = min (block_size, n_values - pos))
     {
-      m_raw_converter->to_raw (samples.data() + pos, m_output_bytes.data(), todo);
+      m_raw_converter->to_raw (samples + pos, m_output_bytes.data(), todo);
 
       fwrite (m_output_bytes.data(), 1, todo * sample_width, stdout);
       if (ferror (stdout))
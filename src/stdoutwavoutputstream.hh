@@ -41,10 +41,12 @@ class StdoutWavOutputStream : public AudioOutputStream
   std::unique_ptr<RawConverter> m_raw_converter;
 
 public:
+  using AudioOutputStream::write_frames;
+
   ~StdoutWavOutputStream();
 
   Error open (int n_channels, int sample_rate, int bit_depth, Encoding encoding, size_t n_frames, bool wav_pipe);
-  Error write_frames (const std::vector<float>& frames) override;
+  Error write_frames (const float *frames, size_t n_frames) override;
   Error close() override;
   int  sample_rate() const override;
   int  bit_depth() const override;
@@ -21,6 +21,8 @@
 #include "syncfinder.hh"
 #include "threadpool.hh"
 #include "wmcommon.hh"
+#include "dspkernels.hh"
+#include "stats.hh"
 
 using std::complex;
 using std::vector;
@@ -140,6 +142,8 @@ SyncFinder::sync_decode (const vector<vector<FrameBit>>& sync_bits,
 
   size_t n_bands = Params::max_band - Params::min_band + 1;
   int bit_count = 0;
+
+  const DSPKernels& dsp = dsp_kernels();
   
   // Added multi-bit confidence tracking
   vector<double> bit_qualities;
@@ -155,11 +159,7 @@ SyncFinder::sync_decode (const vector<vector<FrameBit>>& sync_bits,
           if (have_frames[start_frame + frame_bit.frame])
             {
               const int index = (start_frame + frame_bit.frame) * n_bands;
-              for (size_t i = 0; i < frame_bit.up.size(); i++)
-                {
-                  umag += fft_out_db[index + frame_bit.up[i]];
-                  dmag += fft_out_db[index + frame_bit.down[i]];
-                }
+              dsp.sum_up_down (&fft_out_db[index], frame_bit.up.data(), frame_bit.down.data(), frame_bit.up.size(), &umag, &dmag);
               frame_bit_count++;
             }
         }
@@ -198,25 +198,33 @@ SyncFinder::sync_decode (const vector<vector<FrameBit>>& sync_bits,
   return sync_quality;
 }
 
+template<class T> static void
+find_non_silent_range (const vector<T>& samples, size_t& first, size_t& last)
+{
+  // find first non-zero sample
+  first = 0;
+  while (first < samples.size() && samples[first] == 0)
+    first++;
+
+  // search last to get [first, last) range
+  last = samples.size();
+  while (last > first && samples[last - 1] == 0)
+    last--;
+}
+
 void
 SyncFinder::scan_silence (const WavData& wav_data)
 {
-  const vector<float>& samples = wav_data.samples();
-
-  // find first non-zero sample
-  wav_data_first = 0;
-  while (wav_data_first < samples.size() && samples[wav_data_first] == 0)
-    wav_data_first++;
-
-  // search wav_data_last to get [wav_data_first, wav_data_last) range
-  wav_data_last = samples.size();
-  while (wav_data_last > wav_data_first && samples[wav_data_last - 1] == 0)
-    wav_data_last--;
+  if (wav_data.format() == WavData::Format::FLOAT)
+    find_non_silent_range (wav_data.samples(), wav_data_first, wav_data_last);
+  else
+    find_non_silent_range (wav_data.samples_i16(), wav_data_first, wav_data_last);
 }
 
 void
 SyncFinder::search_approx (vector<SearchKeyResult>& key_results, const vector<vector<vector<FrameBit>>>& sync_bits, const WavData& wav_data, Mode mode)
 {
+  ScopedStat    stat (Stat::SYNC_APPROX);
   ThreadPool    thread_pool;
   vector<float> fft_db;
   vector<char>  have_frames;
@@ -504,6 +512,7 @@ SyncFinder::sync_select_truncate_n (vector<SearchScore>& sync_scores, size_t n)
 void
 SyncFinder::search_refine (const WavData& wav_data, Mode mode, SearchKeyResult& key_result, const vector<vector<FrameBit>>& sync_bits)
 {
+  ScopedStat          stat (Stat::SYNC_REFINE);
   ThreadPool          thread_pool;
   std::mutex          result_mutex;
   vector<SearchScore> result_scores;
@@ -614,7 +623,7 @@ SyncFinder::search (const vector<Key>& key_list, const WavData& wav_data, Mode m
     {
       /* in block mode we don't do anything special for silence at beginning/end */
       wav_data_first = 0;
-      wav_data_last  = wav_data.samples().size();
+      wav_data_last  = wav_data.n_values();
     }
 
   vector<SearchKeyResult>           search_key_results;
@@ -683,7 +692,6 @@ SyncFinder::sync_fft (const WavData& wav_data, size_t index, size_t frame_count,
     return;
 
   FFTAnalyzer fft_analyzer (wav_data.n_channels());
-  const vector<float>& samples = wav_data.samples();
   const size_t n_bands = Params::max_band - Params::min_band + 1;
 
   fft_out_db.resize (n_bands * frame_count);
@@ -699,7 +707,7 @@ SyncFinder::sync_fft (const WavData& wav_data, size_t index, size_t frame_count,
         continue;
 
       /* check if we'd read past end */
-      if (f_last > samples.size())
+      if (f_last > wav_data.n_values())
         continue;
 
       /* check if we'd read within silent area at beginning/end */
@@ -708,22 +716,12 @@ SyncFinder::sync_fft (const WavData& wav_data, size_t index, size_t frame_count,
 
       have_frames[f] = 1;
 
-      vector<vector<complex<float>>> fft_out = fft_analyzer.run_fft (samples, index + f * Params::frame_size);
+      /* restrict our analysis to bands with watermark only */
+      fft_analyzer.run_fft_band_db (wav_data, index + f * Params::frame_size, &fft_out_db[f * n_bands]);
 
-      for (size_t ch = 0; ch < fft_out.size(); ch++)
-        {
-          for (size_t i = 0; i < n_bands; i++)
-            {
-              const double min_db = -96;
-              /* use (i + min_band) as index to restrict our analysis to bands with watermark only */
-              fft_out_db[f * n_bands + i] += db_from_complex (fft_out[ch][i + Params::min_band], min_db);
-            }
-        }
-      if (fft_out.size()) /* normalize */
-        {
-          for (size_t i = 0; i < n_bands; i++)
-            fft_out_db[f * n_bands + i] /= fft_out.size();
-        }
+      /* normalize */
+      for (size_t i = 0; i < n_bands; i++)
+        fft_out_db[f * n_bands + i] /= wav_data.n_channels();
     }
 }
 
@@ -65,6 +65,7 @@
  */
 class SyncFinder
 {
+  friend class SyncFinderBench; // microbenchmarks for sync_fft / sync_decode (benchkernels.cc)
 public:
   enum class Mode { BLOCK, CLIP };
 
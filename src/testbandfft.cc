@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+#include <random>
+#include <assert.h>
+#include <math.h>
+
+#include "wmcommon.hh"
+#include "utils.hh"
+
+using std::vector;
+
+/* run_fft_band_db: only dB values of the bands, without copying the full spectrum */
+static double
+bench_band_db (FFTAnalyzer& fft_analyzer, const WavData& wav_data, vector<float>& band_db)
+{
+  const size_t n_bands = Params::max_band - Params::min_band + 1;
+  const size_t n_frames = wav_data.n_frames() / Params::frame_size;
+
+  band_db.assign (n_frames * n_bands, 0);
+
+  double start = get_time();
+  for (size_t f = 0; f < n_frames; f++)
+    fft_analyzer.run_fft_band_db (wav_data, f * Params::frame_size, &band_db[f * n_bands]);
+  double end = get_time();
+
+  return (end - start) * 1e9 / n_frames;
+}
+
+/* reference: full spectrum for each frame (run_fft), dB values computed from the bins */
+static double
+bench_full (FFTAnalyzer& fft_analyzer, const WavData& wav_data, vector<float>& band_db)
+{
+  const size_t n_bands = Params::max_band - Params::min_band + 1;
+  const size_t n_frames = wav_data.n_frames() / Params::frame_size;
+
+  band_db.assign (n_frames * n_bands, 0);
+
+  double start = get_time();
+  for (size_t f = 0; f < n_frames; f++)
+    {
+      Spectrogram spectrogram = fft_analyzer.run_fft (wav_data.samples(), f * Params::frame_size);
+      for (int ch = 0; ch < wav_data.n_channels(); ch++)
+        for (size_t i = 0; i < n_bands; i++)
+          band_db[f * n_bands + i] += db_from_complex (spectrogram.bins (0, ch)[Params::min_band + i], -96);
+    }
+  double end = get_time();
+
+  return (end - start) * 1e9 / n_frames;
+}
+
+int
+main (int argc, char **argv)
+{
+  const int n_channels = 2;
+  const size_t n_frames = 2000;
+
+  std::mt19937 rng (42);
+  std::uniform_real_distribution<float> dist (-0.5, 0.5);
+
+  vector<float> samples (n_frames * Params::frame_size * n_channels);
+  for (auto& s : samples)
+    s = dist (rng);
+
+  WavData wav_data (samples, n_channels, Params::mark_sample_rate, 16);
+
+  FFTAnalyzer fft_analyzer (n_channels);
+
+  vector<float> band_db, full_db;
+
+  /* warmup: plan creation */
+  bench_band_db (fft_analyzer, wav_data, band_db);
+  bench_full (fft_analyzer, wav_data, full_db);
+
+  double band_ns = bench_band_db (fft_analyzer, wav_data, band_db);
+  double full_ns = bench_full (fft_analyzer, wav_data, full_db);
+
+  double max_diff = 0;
+  for (size_t i = 0; i < band_db.size(); i++)
+    max_diff = std::max (max_diff, fabs (double (band_db[i]) - full_db[i]));
+
+  printf ("band db:  %f ns/frame\n", band_ns);
+  printf ("full fft: %f ns/frame\n", full_ns);
+  printf ("max_diff = %f dB [ should be less than 0.01 ]\n", max_diff);
+  assert (max_diff < 0.01);
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+#include <random>
+#include <assert.h>
+#include <math.h>
+
+#include "dspkernels.hh"
+#include "utils.hh"
+
+using std::vector;
+
+static std::mt19937 rng (42);
+
+static vector<float>
+random_vec (size_t n, float min_value, float max_value)
+{
+  std::uniform_real_distribution<float> dist (min_value, max_value);
+
+  vector<float> v (n);
+  for (auto& x : v)
+    x = dist (rng);
+  return v;
+}
+
+static void
+check (const char *what, double error, double bound)
+{
+  printf ("   %-20s %e [ should be less than %e ]\n", what, error, bound);
+  assert (error < bound);
+}
+
+static void
+test_kernels (const DSPKernels& k)
+{
+  const DSPKernels& ref = dsp_kernels_scalar();
+
+  printf ("%s:\n", k.name);
+
+  /* odd sizes to test the scalar tail code, too */
+  const size_t n = 1027;
+
+  for (size_t stride : { 1, 2, 3 })
+    {
+      auto in = random_vec (n * stride, -1, 1);
+      auto window = random_vec (n, 0, 1);
+      vector<float> out (n), ref_out (n);
+      k.window_deinterleave (in.data(), stride, window.data(), out.data(), n);
+      ref.window_deinterleave (in.data(), stride, window.data(), ref_out.data(), n);
+      assert (out == ref_out);
+    }
+
+  /* add_db_from_complex */
+  {
+    auto in = random_vec (n * 2, -1, 1);
+    in[10] = in[11] = 0; // min_db case
+    vector<float> db (n, 1), ref_db (n, 1);
+    k.add_db_from_complex (in.data(), db.data(), n, -96);
+    ref.add_db_from_complex (in.data(), ref_db.data(), n, -96);
+
+    double err = 0;
+    for (size_t i = 0; i < n; i++)
+      err = std::max (err, fabs (double (db[i]) - ref_db[i]));
+    check ("add_db_from_complex", err, 1e-4);
+  }
+
+  /* sum_up_down */
+  {
+    auto db = random_vec (n, -100, 0);
+    vector<int> up, down;
+    std::uniform_int_distribution<int> idx (0, n - 1);
+    for (size_t i = 0; i < 53; i++)
+      {
+        up.push_back (idx (rng));
+        down.push_back (idx (rng));
+      }
+    float umag = 1, dmag = 2, ref_umag = 1, ref_dmag = 2;
+    k.sum_up_down (db.data(), up.data(), down.data(), up.size(), &umag, &dmag);
+    ref.sum_up_down (db.data(), up.data(), down.data(), up.size(), &ref_umag, &ref_dmag);
+    check ("sum_up_down", std::max (fabs (umag - ref_umag), fabs (dmag - ref_dmag)) / fabs (ref_umag), 1e-5);
+  }
+
+  /* frame_mod_delta */
+  {
+    auto in = random_vec (n * 2, -20, 20);
+    in[20] = in[21] = 0; // below min_mag
+    auto exps = random_vec (n, -0.02, 0.02);
+    for (size_t i = 0; i < n; i += 3)
+      exps[i] = 0;
+
+    auto out = random_vec (n * 2, -1, 1);
+    auto ref_out = out;
+    k.frame_mod_delta (in.data(), exps.data(), out.data(), n, 1e-7);
+    ref.frame_mod_delta (in.data(), exps.data(), ref_out.data(), n, 1e-7);
+
+    double err = 0;
+    for (size_t i = 0; i < n * 2; i++)
+      {
+        /* relative to the unmodified value, as factor can be close to 0 */
+        err = std::max (err, fabs (double (out[i]) - ref_out[i]) / std::max (fabs (in[i]), 1e-3f));
+        if (exps[i / 2] == 0 || i / 2 == 10)
+          assert (out[i] == ref_out[i]);
+      }
+    check ("frame_mod_delta", err, 2e-6);
+  }
+
+  /* abs_max */
+  {
+    auto in = random_vec (n, -1, 1);
+    in[n - 1] = -2; // tail
+    assert (k.abs_max (in.data(), n, 0) == ref.abs_max (in.data(), n, 0));
+    in[n - 1] = 0;
+    in[17] = -3;
+    assert (k.abs_max (in.data(), n, 0) == ref.abs_max (in.data(), n, 0));
+    assert (k.abs_max (in.data(), n, 4) == 4);
+  }
+
+  /* scale_ramp */
+  for (size_t n_channels : { 1, 2, 3, 4, 6 })
+    {
+      const size_t n_frames = 301;
+      auto in = random_vec (n_frames * n_channels, -1, 1);
+      vector<float> out (in.size()), ref_out (in.size());
+      k.scale_ramp (in.data(), out.data(), n_frames, n_channels, 0.9, -0.001);
+      ref.scale_ramp (in.data(), ref_out.data(), n_frames, n_channels, 0.9, -0.001);
+
+      double err = 0;
+      for (size_t i = 0; i < in.size(); i++)
+        err = std::max (err, fabs (double (out[i]) - ref_out[i]));
+      assert (err < 1e-6);
+    }
+
+  /* add */
+  {
+    auto in = random_vec (n, -1, 1);
+    auto out = random_vec (n, -1, 1);
+    auto ref_out = out;
+    k.add (out.data(), in.data(), n);
+    ref.add (ref_out.data(), in.data(), n);
+    assert (out == ref_out);
+  }
+
+  /* power_sum */
+  {
+    auto a = random_vec (n, -1, 1);
+    auto b = random_vec (n, -0.1, 0.1);
+    double pa = 0, pb = 0, ref_pa = 0, ref_pb = 0;
+    k.power_sum (a.data(), b.data(), n, &pa, &pb);
+    ref.power_sum (a.data(), b.data(), n, &ref_pa, &ref_pb);
+    check ("power_sum", std::max (fabs (pa - ref_pa) / ref_pa, fabs (pb - ref_pb) / ref_pb), 1e-5);
+  }
+
+  /* raw sample conversion: must be bit-identical */
+  {
+    auto in = random_vec (n, -1.2, 1.2);
+    in[0] = 1;
+    in[1] = -1;
+    in[2] = 0.99999994f;
+    in[3] = -0.99999994f;
+    in[4] = 1.00000012f;
+    in[5] = -1.00000012f;
+    in[6] = -0.f;
+    in[7] = 32767.5 / 32768;
+    in[8] = 1e30;
+    in[9] = -1e30;
+
+    for (int bytes : { 2, 3, 4 })
+      {
+        auto to_raw = bytes == 2 ? k.float_to_s16le : (bytes == 3 ? k.float_to_s24le : k.float_to_s32le);
+        auto ref_to_raw = bytes == 2 ? ref.float_to_s16le : (bytes == 3 ? ref.float_to_s24le : ref.float_to_s32le);
+        auto from_raw = bytes == 2 ? k.s16le_to_float : (bytes == 3 ? k.s24le_to_float : k.s32le_to_float);
+        auto ref_from_raw = bytes == 2 ? ref.s16le_to_float : (bytes == 3 ? ref.s24le_to_float : ref.s32le_to_float);
+
+        vector<unsigned char> raw (n * bytes), ref_raw (n * bytes);
+        to_raw (in.data(), raw.data(), n);
+        ref_to_raw (in.data(), ref_raw.data(), n);
+        assert (raw == ref_raw);
+
+        vector<float> out (n), ref_out (n);
+        from_raw (raw.data(), out.data(), n);
+        ref_from_raw (raw.data(), ref_out.data(), n);
+        assert (out == ref_out);
+      }
+
+    vector<unsigned char> raw (n * 4), ref_raw (n * 4);
+    k.float_to_f32le (in.data(), raw.data(), n);
+    ref.float_to_f32le (in.data(), ref_raw.data(), n);
+    assert (raw == ref_raw);
+  }
+
+  /* log2: documented error bound for normal and subnormal values */
+  {
+    vector<float> in;
+    for (double x = 1e-44; x < 1e38; x *= 1.0123)
+      in.push_back (x);
+
+    vector<float> out (in.size());
+    k.log2_block (in.data(), out.data(), in.size());
+
+    double err = 0;
+    for (size_t i = 0; i < in.size(); i++)
+      {
+        const double l = log2 (double (in[i]));
+        err = std::max (err, fabs (out[i] - l) / std::max (1.0, fabs (l)));
+      }
+    check ("log2_block", err, 1e-6);
+  }
+
+  /* pow: documented error bound */
+  for (float exponent : { -0.02f, 0.0013f, 0.5f, 1.f, 2.f, -3.f })
+    {
+      vector<float> in;
+      for (double x = 1e-7; x < 1e5; x *= 1.0071)
+        in.push_back (x);
+
+      vector<float> out (in.size());
+      k.pow_block (in.data(), exponent, out.data(), in.size());
+
+      double err = 0;
+      for (size_t i = 0; i < in.size(); i++)
+        {
+          const double p = pow (double (in[i]), exponent);
+          const double l = fabs (exponent * log2 (double (in[i])));
+          if (l < 125)
+            err = std::max (err, fabs (out[i] - p) / p / (5e-7 + l * 7e-7));
+        }
+      char what[64];
+      sprintf (what, "pow_block (%g)", exponent);
+      check (what, err, 1);
+    }
+}
+
+static void
+bench_kernels (const DSPKernels& k)
+{
+  const size_t n = 1024;
+  const int runs = 10000;
+
+  auto in = random_vec (n * 2, -1, 1);
+  auto window = random_vec (n, 0, 1);
+  auto exps = random_vec (n, -0.02, 0.02);
+  vector<float> out (n * 2);
+
+  double t0 = get_time();
+  for (int r = 0; r < runs; r++)
+    k.window_deinterleave (in.data(), 2, window.data(), out.data(), n);
+  double t1 = get_time();
+  for (int r = 0; r < runs; r++)
+    k.add_db_from_complex (in.data(), out.data(), n, -96);
+  double t2 = get_time();
+  for (int r = 0; r < runs; r++)
+    k.frame_mod_delta (in.data(), exps.data(), out.data(), n, 1e-7);
+  double t3 = get_time();
+
+  printf ("%-8s window_deinterleave %7.1f ns  add_db_from_complex %7.1f ns  frame_mod_delta %7.1f ns\n", k.name,
+          (t1 - t0) * 1e9 / runs, (t2 - t1) * 1e9 / runs, (t3 - t2) * 1e9 / runs);
+}
+
+int
+main (int argc, char **argv)
+{
+  printf ("best kernels: %s\n", dsp_kernels().name);
+
+  for (auto k : dsp_kernels_supported())
+    test_kernels (*k);
+
+  /* timing for 1024 values */
+  for (auto k : dsp_kernels_supported())
+    bench_kernels (*k);
+}
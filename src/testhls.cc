@@ -17,8 +17,11 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <assert.h>
+#include <unistd.h>
 
 #include <regex>
+#include <algorithm>
 
 #include "utils.hh"
 #include "mpegts.hh"
@@ -27,6 +30,7 @@
 #include "hls.hh"
 #include "sfinputstream.hh"
 #include "hlsoutputstream.hh"
+#include "bench.hh"
 
 using std::string;
 using std::regex;
@@ -69,14 +73,15 @@ public:
     return wav_data->n_values() / wav_data->n_channels();
   }
   Error
-  read_frames (std::vector<float>& samples, size_t count) override
+  read_frames (float *samples, size_t count, size_t& n_frames_read) override
   {
     size_t read_count = min (n_frames() - read_pos, count);
 
     const auto& wsamples = wav_data->samples();
-    samples.assign (wsamples.begin() + read_pos * n_channels(), wsamples.begin() + (read_pos + read_count) * n_channels());
+    std::copy (wsamples.begin() + read_pos * n_channels(), wsamples.begin() + (read_pos + read_count) * n_channels(), samples);
 
     read_pos += read_count;
+    n_frames_read = read_count;
 
     return Error::Code::NONE;
   }
@@ -107,9 +112,9 @@ public:
     return wav_data->n_channels();
   }
   Error
-  write_frames (const std::vector<float>& frames) override
+  write_frames (const float *frames, size_t n_frames) override
   {
-    samples.insert (samples.end(), frames.begin(), frames.end());
+    samples.insert (samples.end(), frames, frames + n_frames * n_channels());
     return Error::Code::NONE;
   }
   Error
@@ -193,6 +198,63 @@ seek_perf (const Key& key, int sample_rate, double seconds)
   return 0;
 }
 
+/* size of the context and time of a full hls-add, for each context encoding and a few segment durations */
+int
+bench_context (const Key& key)
+{
+  const string message = "0123456789abcdef0011223344556677";
+  const string aac_ts  = "bench-context-aac.ts";
+  const string prep_ts = "bench-context-prep.ts";
+  const string out_ts  = "bench-context-out.ts";
+  const int    runs = 5;
+
+  WavData wav_data = gen_noise (key, 40, 44100, 16);
+
+  set_log_level (Log::WARNING); // hls-add info messages
+
+  int rc = 0;
+  for (double segment_seconds : { 2.0, 4.0, 6.0, 10.0 })
+    {
+      for (auto context : { HLSContext::FLAC, HLSContext::FLAC_FAST, HLSContext::RAW })
+        {
+          double seconds;
+          Error err = bench_gen_hls_segment (wav_data, segment_seconds, context, aac_ts, prep_ts, seconds);
+          TSReader reader;
+          if (!err)
+            err = reader.load (prep_ts);
+          if (err)
+            {
+              error ("testhls: %s\n", err.message());
+              rc = 1;
+              break;
+            }
+          size_t context_bytes = 0;
+          for (const auto& entry : reader.entries())
+            if (entry.filename != "vars")
+              context_bytes += entry.data.size();
+
+          double t0 = get_time();
+          for (int r = 0; r < runs && rc == 0; r++)
+            rc = hls_add (key, prep_ts, out_ts, message);
+          double t = (get_time() - t0) / runs;
+          if (rc != 0)
+            {
+              error ("testhls: hls-add failed\n");
+              break;
+            }
+
+          const char *name = context == HLSContext::FLAC ? "flac" : (context == HLSContext::FLAC_FAST ? "flac-fast" : "raw");
+          printf ("%5.2f s  %-10s context %9zd bytes  hls-add %8.3f ms  %6.1f x realtime\n", seconds, name, context_bytes,
+                  t * 1000, seconds / t);
+        }
+      if (rc != 0)
+        break;
+    }
+  for (auto filename : { aac_ts, prep_ts, out_ts })
+    unlink (filename.c_str());
+  return rc;
+}
+
 int
 main (int argc, char **argv)
 {
@@ -205,6 +267,10 @@ main (int argc, char **argv)
     {
       return seek_perf (global_key, atoi (argv[2]), atof (argv[3]));
     }
+  else if (argc == 2 && strcmp (argv[1], "bench-context") == 0)
+    {
+      return bench_context (global_key);
+    }
   else if (argc == 4 && strcmp (argv[1], "ff-decode") == 0)
     {
       WavData wd;
@@ -15,14 +15,220 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdio.h>
+#include <string.h>
+
 #include "mp3inputstream.hh"
+#include "parallelinputstream.hh"
 #include "wavdata.hh"
 
 using std::string;
+using std::vector;
+
+/* decode mp3 file serially and in parallel, the result must be identical */
+static int
+test_parallel (const string& filename)
+{
+  MP3InputStream m3i;
+  Error err = m3i.open (filename);
+  if (err)
+    {
+      printf ("mp3 open %s failed: %s\n", filename.c_str(), err.message());
+      return 1;
+    }
+  std::unique_ptr<MP3InputStream> pm3i (new MP3InputStream());
+  err = pm3i->open (filename);
+  if (err)
+    {
+      printf ("mp3 open %s failed: %s\n", filename.c_str(), err.message());
+      return 1;
+    }
+  ParallelInputStream pin;
+  err = pin.open (std::move (pm3i));
+  if (err)
+    {
+      printf ("mp3 parallel open %s failed: %s\n", filename.c_str(), err.message());
+      return 1;
+    }
+
+  WavData wd, pwd;
+  err = wd.load (&m3i);
+  if (!err)
+    err = pwd.load (&pin);
+  if (err)
+    {
+      printf ("mp3 load %s failed: %s\n", filename.c_str(), err.message());
+      return 1;
+    }
+  if (wd.samples() != pwd.samples())
+    {
+      printf ("mp3 parallel decoding %s: result differs from serial decoding\n", filename.c_str());
+      return 1;
+    }
+  printf ("mp3 parallel decoding %s: ok (%zd frames)\n", filename.c_str(), wd.n_frames());
+  return 0;
+}
+
+/* opening with Scan::HEADER must produce the same samples as Scan::FULL, and know the length if expected */
+static int
+test_fast_open (const string& filename, bool expect_length)
+{
+  MP3InputStream full_in;
+  MP3InputStream fast_in;
+
+  Error err = full_in.open (filename, MP3InputStream::Scan::FULL);
+  if (!err)
+    err = fast_in.open (filename, MP3InputStream::Scan::HEADER);
+  if (err)
+    {
+      printf ("mp3 open %s failed: %s\n", filename.c_str(), err.message());
+      return 1;
+    }
+  const bool have_length = fast_in.n_frames() != AudioInputStream::N_FRAMES_UNKNOWN;
+  if (have_length != expect_length)
+    {
+      printf ("mp3 fast open %s: length is %s, expected %s\n", filename.c_str(),
+              have_length ? "known" : "unknown", expect_length ? "known" : "unknown");
+      return 1;
+    }
+  if (have_length && fast_in.n_frames() != full_in.n_frames())
+    {
+      printf ("mp3 fast open %s: length %zd differs from full scan length %zd\n", filename.c_str(), fast_in.n_frames(), full_in.n_frames());
+      return 1;
+    }
+  WavData wd, fast_wd;
+  err = wd.load (&full_in);
+  if (!err)
+    err = fast_wd.load (&fast_in);
+  if (err)
+    {
+      printf ("mp3 load %s failed: %s\n", filename.c_str(), err.message());
+      return 1;
+    }
+  if (wd.samples() != fast_wd.samples())
+    {
+      printf ("mp3 fast open %s: result differs from full scan (%zd/%zd frames)\n", filename.c_str(), fast_wd.n_frames(), wd.n_frames());
+      return 1;
+    }
+  printf ("mp3 fast open %s: ok (%zd frames, length %s)\n", filename.c_str(), wd.n_frames(), have_length ? "known" : "unknown");
+  return 0;
+}
+
+/* size of a layer III frame in bytes (0: not a valid frame header) */
+static size_t
+frame_size (const unsigned char *header)
+{
+  static const int mpeg1_bitrates[15] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 };
+  static const int mpeg2_bitrates[15] = { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 };
+  static const int rates[4][3] = { { 11025, 12000, 8000 }, { 0, 0, 0 }, { 22050, 24000, 16000 }, { 44100, 48000, 32000 } };
+
+  const int version  = (header[1] >> 3) & 3;
+  const int layer    = (header[1] >> 1) & 3;
+  const int bitrate  = header[2] >> 4;
+  const int rate_idx = (header[2] >> 2) & 3;
+  const int padding  = (header[2] >> 1) & 1;
+
+  if (header[0] != 0xff || (header[1] & 0xe0) != 0xe0 || version == 1 || layer != 1 || bitrate == 0 || bitrate == 15 || rate_idx == 3)
+    return 0;
+
+  if (version == 3)
+    return 144000 * mpeg1_bitrates[bitrate] / rates[version][rate_idx] + padding;
+  else
+    return 72000 * mpeg2_bitrates[bitrate] / rates[version][rate_idx] + padding;
+}
+
+static void
+put_u16_be (unsigned char *data, uint16_t value)
+{
+  data[0] = value >> 8;
+  data[1] = value;
+}
+
+static void
+put_u32_be (unsigned char *data, uint32_t value)
+{
+  put_u16_be (data, value >> 16);
+  put_u16_be (data + 2, value);
+}
+
+/* insert a VBRI frame (as written by Fraunhofer encoders) before the first frame of an mp3 file without Xing/Info frame */
+static int
+add_vbri (const string& in_filename, const string& out_filename)
+{
+  vector<unsigned char> data;
+
+  FILE *in_file = fopen (in_filename.c_str(), "rb");
+  if (!in_file)
+    {
+      printf ("mp3 add vbri: can't open %s\n", in_filename.c_str());
+      return 1;
+    }
+  unsigned char buffer[4096];
+  size_t n_bytes;
+  while ((n_bytes = fread (buffer, 1, sizeof (buffer), in_file)) > 0)
+    data.insert (data.end(), buffer, buffer + n_bytes);
+  fclose (in_file);
+
+  /* skip ID3v2 tag */
+  size_t first = 0;
+  if (data.size() >= 10 && memcmp (data.data(), "ID3", 3) == 0)
+    first = 10 + ((data[6] & 0x7f) << 21) + ((data[7] & 0x7f) << 14) + ((data[8] & 0x7f) << 7) + (data[9] & 0x7f);
+
+  while (first + 4 <= data.size() && !frame_size (&data[first]))
+    first++;
+
+  size_t pos = first;
+  size_t n_frames = 0;
+  while (pos + 4 <= data.size() && frame_size (&data[pos]) && pos + frame_size (&data[pos]) <= data.size())
+    {
+      pos += frame_size (&data[pos]);
+      n_frames++;
+    }
+  if (!n_frames)
+    {
+      printf ("mp3 add vbri: no mp3 frames found in %s\n", in_filename.c_str());
+      return 1;
+    }
+
+  /* same format as the first frame, without crc and padding */
+  unsigned char header[4] = { data[first], (unsigned char) (data[first + 1] | 1), (unsigned char) (data[first + 2] & ~2), data[first + 3] };
+  vector<unsigned char> vbri_frame (frame_size (header));
+  std::copy (header, header + 4, vbri_frame.begin());
+
+  /* VBRI header is always stored 32 bytes after the frame header */
+  unsigned char *vbri = &vbri_frame[4 + 32];
+  memcpy (vbri, "VBRI", 4);
+  put_u16_be (vbri + 4, 1);                                 // version
+  put_u16_be (vbri + 6, 0);                                 // delay
+  put_u16_be (vbri + 8, 75);                                // quality
+  put_u32_be (vbri + 10, vbri_frame.size() + pos - first);  // number of bytes
+  put_u32_be (vbri + 14, n_frames);                         // number of frames
+  put_u16_be (vbri + 18, 0);                                // number of toc entries
+  put_u16_be (vbri + 20, 1);                                // toc scale factor
+  put_u16_be (vbri + 22, 2);                                // toc entry size
+  put_u16_be (vbri + 24, 0);                                // frames per toc entry
+
+  data.insert (data.begin() + first, vbri_frame.begin(), vbri_frame.end());
+
+  FILE *out_file = fopen (out_filename.c_str(), "wb");
+  if (!out_file || fwrite (data.data(), 1, data.size(), out_file) != data.size() || fclose (out_file) != 0)
+    {
+      printf ("mp3 add vbri: error writing %s\n", out_filename.c_str());
+      return 1;
+    }
+  return 0;
+}
 
 int
 main (int argc, char **argv)
 {
+  if (argc == 3 && string (argv[1]) == "parallel")
+    return test_parallel (argv[2]);
+  if (argc == 4 && string (argv[1]) == "fast-open")
+    return test_fast_open (argv[2], string (argv[3]) == "known");
+  if (argc == 4 && string (argv[1]) == "add-vbri")
+    return add_vbri (argv[2], argv[3]);
+
   WavData wd;
   if (argc >= 2)
     {
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string>
+#include <vector>
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "wmcommon.hh"
+#include "wmspeed.hh"
+#include "stats.hh"
+#include "utils.hh"
+
+using std::string;
+using std::vector;
+
+/* run detect_speed with a prior, return the number of SpeedSync::prepare_mags calls (to see if the grid search ran) */
+static uint64_t
+run_detect_speed (const Key& key, const WavData& wav_data, vector<DetectSpeedResult>& speed_prior)
+{
+  const uint64_t n_prepare = Stats::get_count (Stat::SPEED_PREPARE);
+
+  detect_speed ({ key }, wav_data, false, &speed_prior);
+
+  return Stats::get_count (Stat::SPEED_PREPARE) - n_prepare;
+}
+
+static bool
+check_speed (const char *label, const vector<DetectSpeedResult>& speed_prior, double speed, uint64_t n_prepare)
+{
+  if (speed_prior.size() != 1)
+    {
+      error ("testspeed: %s: no speed detected\n", label);
+      return false;
+    }
+  const double delta = 100 * fabs (speed_prior[0].speed - speed) / speed;
+  printf ("%-9s speed %f quality %f delta %.4f prepare %zd\n", label, speed_prior[0].speed, speed_prior[0].quality, delta, size_t (n_prepare));
+
+  if (delta > 0.03)
+    {
+      error ("testspeed: %s: detected speed %f, expected %f\n", label, speed_prior[0].speed, speed);
+      return false;
+    }
+  return true;
+}
+
+static int
+test_prior (const string& filename, double speed)
+{
+  WavData wav_data;
+  Error err = wav_data.load (filename);
+  if (err)
+    {
+      error ("testspeed: error loading %s: %s\n", filename.c_str(), err.message());
+      return 1;
+    }
+  Stats::enable (""); // count only
+
+  Key key;
+
+  /* no prior: full grid search */
+  vector<DetectSpeedResult> grid_prior;
+  uint64_t n_grid = run_detect_speed (key, wav_data, grid_prior);
+  if (!check_speed ("grid", grid_prior, speed, n_grid))
+    return 1;
+
+  /* good prior: only the narrow search around the prior speed runs */
+  vector<DetectSpeedResult> accept_prior = grid_prior;
+  uint64_t n_accept = run_detect_speed (key, wav_data, accept_prior);
+  if (!check_speed ("accepted", accept_prior, speed, n_accept))
+    return 1;
+  if (n_accept >= n_grid)
+    {
+      error ("testspeed: prior was not accepted (%zd prepare calls, grid search: %zd)\n", size_t (n_accept), size_t (n_grid));
+      return 1;
+    }
+
+  /* quality drops below prior_min_quality_factor * prior quality: narrow search, then full grid search */
+  vector<DetectSpeedResult> reject_prior = grid_prior;
+  reject_prior[0].quality *= 10;
+  uint64_t n_reject = run_detect_speed (key, wav_data, reject_prior);
+  if (!check_speed ("rejected", reject_prior, speed, n_reject))
+    return 1;
+  if (n_reject <= n_grid)
+    {
+      error ("testspeed: prior was not rejected (%zd prepare calls, grid search: %zd)\n", size_t (n_reject), size_t (n_grid));
+      return 1;
+    }
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  if (argc == 4 && strcmp (argv[1], "prior") == 0)
+    {
+      return test_prior (argv[2], atof (argv[3]));
+    }
+  error ("usage: testspeed prior <stretched_wav> <speed>\n");
+  return 1;
+}
@@ -22,15 +22,77 @@
 #include <math.h>
 
 #include "sfinputstream.hh"
+#include "parallelinputstream.hh"
 #include "stdoutwavoutputstream.hh"
 #include "utils.hh"
 
 using std::string;
 using std::vector;
 
+/* decode a seekable (flac) file serially and in parallel, the result must be identical */
+static int
+test_parallel (const string& filename)
+{
+  SFInputStream in;
+  Error err = in.open (filename);
+  if (err)
+    {
+      fprintf (stderr, "teststream: open input failed: %s\n", err.message());
+      return 1;
+    }
+  std::unique_ptr<SFInputStream> pin_stream (new SFInputStream());
+  err = pin_stream->open (filename);
+  if (!err && !pin_stream->can_reopen())
+    err = Error ("input stream not seekable (parallel decoding only supports flac files)");
+  if (err)
+    {
+      fprintf (stderr, "teststream: open parallel input failed: %s\n", err.message());
+      return 1;
+    }
+  ParallelInputStream pin;
+  err = pin.open (std::move (pin_stream));
+  if (err)
+    {
+      fprintf (stderr, "teststream: open parallel input failed: %s\n", err.message());
+      return 1;
+    }
+  vector<float> samples, psamples;
+  size_t n_frames = 0;
+  do
+    {
+      Error serial_err = in.read_frames (samples, 1024);
+      Error parallel_err = pin.read_frames (psamples, 1024);
+      if (serial_err && parallel_err)
+        {
+          /* damaged file: parallel decoding must fail like serial decoding */
+          printf ("teststream: serial and parallel decoding failed near frame %zd: %s\n", n_frames, serial_err.message());
+          return 0;
+        }
+      if (serial_err || parallel_err)
+        {
+          fprintf (stderr, "teststream: %s read failed: %s\n", serial_err ? "serial" : "parallel",
+                   serial_err ? serial_err.message() : parallel_err.message());
+          return 1;
+        }
+      if (samples != psamples)
+        {
+          fprintf (stderr, "teststream: parallel decoding mismatch near frame %zd\n", n_frames);
+          return 1;
+        }
+      n_frames += samples.size() / in.n_channels();
+    }
+  while (samples.size());
+
+  printf ("teststream: parallel decoding ok (%zd frames)\n", n_frames);
+  return 0;
+}
+
 int
 main (int argc, char **argv)
 {
+  if (argc == 3 && string (argv[1]) == "parallel")
+    return test_parallel (argv[2]);
+
   SFInputStream in;
   StdoutWavOutputStream out;
 
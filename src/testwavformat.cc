@@ -24,12 +24,130 @@
 #include <cstring>
 
 #include "sfinputstream.hh"
+#include "mmapwavinputstream.hh"
 #include "stdoutwavoutputstream.hh"
 #include "utils.hh"
 
 using std::string;
 using std::vector;
 
+/* the mmap wav reader must produce the same samples as libsndfile */
+static int
+compare_mmap (const string& filename)
+{
+  MmapWavInputStream mmap_in;
+  SFInputStream      sf_in;
+
+  Error err = mmap_in.open (filename);
+  if (err)
+    {
+      fprintf (stderr, "testwavformat: mmap open %s failed: %s\n", filename.c_str(), err.message());
+      return 1;
+    }
+  err = sf_in.open (filename);
+  if (err)
+    {
+      fprintf (stderr, "testwavformat: libsndfile open %s failed: %s\n", filename.c_str(), err.message());
+      return 1;
+    }
+  if (mmap_in.n_channels() != sf_in.n_channels() || mmap_in.sample_rate() != sf_in.sample_rate() ||
+      mmap_in.bit_depth() != sf_in.bit_depth() || mmap_in.n_frames() != sf_in.n_frames())
+    {
+      fprintf (stderr, "testwavformat: %s: mmap format differs from libsndfile (frames %zd/%zd)\n", filename.c_str(),
+               mmap_in.n_frames(), sf_in.n_frames());
+      return 1;
+    }
+  size_t n_frames = 0;
+  vector<float> mmap_samples, sf_samples;
+  do
+    {
+      err = mmap_in.read_frames (mmap_samples, 1024);
+      if (!err)
+        err = sf_in.read_frames (sf_samples, 1024);
+      if (err)
+        {
+          fprintf (stderr, "testwavformat: %s: read failed: %s\n", filename.c_str(), err.message());
+          return 1;
+        }
+      if (mmap_samples.size() != sf_samples.size())
+        {
+          fprintf (stderr, "testwavformat: %s: mmap length differs from libsndfile\n", filename.c_str());
+          return 1;
+        }
+      /* int -> float conversion may be rounded differently */
+      for (size_t i = 0; i < sf_samples.size(); i++)
+        {
+          if (fabs (mmap_samples[i] - sf_samples[i]) > 1e-7)
+            {
+              fprintf (stderr, "testwavformat: %s: mmap sample %zd differs from libsndfile\n", filename.c_str(), n_frames + i / sf_in.n_channels());
+              return 1;
+            }
+        }
+      n_frames += sf_samples.size() / sf_in.n_channels();
+    }
+  while (sf_samples.size());
+
+  printf ("%s: mmap and libsndfile: %zd frames\n", filename.c_str(), n_frames);
+  return 0;
+}
+
+static void
+put_u16 (vector<unsigned char>& data, uint16_t value)
+{
+  data.push_back (value);
+  data.push_back (value >> 8);
+}
+
+static void
+put_u32 (vector<unsigned char>& data, uint32_t value)
+{
+  put_u16 (data, value);
+  put_u16 (data, value >> 16);
+}
+
+static void
+put_4cc (vector<unsigned char>& data, const char *fourcc)
+{
+  data.insert (data.end(), fourcc, fourcc + 4);
+}
+
+/* finalized wav file with an empty data chunk, followed by a LIST chunk (which is not audio data) */
+static int
+gen_empty_data (const string& filename)
+{
+  vector<unsigned char> list_data (64, 'x');
+  put_4cc (list_data, "INFO"); // content doesn't matter
+
+  vector<unsigned char> data;
+  put_4cc (data, "WAVE");
+  put_4cc (data, "fmt ");
+  put_u32 (data, 16);
+  put_u16 (data, 1);           // pcm
+  put_u16 (data, 2);           // channels
+  put_u32 (data, 44100);       // sample rate
+  put_u32 (data, 44100 * 4);   // bytes per second
+  put_u16 (data, 4);           // block align
+  put_u16 (data, 16);          // bit depth
+  put_4cc (data, "data");
+  put_u32 (data, 0);
+  put_4cc (data, "LIST");
+  put_u32 (data, list_data.size());
+  data.insert (data.end(), list_data.begin(), list_data.end());
+
+  vector<unsigned char> riff;
+  put_4cc (riff, "RIFF");
+  put_u32 (riff, data.size());
+  riff.insert (riff.end(), data.begin(), data.end());
+
+  FILE *file = fopen (filename.c_str(), "wb");
+  if (!file || fwrite (riff.data(), 1, riff.size(), file) != riff.size() || fclose (file) != 0)
+    {
+      fprintf (stderr, "testwavformat: error writing %s\n", filename.c_str());
+      return 1;
+    }
+  return 0;
+}
+
 int
 main (int argc, char **argv)
 {
@@ -65,13 +183,22 @@ main (int argc, char **argv)
       fprintf (stderr, "unsupported format %d\n", sfinfo.format);
       return 1;
     }
-  else if (argc == 5 && !strcmp (argv[1], "convert"))
+  else if (argc == 3 && !strcmp (argv[1], "compare-mmap"))
+    {
+      return compare_mmap (argv[2]);
+    }
+  else if (argc == 3 && !strcmp (argv[1], "gen-empty-data"))
+    {
+      return gen_empty_data (argv[2]);
+    }
+  else if ((argc == 5 || argc == 6) && !strcmp (argv[1], "convert"))
     {
       SFInputStream in;
 
       std::string in_filename = argv[2];
       std::string out_filename = argv[3];
       std::string out_format = argv[4];
+      std::string out_container = argc == 6 ? argv[5] : "wav";
 
       Error err = in.open (in_filename.c_str());
       if (err)
@@ -91,7 +218,17 @@ main (int argc, char **argv)
           fprintf (stderr, "testwavformat: unsupported output format %s\n", out_format.c_str());
           return 1;
         }
-      sfinfo.format |= SF_FORMAT_WAV;
+      if (out_container == "wav")
+        sfinfo.format |= SF_FORMAT_WAV;
+      else if (out_container == "rf64")
+        sfinfo.format |= SF_FORMAT_RF64;
+      else if (out_container == "wavex")
+        sfinfo.format |= SF_FORMAT_WAVEX;
+      else
+        {
+          fprintf (stderr, "testwavformat: unsupported output container %s\n", out_container.c_str());
+          return 1;
+        }
 
       auto sndfile = sf_open (out_filename.c_str(), SFM_WRITE, &sfinfo);
       int error = sf_error (sndfile);
@@ -113,8 +250,10 @@ main (int argc, char **argv)
     }
   else
     {
-      fprintf (stderr, "usage: testwavformat convert <in_filename> <out_filename> <format>\n");
+      fprintf (stderr, "usage: testwavformat convert <in_filename> <out_filename> <format> [ wav | rf64 | wavex ]\n");
       fprintf (stderr, "or     testwavformat detect <in_filename>\n");
+      fprintf (stderr, "or     testwavformat compare-mmap <in_filename>\n");
+      fprintf (stderr, "or     testwavformat gen-empty-data <out_filename>\n");
       fprintf (stderr, "or     testwavformat list\n");
       return 1;
     }
@@ -55,9 +55,18 @@ ThreadPool::worker_run()
     }
 }
 
+static size_t default_n_threads = 0;
+
+void
+ThreadPool::set_default_n_threads (size_t n_threads)
+{
+  default_n_threads = n_threads;
+}
+
 ThreadPool::ThreadPool()
 {
-  for (unsigned int i = 0; i < std::thread::hardware_concurrency(); i++)
+  const size_t n_threads = default_n_threads ? default_n_threads : std::thread::hardware_concurrency();
+  for (size_t i = 0; i < n_threads; i++)
     {
       threads.push_back (std::thread (&ThreadPool::worker_run, this));
     }
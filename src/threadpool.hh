@@ -53,6 +53,9 @@ public:
   void wait_all();
 
   size_t n_threads();
+
+  /* number of threads of thread pools created afterwards (0: one thread per cpu core) */
+  static void set_default_n_threads (size_t n_threads);
 };
 
 #endif /* AUDIOWMARK_THREAD_POOL_HH */
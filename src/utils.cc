@@ -200,6 +200,12 @@ set_log_level (Log level)
   log_level = level;
 }
 
+Log
+get_log_level()
+{
+  return log_level;
+}
+
 static void
 logv (Log log, const char *format, va_list vargs)
 {
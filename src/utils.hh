@@ -81,6 +81,7 @@ void debug (const char *format, ...) AUDIOWMARK_PRINTF (1, 2);
 enum class Log { ERROR = 3, WARNING = 2, INFO = 1, DEBUG = 0 };
 
 void set_log_level (Log level);
+Log get_log_level();
 
 std::string string_printf (const char *fmt, ...) AUDIOWMARK_PRINTF (1, 2);
 
@@ -0,0 +1,557 @@
+/*
+ * Copyright (C) 2025 Stefan Westerfeld
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string>
+#include <vector>
+
+#include <assert.h>
+#include <inttypes.h>
+
+#include "utils.hh"
+#include "wmcommon.hh"
+#include "video.hh"
+
+#include "config.h"
+
+using std::string;
+using std::vector;
+using std::min;
+
+#if !HAVE_FFMPEG
+int
+video_add (const Key& key, const string& infile, const string& outfile, const string& bits)
+{
+  error ("audiowmark: video support is not available in this build of audiowmark\n");
+  return 1;
+}
+
+int
+video_get (const vector<Key>& key_list, const string& infile, const string& orig_pattern)
+{
+  error ("audiowmark: video support is not available in this build of audiowmark\n");
+  return 1;
+}
+#else
+
+#include "ffinputstream.hh"
+#include "audiobuffer.hh"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+#include <libswresample/swresample.h>
+}
+
+#undef av_err2str
+#define av_err2str(errnum) av_make_error_string((char*)__builtin_alloca(AV_ERROR_MAX_STRING_SIZE), AV_ERROR_MAX_STRING_SIZE, errnum)
+
+/*
+ * VideoRemux reads the input file and writes the output file in a single pass:
+ *  - video packets are copied to the output without re-encoding
+ *  - the audio stream is decoded by FFInputStream, watermarked and encoded
+ *    again by VideoAudioOutputStream (same codec and bit rate as the input)
+ *
+ * Packets are written using av_interleaved_write_frame(), so the muxer takes
+ * care of the interleaving, although the audio output lags behind the video
+ * packets (the watermarker needs some look-ahead).
+ */
+class VideoRemux
+{
+public:
+  AVFormatContext *in_fmt_ctx = nullptr;
+  AVFormatContext *out_fmt_ctx = nullptr;
+  int              in_audio_index = -1;
+  int              in_video_index = -1;
+  AVStream        *out_video_st = nullptr;
+  AVStream        *out_audio_st = nullptr;
+
+  ~VideoRemux();
+
+  Error open_input (const string& filename);
+  Error open_output (const string& filename);
+  Error write_header();
+  Error copy_video_packet (AVPacket *pkt);
+  Error write_audio_packet (AVPacket *pkt, AVRational time_base);
+  Error write_trailer();
+};
+
+VideoRemux::~VideoRemux()
+{
+  if (out_fmt_ctx)
+    {
+      if (!(out_fmt_ctx->oformat->flags & AVFMT_NOFILE))
+        avio_closep (&out_fmt_ctx->pb);
+      avformat_free_context (out_fmt_ctx);
+    }
+  avformat_close_input (&in_fmt_ctx);
+}
+
+Error
+VideoRemux::open_input (const string& filename)
+{
+  av_log_set_level (AV_LOG_ERROR);
+
+  int ret = avformat_open_input (&in_fmt_ctx, filename.c_str(), nullptr, nullptr);
+  if (ret < 0)
+    return Error (string_printf ("could not open '%s': %s", filename.c_str(), av_err2str (ret)));
+
+  ret = avformat_find_stream_info (in_fmt_ctx, nullptr);
+  if (ret < 0)
+    return Error (string_printf ("could not find stream info: %s", av_err2str (ret)));
+
+  int n_audio = 0, n_video = 0;
+  for (unsigned int i = 0; i < in_fmt_ctx->nb_streams; i++)
+    {
+      if (in_fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+        {
+          in_audio_index = i;
+          n_audio++;
+        }
+      if (in_fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        {
+          in_video_index = i;
+          n_video++;
+        }
+    }
+  if (n_audio != 1 || n_video != 1)
+    return Error (string_printf ("input file must have one audio stream and one video stream (detected audio=%d:video=%d)", n_audio, n_video));
+
+  return Error::Code::NONE;
+}
+
+static string
+extension (const string& filename)
+{
+  const size_t dot = filename.rfind ('.');
+  const size_t slash = filename.rfind ('/');
+  if (dot == string::npos || (slash != string::npos && dot < slash))
+    return "";
+  return filename.substr (dot + 1);
+}
+
+Error
+VideoRemux::open_output (const string& filename)
+{
+  /* the output container format is deduced from the extension, so we need the same extension as the input */
+  const string ext_in = extension (in_fmt_ctx->url);
+  const string ext_out = extension (filename);
+  if (ext_in != ext_out)
+    return Error (string_printf ("input/output extension must match ('%s' vs. '%s')", ext_in.c_str(), ext_out.c_str()));
+
+  avformat_alloc_output_context2 (&out_fmt_ctx, nullptr, nullptr, filename.c_str());
+  if (!out_fmt_ctx)
+    return Error ("could not deduce output format from file extension");
+
+  /* video stream: copy codec parameters, packets will be copied unchanged */
+  AVStream *in_video_st = in_fmt_ctx->streams[in_video_index];
+
+  out_video_st = avformat_new_stream (out_fmt_ctx, nullptr);
+  if (!out_video_st)
+    return Error ("could not allocate stream");
+
+  int ret = avcodec_parameters_copy (out_video_st->codecpar, in_video_st->codecpar);
+  if (ret < 0)
+    return Error ("could not copy the stream parameters");
+  out_video_st->codecpar->codec_tag = 0;
+  out_video_st->time_base = in_video_st->time_base;
+
+  if (!(out_fmt_ctx->oformat->flags & AVFMT_NOFILE))
+    {
+      ret = avio_open (&out_fmt_ctx->pb, filename.c_str(), AVIO_FLAG_WRITE);
+      if (ret < 0)
+        return Error (string_printf ("could not open '%s': %s", filename.c_str(), av_err2str (ret)));
+    }
+  return Error::Code::NONE;
+}
+
+Error
+VideoRemux::write_header()
+{
+  int ret = avformat_write_header (out_fmt_ctx, nullptr);
+  if (ret < 0)
+    return Error (string_printf ("error writing output file header: %s", av_err2str (ret)));
+
+  return Error::Code::NONE;
+}
+
+/* called by FFInputStream for all packets that are not part of the audio stream */
+Error
+VideoRemux::copy_video_packet (AVPacket *pkt)
+{
+  if (pkt->stream_index != in_video_index)
+    return Error::Code::NONE; // skip other streams (subtitles, data, ...)
+
+  av_packet_rescale_ts (pkt, in_fmt_ctx->streams[in_video_index]->time_base, out_video_st->time_base);
+  pkt->stream_index = out_video_st->index;
+  pkt->pos = -1;
+
+  int ret = av_interleaved_write_frame (out_fmt_ctx, pkt);
+  if (ret < 0)
+    return Error (string_printf ("error while writing video packet: %s", av_err2str (ret)));
+
+  return Error::Code::NONE;
+}
+
+Error
+VideoRemux::write_audio_packet (AVPacket *pkt, AVRational time_base)
+{
+  av_packet_rescale_ts (pkt, time_base, out_audio_st->time_base);
+  pkt->stream_index = out_audio_st->index;
+
+  int ret = av_interleaved_write_frame (out_fmt_ctx, pkt);
+  if (ret < 0)
+    return Error (string_printf ("error while writing audio packet: %s", av_err2str (ret)));
+
+  return Error::Code::NONE;
+}
+
+Error
+VideoRemux::write_trailer()
+{
+  int ret = av_write_trailer (out_fmt_ctx);
+  if (ret < 0)
+    return Error (string_printf ("error writing output file trailer: %s", av_err2str (ret)));
+
+  return Error::Code::NONE;
+}
+
+/*
+ * VideoAudioOutputStream encodes the watermarked audio with the codec of the
+ * input audio stream (this is based on HLSOutputStream)
+ */
+class VideoAudioOutputStream : public AudioOutputStream
+{
+  VideoRemux       *m_remux = nullptr;
+  AVCodecContext   *m_enc = nullptr;
+  AVFrame          *m_frame = nullptr;
+  AVPacket         *m_pkt = nullptr;
+  SwrContext       *m_swr_ctx = nullptr;
+
+  int               m_bit_depth = 0;
+  int               m_sample_rate = 0;
+  int               m_n_channels = 0;
+  int               m_frame_size = 0;
+  int64_t           m_next_pts = 0;
+  AudioBuffer       m_audio_buffer;
+  std::vector<float> m_frame_samples;
+
+  enum class State {
+    NEW,
+    OPEN,
+    CLOSED
+  };
+  State             m_state = State::NEW;
+
+  Error encode_frame (int n_frames);
+  Error receive_packets();
+public:
+  using AudioOutputStream::write_frames;
+
+  VideoAudioOutputStream (int n_channels, int sample_rate, int bit_depth);
+  ~VideoAudioOutputStream();
+
+  Error open (VideoRemux *remux);
+  Error write_frames (const float *frames, size_t n_frames) override;
+  Error close() override;
+
+  int bit_depth() const override   { return m_bit_depth; }
+  int sample_rate() const override { return m_sample_rate; }
+  int n_channels() const override  { return m_n_channels; }
+
+  string codec_info() const;
+};
+
+VideoAudioOutputStream::VideoAudioOutputStream (int n_channels, int sample_rate, int bit_depth) :
+  m_bit_depth (bit_depth),
+  m_sample_rate (sample_rate),
+  m_n_channels (n_channels),
+  m_audio_buffer (n_channels)
+{
+}
+
+VideoAudioOutputStream::~VideoAudioOutputStream()
+{
+  avcodec_free_context (&m_enc);
+  av_frame_free (&m_frame);
+  av_packet_free (&m_pkt);
+  swr_free (&m_swr_ctx);
+}
+
+Error
+VideoAudioOutputStream::open (VideoRemux *remux)
+{
+  assert (m_state == State::NEW);
+
+  m_remux = remux;
+
+  const AVCodecParameters *in_par = remux->in_fmt_ctx->streams[remux->in_audio_index]->codecpar;
+
+  /* opus encoder is experimental, ffmpeg recommends libopus for encoding */
+  const AVCodec *codec = nullptr;
+  if (in_par->codec_id == AV_CODEC_ID_OPUS)
+    codec = avcodec_find_encoder_by_name ("libopus");
+  if (!codec)
+    codec = avcodec_find_encoder (in_par->codec_id);
+  if (!codec)
+    return Error (string_printf ("could not find encoder for '%s'", avcodec_get_name (in_par->codec_id)));
+
+  m_enc = avcodec_alloc_context3 (codec);
+  if (!m_enc)
+    return Error ("could not alloc an encoding context");
+
+  m_enc->sample_fmt  = codec->sample_fmts ? codec->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+  m_enc->bit_rate    = in_par->bit_rate; // 0: use codec default
+  m_enc->sample_rate = m_sample_rate;
+  m_enc->time_base   = AVRational { 1, m_sample_rate };
+  av_channel_layout_copy (&m_enc->ch_layout, &in_par->ch_layout);
+  if (m_enc->ch_layout.nb_channels != m_n_channels)
+    return Error ("audio channel layout does not match number of channels");
+
+  m_remux->out_audio_st = avformat_new_stream (m_remux->out_fmt_ctx, nullptr);
+  if (!m_remux->out_audio_st)
+    return Error ("could not allocate stream");
+  m_remux->out_audio_st->time_base = m_enc->time_base;
+
+  /* Some formats want stream headers to be separate. */
+  if (m_remux->out_fmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+    m_enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+  int ret = avcodec_open2 (m_enc, codec, nullptr);
+  if (ret < 0)
+    return Error (string_printf ("could not open audio codec: %s", av_err2str (ret)));
+
+  ret = avcodec_parameters_from_context (m_remux->out_audio_st->codecpar, m_enc);
+  if (ret < 0)
+    return Error ("could not copy the stream parameters");
+
+  if (m_enc->codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE || m_enc->frame_size <= 0)
+    m_frame_size = 10000;
+  else
+    m_frame_size = m_enc->frame_size;
+
+  m_frame = av_frame_alloc();
+  m_pkt   = av_packet_alloc();
+  if (!m_frame || !m_pkt)
+    return Error ("could not allocate frame/packet");
+
+  m_frame->format = m_enc->sample_fmt;
+  av_channel_layout_copy (&m_frame->ch_layout, &m_enc->ch_layout);
+  m_frame->sample_rate = m_enc->sample_rate;
+  m_frame->nb_samples = m_frame_size;
+  ret = av_frame_get_buffer (m_frame, 0);
+  if (ret < 0)
+    return Error ("error allocating an audio buffer");
+
+  /* sample format conversion: interleaved float -> codec format */
+  m_swr_ctx = swr_alloc();
+  if (!m_swr_ctx)
+    return Error ("could not allocate resampler context");
+
+  av_opt_set_chlayout   (m_swr_ctx, "in_chlayout",        &m_enc->ch_layout,     0);
+  av_opt_set_int        (m_swr_ctx, "in_sample_rate",     m_enc->sample_rate,    0);
+  av_opt_set_sample_fmt (m_swr_ctx, "in_sample_fmt",      AV_SAMPLE_FMT_FLT,     0);
+  av_opt_set_chlayout   (m_swr_ctx, "out_chlayout",       &m_enc->ch_layout,     0);
+  av_opt_set_int        (m_swr_ctx, "out_sample_rate",    m_enc->sample_rate,    0);
+  av_opt_set_sample_fmt (m_swr_ctx, "out_sample_fmt",     m_enc->sample_fmt,     0);
+
+  if ((ret = swr_init (m_swr_ctx)) < 0)
+    return Error ("failed to initialize the resampling context");
+
+  /* keep audio/video in sync: audio starts at the same time as the input audio */
+  const AVStream *in_audio_st = remux->in_fmt_ctx->streams[remux->in_audio_index];
+  if (in_audio_st->start_time != AV_NOPTS_VALUE)
+    m_next_pts = av_rescale_q (in_audio_st->start_time, in_audio_st->time_base, m_enc->time_base);
+
+  m_state = State::OPEN;
+  return Error::Code::NONE;
+}
+
+string
+VideoAudioOutputStream::codec_info() const
+{
+  string info = m_enc->codec->name;
+  if (m_enc->bit_rate > 0)
+    info += string_printf (", %" PRId64 " bit/s", int64_t (m_enc->bit_rate));
+  return info;
+}
+
+/* send all packets the encoder has produced to the muxer */
+Error
+VideoAudioOutputStream::receive_packets()
+{
+  for (;;)
+    {
+      int ret = avcodec_receive_packet (m_enc, m_pkt);
+      if (ret == AVERROR (EAGAIN) || ret == AVERROR_EOF)
+        return Error::Code::NONE;
+      if (ret < 0)
+        return Error (string_printf ("error while encoding audio frame: %s", av_err2str (ret)));
+
+      Error err = m_remux->write_audio_packet (m_pkt, m_enc->time_base);
+      if (err)
+        return err;
+    }
+}
+
+/* encode n_frames from the audio buffer (n_frames = 0: flush encoder) */
+Error
+VideoAudioOutputStream::encode_frame (int n_frames)
+{
+  AVFrame *frame = nullptr;
+  if (n_frames)
+    {
+      m_frame_samples.resize (n_frames * m_n_channels);
+      m_audio_buffer.read_frames (m_frame_samples.data(), n_frames);
+
+      /* the encoder may keep a reference to the frame, so we need to make it writable */
+      int ret = av_frame_make_writable (m_frame);
+      if (ret < 0)
+        return Error ("error making frame writable");
+
+      const uint8_t *in_data[1] = { reinterpret_cast<const uint8_t *> (m_frame_samples.data()) };
+      m_frame->nb_samples = n_frames;
+      ret = swr_convert (m_swr_ctx, m_frame->data, n_frames, in_data, n_frames);
+      if (ret < 0)
+        return Error ("error while converting");
+
+      m_frame->pts = m_next_pts;
+      m_next_pts += n_frames;
+      frame = m_frame;
+    }
+
+  int ret = avcodec_send_frame (m_enc, frame);
+  if (ret < 0 && ret != AVERROR_EOF)
+    return Error (string_printf ("error encoding audio frame: %s", av_err2str (ret)));
+
+  return receive_packets();
+}
+
+Error
+VideoAudioOutputStream::write_frames (const float *frames, size_t n_frames)
+{
+  assert (m_state == State::OPEN);
+
+  m_audio_buffer.write_frames (frames, n_frames);
+  while (m_audio_buffer.can_read_frames() >= size_t (m_frame_size))
+    {
+      Error err = encode_frame (m_frame_size);
+      if (err)
+        return err;
+    }
+  return Error::Code::NONE;
+}
+
+Error
+VideoAudioOutputStream::close()
+{
+  if (m_state != State::OPEN)
+    return Error::Code::NONE;
+
+  // never close twice
+  m_state = State::CLOSED;
+
+  /* last frame: pad with zeros if the codec does not support a short last frame */
+  int n_frames = m_audio_buffer.can_read_frames();
+  if (n_frames)
+    {
+      if (!(m_enc->codec->capabilities & (AV_CODEC_CAP_SMALL_LAST_FRAME | AV_CODEC_CAP_VARIABLE_FRAME_SIZE)))
+        {
+          m_audio_buffer.write_frames (vector<float> ((m_frame_size - n_frames) * m_n_channels));
+          n_frames = m_frame_size;
+        }
+      Error err = encode_frame (n_frames);
+      if (err)
+        return err;
+    }
+  return encode_frame (0);
+}
+
+int
+video_add (const Key& key, const string& infile, const string& outfile, const string& bits)
+{
+  VideoRemux remux;
+
+  Error err = remux.open_input (infile);
+  if (!err)
+    err = remux.open_output (outfile);
+  if (err)
+    {
+      error ("audiowmark: video: %s\n", err.message());
+      return 1;
+    }
+
+  FFInputStream in_stream;
+  err = in_stream.open (remux.in_fmt_ctx, remux.in_audio_index, [&remux] (AVPacket *pkt) { return remux.copy_video_packet (pkt); });
+  if (err)
+    {
+      error ("audiowmark: video: %s\n", err.message());
+      return 1;
+    }
+
+  VideoAudioOutputStream out_stream (in_stream.n_channels(), in_stream.sample_rate(), in_stream.bit_depth());
+  err = out_stream.open (&remux);
+  if (!err)
+    err = remux.write_header();
+  if (err)
+    {
+      error ("audiowmark: video: %s\n", err.message());
+      return 1;
+    }
+
+  info ("Audio Codec:  %s\n", out_stream.codec_info().c_str());
+  info ("Input:        %s\n", Params::input_label.size() ? Params::input_label.c_str() : infile.c_str());
+  info ("Output:       %s\n", Params::output_label.size() ? Params::output_label.c_str() : outfile.c_str());
+
+  int rc = add_stream_watermark (key, &in_stream, &out_stream, bits, 0);
+  if (rc != 0)
+    return rc;
+
+  err = remux.write_trailer();
+  if (err)
+    {
+      error ("audiowmark: video: %s\n", err.message());
+      return 1;
+    }
+  return 0;
+}
+
+int
+video_get (const vector<Key>& key_list, const string& infile, const string& orig_pattern)
+{
+  /* remux owns the format context, so it must outlive in_stream */
+  VideoRemux remux;
+
+  Error err = remux.open_input (infile);
+  if (err)
+    {
+      error ("audiowmark: video: %s\n", err.message());
+      return 1;
+    }
+
+  /* decode the audio stream of the already opened input, video packets are ignored */
+  auto in_stream = std::make_unique<FFInputStream>();
+  err = in_stream->open (remux.in_fmt_ctx, remux.in_audio_index, nullptr);
+  if (err)
+    {
+      error ("audiowmark: video: %s\n", err.message());
+      return 1;
+    }
+  return get_watermark (key_list, std::move (in_stream), infile, orig_pattern);
+}
+
+#endif
@@ -16,7 +16,9 @@
  */
 
 #include "wavchunkloader.hh"
+#include "parallelinputstream.hh"
 #include "wmcommon.hh"
+#include "stats.hh"
 
 #include <math.h>
 #include <assert.h>
@@ -51,21 +53,43 @@ WavChunkLoader::WavChunkLoader (const std::string& filename) :
 {
 }
 
+/* use an already opened input stream (i.e. HLSInputStream) */
+WavChunkLoader::WavChunkLoader (std::unique_ptr<AudioInputStream> in_stream) :
+  m_in_stream (std::move (in_stream))
+{
+}
+
 Error
 WavChunkLoader::open()
 {
   assert (m_state == State::NEW);
 
   Error err;
-  m_in_stream = AudioInputStream::create (m_filename, err);
-  if (err)
+  if (!m_in_stream)
     {
-      m_state = State::ERROR;
-      return err;
+      m_in_stream = AudioInputStream::create (m_filename, err);
+      if (err)
+        {
+          m_state = State::ERROR;
+          return err;
+        }
+    }
+  /* decoding compressed input (flac, mp3) would be the bottleneck, so decode on all cpu cores */
+  if (ParallelInputStream::supported (m_in_stream.get()))
+    {
+      ParallelInputStream *pistream = new ParallelInputStream();
+      err = pistream->open (std::move (m_in_stream));
+      m_in_stream.reset (pistream);
+      if (err)
+        {
+          m_state = State::ERROR;
+          return err;
+        }
     }
   m_state = State::OPEN;
 
   m_wav_data = WavData ({}, m_in_stream->n_channels(), Params::mark_sample_rate, m_in_stream->bit_depth());
+  m_wav_data.set_format (Params::get_sample_format);
 
   /* initialize resampler if input sample rate != watermark rate */
   if (m_in_stream->sample_rate() != m_wav_data.sample_rate())
@@ -93,7 +117,11 @@ WavChunkLoader::open()
       n_reserve_frames *= 1.001;
       n_reserve_frames += 100;
 
-      m_wav_data.mutable_samples().reserve (std::min (m_wav_data_max_size, n_reserve_frames * m_wav_data.n_channels()));
+      const size_t n_reserve = std::min (m_wav_data_max_size, n_reserve_frames * m_wav_data.n_channels());
+      if (m_wav_data.format() == WavData::Format::FLOAT)
+        m_wav_data.mutable_samples().reserve (n_reserve);
+      else
+        m_wav_data.mutable_samples_i16().reserve (n_reserve);
     }
   return Error::Code::NONE;
 }
@@ -101,6 +129,8 @@ WavChunkLoader::open()
 Error
 WavChunkLoader::load_next_chunk()
 {
+  ScopedStat stat (Stat::CHUNK_LOAD);
+
   assert (m_state != State::ERROR);
 
   if (m_state == State::LAST_CHUNK)
@@ -118,7 +148,15 @@ WavChunkLoader::load_next_chunk()
         return err;
     }
 
-  vector<float>& ref_samples = m_wav_data.mutable_samples();
+  if (m_wav_data.format() == WavData::Format::FLOAT)
+    return load_samples (m_wav_data.mutable_samples());
+  else
+    return load_samples (m_wav_data.mutable_samples_i16());
+}
+
+template<class T> Error
+WavChunkLoader::load_samples (vector<T>& ref_samples)
+{
   if (!ref_samples.empty()) /* second block or later */
     {
       /* overlap samples with last block */
@@ -162,8 +200,8 @@ WavChunkLoader::load_next_chunk()
   return Error::Code::NONE;
 }
 
-void
-WavChunkLoader::update_capacity (vector<float>& samples, size_t need_space, size_t max_size)
+template<class T> void
+WavChunkLoader::update_capacity (vector<T>& samples, size_t need_space, size_t max_size)
 {
   assert (need_space <= max_size);
 
@@ -188,8 +226,49 @@ WavChunkLoader::update_capacity (vector<float>& samples, size_t need_space, size
   assert (samples.capacity() >= need_space);
 }
 
-Error
-WavChunkLoader::refill (std::vector<float>& samples, size_t max_size, bool *eof)
+static void
+append_samples (vector<float>& samples, const vector<float>& buffer)
+{
+  samples.insert (samples.end(), buffer.begin(), buffer.end());
+}
+
+static void
+append_samples (vector<int16_t>& samples, const vector<float>& buffer)
+{
+  const size_t old_size = samples.size();
+
+  samples.resize (old_size + buffer.size());
+  WavData::float_to_int16 (buffer.data(), &samples[old_size], buffer.size());
+}
+
+/* float samples can be read directly into the sample storage, without using buffer */
+static Error
+read_append_samples (AudioInputStream *in_stream, size_t count, vector<float>& samples, vector<float>& buffer)
+{
+  const size_t old_size = samples.size();
+  samples.resize (old_size + count * in_stream->n_channels());
+
+  ScopedStat stat (Stat::READ);
+  size_t n_frames_read = 0;
+  Error err = in_stream->read_frames (&samples[old_size], count, n_frames_read);
+  samples.resize (old_size + n_frames_read * in_stream->n_channels());
+  return err;
+}
+
+static Error
+read_append_samples (AudioInputStream *in_stream, size_t count, vector<int16_t>& samples, vector<float>& buffer)
+{
+  Error err;
+  {
+    ScopedStat stat (Stat::READ);
+    err = in_stream->read_frames (buffer, count);
+  }
+  append_samples (samples, buffer);
+  return err;
+}
+
+template<class T> Error
+WavChunkLoader::refill (vector<T>& samples, size_t max_size, bool *eof)
 {
   *eof = false;
 
@@ -202,7 +281,11 @@ WavChunkLoader::refill (std::vector<float>& samples, size_t max_size, bool *eof)
         {
           if (m_resampler->can_read_frames() < block_size && !m_resampler_in_eof)
             {
-              Error err = m_in_stream->read_frames (buffer, block_size * double (m_in_stream->sample_rate()) / m_wav_data.sample_rate());
+              Error err;
+              {
+                ScopedStat stat (Stat::READ);
+                err = m_in_stream->read_frames (buffer, block_size * double (m_in_stream->sample_rate()) / m_wav_data.sample_rate());
+              }
               if (err)
                 return err;
 
@@ -219,9 +302,22 @@ WavChunkLoader::refill (std::vector<float>& samples, size_t max_size, bool *eof)
         }
       else
         {
-          Error err = m_in_stream->read_frames (buffer, std::min<size_t> (block_size, (max_size - samples.size()) / m_wav_data.n_channels()));
+          const size_t count = std::min<size_t> (block_size, (max_size - samples.size()) / m_wav_data.n_channels());
+          const size_t old_size = samples.size();
+
+          update_capacity (samples, old_size + count * m_wav_data.n_channels(), max_size);
+          Error err = read_append_samples (m_in_stream.get(), count, samples, buffer);
           if (err)
             return err;
+
+          if (samples.size() == old_size)
+            {
+              /* reached eof */
+              *eof = true;
+              return Error::Code::NONE;
+            }
+          m_n_total_samples += samples.size() - old_size;
+          continue;
         }
 
       if (!buffer.size())
@@ -232,7 +328,7 @@ WavChunkLoader::refill (std::vector<float>& samples, size_t max_size, bool *eof)
         }
 
       update_capacity (samples, samples.size() + buffer.size(), max_size);
-      samples.insert (samples.end(), buffer.begin(), buffer.end());
+      append_samples (samples, buffer);
       m_n_total_samples += buffer.size();
     }
   return Error::Code::NONE;
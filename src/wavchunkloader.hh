@@ -47,10 +47,15 @@ class WavChunkLoader
   State                             m_state = State::NEW;
 
   Error           open();
-  void            update_capacity (std::vector<float>& samples, size_t need_space, size_t max_size);
-  Error           refill (std::vector<float>& samples, size_t max_size, bool *eof);
+  template<class T>
+  Error           load_samples (std::vector<T>& samples);
+  template<class T>
+  void            update_capacity (std::vector<T>& samples, size_t need_space, size_t max_size);
+  template<class T>
+  Error           refill (std::vector<T>& samples, size_t max_size, bool *eof);
 public:
   WavChunkLoader (const std::string& filename);
+  WavChunkLoader (std::unique_ptr<AudioInputStream> in_stream);
 
   Error           load_next_chunk();
   bool            done();
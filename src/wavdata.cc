@@ -23,6 +23,7 @@
 #include "mp3inputstream.hh"
 
 #include <memory>
+#include <algorithm>
 #include <math.h>
 
 using std::string;
@@ -55,25 +56,35 @@ WavData::load (const string& filename)
 Error
 WavData::load (AudioInputStream *in_stream)
 {
+  m_format = Format::FLOAT;
+  m_samples_i16 = vector<int16_t>();
   m_samples.clear(); // get rid of old contents
 
+  const size_t block_size = 8192;
+  const int    n_channels = in_stream->n_channels();
+
+  /* read directly into m_samples; the extra block avoids reallocation for the final (empty) read */
   if (in_stream->n_frames() != AudioInputStream::N_FRAMES_UNKNOWN)
-    m_samples.reserve (in_stream->n_frames() * in_stream->n_channels());
+    m_samples.reserve ((in_stream->n_frames() + block_size) * n_channels);
 
-  vector<float> m_buffer;
+  size_t n_values = 0;
   while (true)
     {
-      Error err = in_stream->read_frames (m_buffer, 1024);
+      m_samples.resize (n_values + block_size * n_channels);
+
+      size_t n_frames_read;
+      Error err = in_stream->read_frames (m_samples.data() + n_values, block_size, n_frames_read);
       if (err)
         return err;
 
-      if (!m_buffer.size())
+      if (!n_frames_read)
         {
           /* reached eof */
           break;
         }
-      m_samples.insert (m_samples.end(), m_buffer.begin(), m_buffer.end());
+      n_values += n_frames_read * n_channels;
     }
+  m_samples.resize (n_values);
   m_sample_rate = in_stream->sample_rate();
   m_n_channels  = in_stream->n_channels();
   m_bit_depth   = in_stream->bit_depth();
@@ -84,6 +95,8 @@ WavData::load (AudioInputStream *in_stream)
 Error
 WavData::save (const string& filename) const
 {
+  assert (m_format == Format::FLOAT);
+
   std::unique_ptr<AudioOutputStream> out_stream;
   Error err;
 
@@ -114,5 +127,55 @@ WavData::bit_depth() const
 void
 WavData::set_samples (const vector<float>& samples)
 {
+  assert (m_format == Format::FLOAT);
   m_samples = samples;
 }
+
+void
+WavData::float_to_int16 (const float *in, int16_t *out, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    {
+      const float f = std::max (std::min (in[i] * 32768.f, 32767.f), -32768.f);
+      out[i] = lrintf (f);
+    }
+}
+
+void
+WavData::int16_to_float (const int16_t *in, float *out, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    out[i] = in[i] * int16_scale;
+}
+
+void
+WavData::get_samples (size_t first, size_t n, float *out) const
+{
+  assert (first + n <= n_values());
+
+  if (m_format == Format::FLOAT)
+    std::copy (m_samples.begin() + first, m_samples.begin() + first + n, out);
+  else
+    int16_to_float (m_samples_i16.data() + first, out, n);
+}
+
+void
+WavData::set_format (Format format)
+{
+  if (format == m_format)
+    return;
+
+  if (format == Format::INT16)
+    {
+      m_samples_i16.resize (m_samples.size());
+      float_to_int16 (m_samples.data(), m_samples_i16.data(), m_samples.size());
+      m_samples = vector<float>(); // free memory
+    }
+  else
+    {
+      m_samples.resize (m_samples_i16.size());
+      int16_to_float (m_samples_i16.data(), m_samples.data(), m_samples_i16.size());
+      m_samples_i16 = vector<int16_t>(); // free memory
+    }
+  m_format = format;
+}
@@ -21,15 +21,26 @@
 #include <string>
 #include <vector>
 
+#include <stdint.h>
+#include <assert.h>
+
 #include "utils.hh"
 #include "audiostream.hh"
 
 class WavData
 {
-  std::vector<float> m_samples;
-  int                m_sample_rate = 0;
-  int                m_n_channels  = 0;
-  int                m_bit_depth   = 0;
+public:
+  /* sample storage: FLOAT (default) or INT16 (half the memory, for detection) */
+  enum class Format { FLOAT, INT16 };
+
+  static constexpr float int16_scale = 1 / 32768.f;
+private:
+  Format               m_format = Format::FLOAT;
+  std::vector<float>   m_samples;
+  std::vector<int16_t> m_samples_i16;
+  int                  m_sample_rate = 0;
+  int                  m_n_channels  = 0;
+  int                  m_bit_depth   = 0;
 
 public:
   WavData();
@@ -50,18 +61,40 @@ public:
   size_t
   n_values() const
   {
-    return m_samples.size();
+    return m_format == Format::FLOAT ? m_samples.size() : m_samples_i16.size();
   }
   size_t
   n_frames() const
   {
-    return m_samples.size() / m_n_channels;
+    return n_values() / m_n_channels;
   }
+  Format
+  format() const
+  {
+    return m_format;
+  }
+  /* only available for Format::FLOAT, use get_samples() for code that works with any format */
   const std::vector<float>&
   samples() const
   {
+    assert (m_format == Format::FLOAT);
     return m_samples;
   }
+  const std::vector<int16_t>&
+  samples_i16() const
+  {
+    assert (m_format == Format::INT16);
+    return m_samples_i16;
+  }
+
+  /* copy (and convert) n values starting at value first to out */
+  void get_samples (size_t first, size_t n, float *out) const;
+
+  /* change storage format, converting existing samples (values are clipped for INT16) */
+  void set_format (Format format);
+
+  static void float_to_int16 (const float *in, int16_t *out, size_t n);
+  static void int16_to_float (const int16_t *in, float *out, size_t n);
 
   void set_samples (const std::vector<float>& samples);
 
@@ -69,8 +102,15 @@ public:
   mutable_samples()
   {
     /* allow direct access to samples vector to optimize for performance and low memory usage */
+    assert (m_format == Format::FLOAT);
     return m_samples;
   }
+  std::vector<int16_t>&
+  mutable_samples_i16()
+  {
+    assert (m_format == Format::INT16);
+    return m_samples_i16;
+  }
 };
 
 #endif /* AUDIOWMARK_WAV_DATA_HH */
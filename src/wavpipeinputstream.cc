@@ -27,7 +27,6 @@
 using std::string;
 using std::vector;
 using std::min;
-using std::max;
 
 WavPipeInputStream::~WavPipeInputStream()
 {
@@ -203,10 +202,12 @@ WavPipeInputStream::encoding() const
 }
 
 Error
-WavPipeInputStream::read_frames (vector<float>& samples, size_t count)
+WavPipeInputStream::read_frames (float *samples, size_t count, size_t& n_frames_read)
 {
   assert (m_state == State::OPEN);
 
+  n_frames_read = 0;
+
   const size_t block_size = 8192;
   const int n_channels   = m_format.n_channels();
   const int sample_width = m_format.bit_depth() / 8;
@@ -223,14 +224,12 @@ WavPipeInputStream::read_frames (vector<float>& samples, size_t count)
       if (!r_count)
         break;
 
-      samples.resize (max (samples.size(), (pos + r_count) * n_channels));
-
-      m_raw_converter->from_raw (m_input_bytes.data(), samples.data() + pos * n_channels, r_count * n_channels);
+      m_raw_converter->from_raw (m_input_bytes.data(), samples + pos * n_channels, r_count * n_channels);
 
       pos += r_count;
       count -= r_count;
+      n_frames_read = pos;
     }
-  samples.resize (pos * n_channels);
   return Error::Code::NONE;
 }
 
@@ -44,10 +44,12 @@ class WavPipeInputStream : public AudioInputStream
   Error read_error (const std::string& message);
 
 public:
+  using AudioInputStream::read_frames;
+
   ~WavPipeInputStream();
 
   Error   open (const std::string& filename);
-  Error   read_frames (std::vector<float>& samples, size_t count) override;
+  Error   read_frames (float *samples, size_t count, size_t& n_frames_read) override;
   void    close();
 
   int     bit_depth() const override;
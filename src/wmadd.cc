@@ -33,6 +33,8 @@
 #include "shortcode.hh"
 #include "audiobuffer.hh"
 #include "resample.hh"
+#include "dspkernels.hh"
+#include "stats.hh"
 
 using std::string;
 using std::vector;
@@ -58,10 +60,10 @@ prepare_frame_mod (UpDownGen& up_down_gen, int f, vector<FrameMod>& frame_mod, i
     frame_mod[d] = data_bit ? FrameMod::DOWN : FrameMod::UP;
 }
 
-static void
-apply_frame_mod (const vector<FrameMod>& frame_mod, const vector<complex<float>>& fft_out, vector<complex<float>>& fft_delta_spect)
+static vector<float>
+frame_mod_exponents (const vector<FrameMod>& frame_mod)
 {
-  const float   min_mag = 1e-7;   // avoid computing pow (0.0, -water_delta) which would be inf
+  vector<float> exponents (frame_mod.size());
   for (size_t i = 0; i < frame_mod.size(); i++)
     {
       if (frame_mod[i] == FrameMod::KEEP)
@@ -73,14 +75,19 @@ apply_frame_mod (const vector<FrameMod>& frame_mod, const vector<complex<float>>
        *
        * this actually increases the amount of energy because mag is less than 1.0
        */
-      const float mag = abs (fft_out[i]);
-      if (mag > min_mag)
-        {
-          const float mag_factor = powf (mag, -Params::water_delta * data_bit_sign);
-
-          fft_delta_spect[i] = fft_out[i] * (mag_factor - 1);
-        }
+      exponents[i] = -Params::water_delta * data_bit_sign;
     }
+  return exponents;
+}
+
+static void
+apply_frame_mod (const vector<float>& exponents, const complex<float> *fft_out, complex<float> *fft_delta_spect)
+{
+  const float   min_mag = 1e-7;   // avoid computing pow (0.0, -water_delta) which would be inf
+
+  /* complex<float> is stored as two floats (re, im) */
+  dsp_kernels().frame_mod_delta (reinterpret_cast<const float *> (fft_out), exponents.data(),
+                                 reinterpret_cast<float *> (fft_delta_spect), exponents.size(), min_mag);
 }
 
 static void
@@ -213,7 +220,7 @@ public:
     synth_samples.resize (window.size() * n_channels);
   }
   vector<float>
-  run (const vector<vector<complex<float>>>& fft_delta_spect)
+  run (const Spectrogram& fft_delta_spect)
   {
     const size_t synth_frame_sz = Params::frame_size * n_channels;
     /* move frame 1 and frame 2 to frame 0 and frame 1 */
@@ -223,7 +230,11 @@ public:
     for (int ch = 0; ch < n_channels; ch++)
       {
         /* mix watermark signal to output frame */
-        vector<float> fft_delta_out = fft_processor.ifft (fft_delta_spect[ch]);
+        const complex<float> *delta_bins = fft_delta_spect.bins (0, ch);
+        std::copy (delta_bins, delta_bins + fft_delta_spect.n_bins(), reinterpret_cast<complex<float> *> (fft_processor.in()));
+        fft_processor.ifft();
+
+        const float *fft_delta_out = fft_processor.out();
 
         for (int dframe = 0; dframe <= 2; dframe++)
           {
@@ -299,15 +310,13 @@ public:
   {
     assert (samples.size() == Params::frame_size * n_channels);
 
-    vector<vector<complex<float>>> fft_out = fft_analyzer.run_fft (samples, 0);
+    Spectrogram fft_out = fft_analyzer.run_fft (samples, 0);
+    Spectrogram fft_delta_spect (1, n_channels, fft_out.n_bins());
 
-    vector<vector<complex<float>>> fft_delta_spect;
+    const vector<float> exponents = frame_mod_exponents (get_frame_mod (key));
+    assert (exponents.size() <= fft_out.n_bins());
     for (int ch = 0; ch < n_channels; ch++)
-      fft_delta_spect.push_back (vector<complex<float>> (fft_out.back().size()));
-
-    const vector<FrameMod>& frame_mod = get_frame_mod (key);
-    for (int ch = 0; ch < n_channels; ch++)
-      apply_frame_mod (frame_mod, fft_out[ch], fft_delta_spect[ch]);
+      apply_frame_mod (exponents, fft_out.bins (0, ch), fft_delta_spect.bins (0, ch));
 
     frame_number++;
     if (frame_number % frames_per_block == 0)
@@ -480,9 +489,11 @@ add_stream_watermark (const Key& key, AudioInputStream *in_stream, AudioOutputSt
   info ("Sample Rate:  %d\n", in_stream->sample_rate());
   info ("Channels:     %d\n", in_stream->n_channels());
 
-  vector<float> samples;
-
   const int n_channels = in_stream->n_channels();
+
+  vector<float> in_samples (Params::frame_size * n_channels);
+  vector<float> orig_samples;
+  vector<float> samples;
   AudioBuffer audio_buffer (n_channels);
   WatermarkResampler wm_resampler (n_channels, in_stream->sample_rate(), bitvec);
   if (!wm_resampler.init_ok())
@@ -519,73 +530,68 @@ add_stream_watermark (const Key& key, AudioInputStream *in_stream, AudioOutputSt
     }
   while (true)
     {
-      if (zero_frames_in > 0)
-        {
-          err = in_stream->read_frames (samples, Params::frame_size - zero_frames_in);
-          samples.insert (samples.begin(), zero_frames_in * n_channels, 0);
-          zero_frames_in = 0;
-        }
-      else
-        {
-          err = in_stream->read_frames (samples, Params::frame_size);
-        }
+      /* read input directly into a reused buffer, with zero padding at start and end */
+      size_t n_frames_read = 0;
+      {
+        ScopedStat stat (Stat::READ);
+        if (zero_frames_in > 0)
+          {
+            std::fill (in_samples.begin(), in_samples.begin() + zero_frames_in * n_channels, 0);
+            err = in_stream->read_frames (&in_samples[zero_frames_in * n_channels], Params::frame_size - zero_frames_in, n_frames_read);
+            n_frames_read += zero_frames_in;
+            zero_frames_in = 0;
+          }
+        else
+          {
+            err = in_stream->read_frames (in_samples.data(), Params::frame_size, n_frames_read);
+          }
+      }
       if (err)
         {
           error ("audiowmark: input stream read failed: %s\n", err.message());
           return 1;
         }
-      total_input_frames += samples.size() / n_channels;
+      total_input_frames += n_frames_read;
 
-      if (samples.size() < Params::frame_size * n_channels)
+      if (n_frames_read < Params::frame_size)
         {
           if (total_input_frames == total_output_frames)
             break;
 
           /* zero sample padding after the actual input */
-          samples.resize (Params::frame_size * n_channels);
+          std::fill (in_samples.begin() + n_frames_read * n_channels, in_samples.end(), 0);
         }
-      audio_buffer.write_frames (samples);
-      samples = wm_resampler.run (key, samples);
+      audio_buffer.write_frames (in_samples);
+      samples = wm_resampler.run (key, in_samples);
       size_t to_read = samples.size() / n_channels;
-      vector<float> orig_samples  = audio_buffer.read_frames (to_read);
-      assert (samples.size() == orig_samples.size());
+      orig_samples.resize (samples.size());
+      audio_buffer.read_frames (orig_samples.data(), to_read);
 
-      if (Params::snr)
-        {
-          for (size_t i = 0; i < samples.size(); i++)
-            {
-              const double orig  = orig_samples[i]; // original sample
-              const double delta = samples[i];      // watermark
+      if (Params::snr) /* samples: watermark, orig_samples: original */
+        dsp_kernels().power_sum (samples.data(), orig_samples.data(), samples.size(), &snr_delta_power, &snr_signal_power);
 
-              snr_delta_power += delta * delta;
-              snr_signal_power += orig * orig;
-            }
-        }
-      for (size_t i = 0; i < samples.size(); i++)
-        samples[i] += orig_samples[i];
+      dsp_kernels().add (samples.data(), orig_samples.data(), samples.size());
 
       if (!Params::test_no_limiter)
         samples = limiter.process (samples);
 
-      size_t max_write_frames = total_input_frames - total_output_frames;
-      if (samples.size() > max_write_frames * n_channels)
-        samples.resize (max_write_frames * n_channels);
+      const size_t max_write_frames = total_input_frames - total_output_frames;
+      const size_t out_frames = min (samples.size() / n_channels, max_write_frames);
 
-      const size_t cut_frames = min (samples.size() / n_channels, zero_frames_out);
-      if (cut_frames > 0)
-        {
-          samples.erase (samples.begin(), samples.begin() + cut_frames * n_channels);
-          total_output_frames += cut_frames;
-          zero_frames_out -= cut_frames;
-        }
+      const size_t cut_frames = min (out_frames, zero_frames_out);
+      total_output_frames += cut_frames;
+      zero_frames_out -= cut_frames;
 
-      err = out_stream->write_frames (samples);
+      {
+        ScopedStat stat (Stat::WRITE);
+        err = out_stream->write_frames (samples.data() + cut_frames * n_channels, out_frames - cut_frames);
+      }
       if (err)
         {
           error ("audiowmark output write failed: %s\n", err.message());
           return 1;
         }
-      total_output_frames += samples.size() / n_channels;
+      total_output_frames += out_frames - cut_frames;
     }
 
   if (Params::snr)
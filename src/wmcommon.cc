@@ -19,6 +19,7 @@
 #include "fft.hh"
 #include "convcode.hh"
 #include "shortcode.hh"
+#include "dspkernels.hh"
 
 using std::string;
 using std::vector;
@@ -32,6 +33,7 @@ bool   Params::snr             = false; // compute/show snr while adding waterma
 bool   Params::strict          = true;  // Changed from false to true to prevent automatic payload expansion
 bool   Params::detect_speed    = false;
 bool   Params::detect_speed_patient = false;
+bool   Params::detect_speed_reuse = false;
 double Params::try_speed       = -1;
 double Params::test_speed      = -1;
 double Params::sync_threshold2 = 0.35;
@@ -45,24 +47,35 @@ bool   Params::test_no_limiter = false; // disable limiter
 int    Params::test_truncate   = 0;
 int    Params::expect_matches  = -1;
 double Params::get_chunk_size  = 30;
+WavData::Format Params::get_sample_format = WavData::Format::FLOAT;
 
 Format Params::input_format     = Format::AUTO;
 Format Params::output_format    = Format::AUTO;
+bool   Params::mp3_fast_open    = false;
 
 RawFormat Params::raw_input_format;
 RawFormat Params::raw_output_format;
 
 int    Params::hls_bit_rate = 0;
+int    Params::hls_ab_bits = 32;
+HLSContext Params::hls_context = HLSContext::FLAC;
+string Params::hls_state_file;
 
 string Params::json_output;
 string Params::input_label;
 string Params::output_label;
 
+static const vector<float>&
+analysis_window()
+{
+  static const vector<float> window = FFTAnalyzer::gen_normalized_window (Params::frame_size);
+  return window;
+}
+
 FFTAnalyzer::FFTAnalyzer (int n_channels) :
   m_n_channels (n_channels),
-  m_fft_processor (Params::frame_size)
+  m_window (analysis_window())
 {
-  m_window = gen_normalized_window (Params::frame_size);
 }
 
 /* safe to call from any thread */
@@ -89,58 +102,138 @@ FFTAnalyzer::gen_normalized_window (size_t n_values)
   return window;
 }
 
-vector<vector<complex<float>>>
-FFTAnalyzer::run_fft (const vector<float>& samples, size_t start_index)
+/* deinterleave frame data (frame_samples: frame_size interleaved frames) and apply window */
+void
+FFTAnalyzer::window_frame (const float *frame_samples, int ch, float *frame)
 {
-  assert (samples.size() >= (Params::frame_size + start_index) * m_n_channels);
+  dsp_kernels().window_deinterleave (frame_samples + ch, m_n_channels, m_window.data(), frame, Params::frame_size);
+}
 
-  float *frame     = m_fft_processor.in();
-  float *frame_fft = m_fft_processor.out();
+/* get float samples for one frame (all channels), converting them to float if necessary */
+const float *
+FFTAnalyzer::frame_samples (const WavData& wav_data, size_t start_index, vector<float>& buffer)
+{
+  const size_t n_values = Params::frame_size * m_n_channels;
+  assert ((start_index + Params::frame_size) * m_n_channels <= wav_data.n_values());
+
+  if (wav_data.format() == WavData::Format::FLOAT)
+    return &wav_data.samples()[start_index * m_n_channels];
+
+  buffer.resize (n_values);
+  wav_data.get_samples (start_index * m_n_channels, n_values, buffer.data());
+  return buffer.data();
+}
+
+/* compute fft of one frame (all channels) and store it in spectrogram */
+void
+FFTAnalyzer::fft_frame (const float *frame_samples, Spectrogram& spectrogram, size_t frame)
+{
+  FFTProcessor& fft_processor = FFTProcessor::thread_local_instance (Params::frame_size);
+
+  float *frame_in  = fft_processor.in();
+  float *frame_fft = fft_processor.out();
 
-  vector<vector<complex<float>>> fft_out;
   for (int ch = 0; ch < m_n_channels; ch++)
     {
-      size_t pos = start_index * m_n_channels + ch;
-      assert (pos + (Params::frame_size - 1) * m_n_channels < samples.size());
+      window_frame (frame_samples, ch, frame_in);
 
-      /* deinterleave frame data and apply window */
-      for (size_t x = 0; x < Params::frame_size; x++)
-        {
-          frame[x] = samples[pos] * m_window[x];
-          pos += m_n_channels;
-        }
       /* FFT transform */
-      m_fft_processor.fft();
+      fft_processor.fft();
 
       /* complex<float> and frame_fft have the same layout in memory */
-      const complex<float> *first = (complex<float> *) frame_fft;
-      const complex<float> *last  = first + Params::frame_size / 2 + 1;
-      fft_out.emplace_back (first, last);
+      const complex<float> *first = reinterpret_cast<const complex<float> *> (frame_fft);
+      std::copy (first, first + spectrogram.n_bins(), spectrogram.bins (frame, ch));
     }
+}
+
+Spectrogram
+FFTAnalyzer::run_fft (const vector<float>& samples, size_t start_index)
+{
+  assert (samples.size() >= (Params::frame_size + start_index) * m_n_channels);
 
+  Spectrogram fft_out (1, m_n_channels, Params::frame_size / 2 + 1);
+
+  fft_frame (&samples[start_index * m_n_channels], fft_out, 0);
   return fft_out;
 }
 
-vector<vector<complex<float>>>
-FFTAnalyzer::fft_range (const vector<float>& samples, size_t start_index, size_t frame_count)
+Spectrogram
+FFTAnalyzer::fft_range (const WavData& wav_data, size_t start_index, size_t frame_count)
 {
-  vector<vector<complex<float>>> fft_out;
+  /* if there is not enough space for frame_count values, return an error (empty spectrogram) */
+  if (wav_data.n_values() < (start_index + frame_count * Params::frame_size) * m_n_channels)
+    return Spectrogram();
+
+  vector<float> buffer;
 
-  /* if there is not enough space for frame_count values, return an error (empty vector) */
-  if (samples.size() < (start_index + frame_count * Params::frame_size) * m_n_channels)
-    return fft_out;
+  const size_t n_bins = Params::frame_size / 2 + 1;
 
-  for (size_t f = 0; f < frame_count; f++)
+  Spectrogram fft_out (frame_count, m_n_channels, n_bins);
+
+  /* transform fft_batch_frames frames (all channels) with one batched fft */
+  const size_t n_batch = fft_batch_frames * m_n_channels;
+
+  FFTBatchProcessor& batch_processor = FFTBatchProcessor::thread_local_instance (Params::frame_size, n_batch);
+
+  size_t f = 0;
+  while (f + fft_batch_frames <= frame_count)
     {
-      const size_t frame_start = (f * Params::frame_size) + start_index;
+      float *batch_in = batch_processor.in();
+      for (size_t bf = 0; bf < fft_batch_frames; bf++)
+        {
+          const float *samples = frame_samples (wav_data, (f + bf) * Params::frame_size + start_index, buffer);
+          for (int ch = 0; ch < m_n_channels; ch++)
+            {
+              window_frame (samples, ch, batch_in);
+              batch_in += Params::frame_size;
+            }
+        }
+      batch_processor.fft();
 
-      vector<vector<complex<float>>> frame_result = run_fft (samples, frame_start);
-      for (auto& fr : frame_result)
-        fft_out.emplace_back (std::move (fr));
+      /* complex<float> and batch output have the same layout in memory */
+      const complex<float> *batch_out = reinterpret_cast<const complex<float> *> (batch_processor.out());
+      for (size_t bf = 0; bf < fft_batch_frames; bf++)
+        {
+          for (int ch = 0; ch < m_n_channels; ch++)
+            {
+              std::copy (batch_out, batch_out + n_bins, fft_out.bins (f + bf, ch));
+              batch_out += n_bins;
+            }
+        }
+      f += fft_batch_frames;
     }
+
+  /* remaining frames */
+  for (; f < frame_count; f++)
+    fft_frame (frame_samples (wav_data, (f * Params::frame_size) + start_index, buffer), fft_out, f);
+
   return fft_out;
 }
 
+void
+FFTAnalyzer::run_fft_band_db (const WavData& wav_data, size_t start_index, float *band_db)
+{
+  constexpr size_t n_bands = Params::max_band - Params::min_band + 1;
+  const float min_db = -96;
+
+  FFTProcessor& fft_processor = FFTProcessor::thread_local_instance (Params::frame_size);
+
+  static thread_local vector<float> buffer;
+  const float *samples = frame_samples (wav_data, start_index, buffer);
+
+  float *frame = fft_processor.in();
+  for (int ch = 0; ch < m_n_channels; ch++)
+    {
+      window_frame (samples, ch, frame);
+
+      /* full FFT, but avoid copying bins we don't need */
+      fft_processor.fft();
+
+      const float *frame_fft = fft_processor.out();
+      dsp_kernels().add_db_from_complex (frame_fft + Params::min_band * 2, band_db, n_bands, min_db);
+    }
+}
+
 BitPosGen::BitPosGen (const Key& key)
 {
   int frame_count = mark_data_frame_count() + mark_sync_frame_count();
@@ -237,3 +330,53 @@ parse_payload (const string& bits)
     }
   return bitvec;
 }
+
+/*
+ * message layout for A/B segment variants (hls-prepare-ab):
+ *
+ *  - ab_index_bits bits index of the payload bit (msb first)
+ *  - 1 bit payload bit value
+ *  - all remaining message bits are zero (used to reject other messages)
+ */
+vector<int>
+ab_message (int index, int bit)
+{
+  assert (index >= 0 && index < (1 << ab_index_bits));
+
+  vector<int> bit_vec (Params::payload_size);
+  for (int i = 0; i < ab_index_bits; i++)
+    bit_vec[i] = (index >> (ab_index_bits - 1 - i)) & 1;
+  bit_vec[ab_index_bits] = bit;
+  return bit_vec;
+}
+
+bool
+ab_message_parse (const vector<int>& bit_vec, int& index, int& bit)
+{
+  if (bit_vec.size() <= ab_index_bits)
+    return false;
+
+  for (size_t i = ab_index_bits + 1; i < bit_vec.size(); i++)
+    if (bit_vec[i])
+      return false;
+
+  index = 0;
+  for (int i = 0; i < ab_index_bits; i++)
+    index = (index << 1) | bit_vec[i];
+  bit = bit_vec[ab_index_bits];
+  return true;
+}
+
+/* deterministic stereo test signal (white noise), depending only on the key */
+WavData
+gen_noise (const Key& key, double seconds, int rate, int bits)
+{
+  const int channels = 2;
+
+  vector<float> noise;
+  Random rng (key, 0, /* there is no stream for this test */ Random::Stream::data_up_down);
+  for (size_t i = 0; i < size_t (rate * seconds) * channels; i++)
+    noise.push_back (rng.random_double() * 2 - 1);
+
+  return WavData (noise, channels, rate, bits);
+}
@@ -25,11 +25,15 @@
 #include "rawinputstream.hh"
 #include "wavdata.hh"
 #include "fft.hh"
+#include "spectrogram.hh"
 
 #include <assert.h>
 
 enum class Format { AUTO = 1, RAW, RF64, WAV_PIPE };
 
+/* encoding of the audio context stored in prepared hls segments */
+enum class HLSContext { FLAC, FLAC_FAST, RAW };
+
 class Params
 {
 public:
@@ -48,6 +52,7 @@ public:
 
   static           bool detect_speed;
   static           bool detect_speed_patient;
+  static           bool detect_speed_reuse;        // use speed of previous chunk as prior for next chunk
   static           double try_speed;               // manual speed correction
   static           double test_speed;              // for debugging --detect-speed
 
@@ -69,6 +74,7 @@ public:
   static constexpr double limiter_ceiling       = 0.99;
 
   static           double get_chunk_size;          // chunk size for audiowmark get to reduce memory usage
+  static           WavData::Format get_sample_format; // sample storage for audiowmark get (INT16 to reduce memory usage)
 
   static           int test_cut; // for sync test
   static           bool test_no_sync;
@@ -78,11 +84,15 @@ public:
 
   static           Format input_format;
   static           Format output_format;
+  static           bool   mp3_fast_open;           // don't scan mp3 files to get the exact length
 
   static           RawFormat raw_input_format;
   static           RawFormat raw_output_format;
 
   static           int hls_bit_rate;
+  static           int hls_ab_bits;               // number of payload bits for A/B segment variants
+  static           HLSContext hls_context;
+  static           std::string hls_state_file;    // state file for incremental hls-prepare
 
   // input/output labels can be set for pretty output for videowmark add
   static           std::string input_label;
@@ -133,16 +143,31 @@ public:
   int data_frame (int f);
 };
 
+/*
+ * FFTAnalyzer is cheap to construct: it uses the FFTProcessor of the calling
+ * thread and a shared analysis window.
+ */
 class FFTAnalyzer
 {
-  int           m_n_channels = 0;
-  std::vector<float> m_window;
-  FFTProcessor  m_fft_processor;
+  static constexpr size_t fft_batch_frames = 16; // number of frames per batch in fft_range
+
+  int                       m_n_channels = 0;
+  const std::vector<float>& m_window;
+
+  void         window_frame (const float *frame_samples, int ch, float *frame);
+  const float *frame_samples (const WavData& wav_data, size_t start_index, std::vector<float>& buffer);
+  void         fft_frame (const float *frame_samples, Spectrogram& spectrogram, size_t frame);
 public:
   FFTAnalyzer (int n_channels);
 
-  std::vector<std::vector<std::complex<float>>> run_fft (const std::vector<float>& samples, size_t start_index);
-  std::vector<std::vector<std::complex<float>>> fft_range (const std::vector<float>& samples, size_t start_index, size_t frame_count);
+  /* one frame (all channels) */
+  Spectrogram run_fft (const std::vector<float>& samples, size_t start_index);
+
+  /* frame_count frames (all channels), empty spectrogram if there are not enough samples */
+  Spectrogram fft_range (const WavData& wav_data, size_t start_index, size_t frame_count);
+
+  /* add dB values for bins min_band..max_band (summed over all channels) to band_db[0..n_bands) */
+  void run_fft_band_db (const WavData& wav_data, size_t start_index, float *band_db);
 
   static std::vector<float> gen_normalized_window (size_t n_values);
 };
@@ -163,6 +188,14 @@ int frame_count (const WavData& wav_data);
 
 std::vector<int> parse_payload (const std::string& str);
 
+WavData gen_noise (const Key& key, double seconds, int rate, int bits);
+
+/* A/B segment variants: each watermark message carries one payload bit and its index */
+constexpr int ab_index_bits = 12;
+
+std::vector<int> ab_message (int index, int bit);
+bool             ab_message_parse (const std::vector<int>& bit_vec, int& index, int& bit);
+
 template<class T> std::vector<T>
 randomize_bit_order (const Key& key, const std::vector<T>& bit_vec, bool encode)
 {
@@ -227,5 +260,8 @@ db_from_complex (std::complex<float> f, float min_dB)
 int add_stream_watermark (const Key& key, AudioInputStream *in_stream, AudioOutputStream *out_stream, const std::string& bits, size_t zero_frames);
 int add_watermark (const Key& key, const std::string& infile, const std::string& outfile, const std::string& bits);
 int get_watermark (const std::vector<Key>& key_list, const std::string& infile, const std::string& orig_pattern);
+int get_watermark (const std::vector<Key>& key_list, std::unique_ptr<AudioInputStream> in_stream, const std::string& name,
+                   const std::string& orig_pattern);
+int get_ab_watermark (const std::vector<Key>& key_list, const std::string& infile);
 
 #endif /* AUDIOWMARK_WM_COMMON_HH */
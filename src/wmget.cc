@@ -65,7 +65,7 @@ normalize_soft_bits (const vector<float>& soft_bits)
 }
 
 static vector<float>
-mix_decode (const Key& key, vector<vector<complex<float>>>& fft_out, int n_channels)
+mix_decode (const Key& key, const Spectrogram& fft_out, int n_channels)
 {
   vector<float> raw_bit_vec;
 
@@ -81,20 +81,23 @@ mix_decode (const Key& key, vector<vector<complex<float>>>& fft_out, int n_chann
           for (size_t frame_b = 0; frame_b < Params::bands_per_frame; frame_b++)
             {
               int b = f * Params::bands_per_frame + frame_b;
-              const double min_db = -96;
 
-              const size_t index = mix_entries[b].frame * n_channels + ch;
-              const size_t next_index = (index + n_channels) < fft_out.size() ? index + n_channels : index - n_channels;
-              const size_t prev_index = (int (index) - n_channels) >= 0 ? index - n_channels : index + n_channels;
+              const size_t frame = mix_entries[b].frame;
+              const size_t next_frame = (frame + 1) < fft_out.n_frames() ? frame + 1 : frame - 1;
+              const size_t prev_frame = frame >= 1 ? frame - 1 : frame + 1;
+
+              const float *db = fft_out.db (frame, ch);
+              const float *prev_db = fft_out.db (prev_frame, ch);
+              const float *next_db = fft_out.db (next_frame, ch);
 
               const int u = mix_entries[b].up;
               const int d = mix_entries[b].down;
 
-              umag += db_from_complex (fft_out[index][u], min_db);
-              umag -= (db_from_complex (fft_out[prev_index][u], min_db) + db_from_complex (fft_out[next_index][u], min_db)) * 0.5;
+              umag += db[u];
+              umag -= (prev_db[u] + next_db[u]) * 0.5;
 
-              dmag += db_from_complex (fft_out[index][d], min_db);
-              dmag -= (db_from_complex (fft_out[prev_index][d], min_db) + db_from_complex (fft_out[next_index][d], min_db)) * 0.5;
+              dmag += db[d];
+              dmag -= (prev_db[d] + next_db[d]) * 0.5;
             }
         }
       if ((f % Params::frames_per_bit) == (Params::frames_per_bit - 1))
@@ -108,7 +111,7 @@ mix_decode (const Key& key, vector<vector<complex<float>>>& fft_out, int n_chann
 }
 
 static vector<float>
-linear_decode (const Key& key, vector<vector<complex<float>>>& fft_out, int n_channels)
+linear_decode (const Key& key, const Spectrogram& fft_out, int n_channels)
 {
   UpDownGen     up_down_gen (key, Random::Stream::data_up_down);
   BitPosGen     bit_pos_gen (key);
@@ -121,24 +124,27 @@ linear_decode (const Key& key, vector<vector<complex<float>>>& fft_out, int n_ch
     {
       for (int ch = 0; ch < n_channels; ch++)
         {
-          const size_t index = bit_pos_gen.data_frame (f) * n_channels + ch;
-          const size_t next_index = (index + n_channels) < fft_out.size() ? index + n_channels : index - n_channels;
-          const size_t prev_index = (int (index) - n_channels) >= 0 ? index - n_channels : index + n_channels;
+          const size_t frame = bit_pos_gen.data_frame (f);
+          const size_t next_frame = (frame + 1) < fft_out.n_frames() ? frame + 1 : frame - 1;
+          const size_t prev_frame = frame >= 1 ? frame - 1 : frame + 1;
+
+          const float *db = fft_out.db (frame, ch);
+          const float *prev_db = fft_out.db (prev_frame, ch);
+          const float *next_db = fft_out.db (next_frame, ch);
 
           UpDownArray up, down;
           up_down_gen.get (f, up, down);
 
-          const double min_db = -96;
           for (auto u : up)
             {
-              umag += db_from_complex (fft_out[index][u], min_db);
-              umag -= 0.5 * (db_from_complex (fft_out[prev_index][u], min_db) + db_from_complex (fft_out[next_index][u], min_db));
+              umag += db[u];
+              umag -= 0.5 * (prev_db[u] + next_db[u]);
             }
 
           for (auto d : down)
             {
-              dmag += db_from_complex (fft_out[index][d], min_db);
-              dmag -= 0.5 * (db_from_complex (fft_out[prev_index][d], min_db) + db_from_complex (fft_out[next_index][d], min_db));
+              dmag += db[d];
+              dmag -= 0.5 * (prev_db[d] + next_db[d]);
             }
         }
       if ((f % Params::frames_per_bit) == (Params::frames_per_bit - 1))
@@ -152,8 +158,13 @@ linear_decode (const Key& key, vector<vector<complex<float>>>& fft_out, int n_ch
 }
 
 static vector<float>
-mix_or_linear_decode (const Key& key, vector<vector<complex<float>>>& fft_out, int n_channels)
+mix_or_linear_decode (const Key& key, Spectrogram& fft_out, int n_channels)
 {
+  /* compute dB values once; each bin is used up to three times (as frame, prev and next) */
+  const float min_db = -96;
+  if (!fft_out.has_db())
+    fft_out.compute_db (min_db);
+
   if (Params::mix)
     return mix_decode (key, fft_out, n_channels);
   else
@@ -468,6 +479,32 @@ public:
   {
     printf ("%s", debug_sync.c_str());
   }
+  /* A/B segment variants: vote (weighted by sync quality) for each payload bit, -1 = unknown */
+  vector<int>
+  ab_payload (int n_bits) const
+  {
+    vector<std::array<double, 2>> votes (n_bits);
+
+    for (const auto& pattern : patterns)
+      {
+        /* all patterns combine blocks which can belong to different A/B segments */
+        if (pattern.type == Type::ALL)
+          continue;
+
+        int index, bit;
+        if (ab_message_parse (pattern.bit_vec, index, bit) && index < n_bits)
+          votes[index][bit] += pattern.sync_score.quality;
+      }
+    vector<int> bits (n_bits, -1);
+    for (int i = 0; i < n_bits; i++)
+      {
+        if (votes[i][0] > votes[i][1])
+          bits[i] = 0;
+        else if (votes[i][1] > votes[i][0])
+          bits[i] = 1;
+      }
+    return bits;
+  }
   double
   best_quality() const
   {
@@ -529,8 +566,8 @@ public:
             const size_t count = mark_sync_frame_count() + mark_data_frame_count();
             const size_t index = sync_score.index;
 
-            auto fft_range_out = fft_analyzer.fft_range (wav_data.samples(), index, count);
-            if (fft_range_out.size())
+            auto fft_range_out = fft_analyzer.fft_range (wav_data, index, count);
+            if (!fft_range_out.empty())
               {
                 /* ---- retrieve bits from watermark ---- */
                 vector<float> raw_bit_vec = mix_or_linear_decode (key, fft_range_out, wav_data.n_channels());
@@ -787,9 +824,9 @@ class ClipDecoder
           {
             const size_t count = mark_sync_frame_count() + mark_data_frame_count();
             const size_t index = sync_score.index;
-            auto fft_range_out1 = fft_analyzer.fft_range (wav_data.samples(), index, count);
-            auto fft_range_out2 = fft_analyzer.fft_range (wav_data.samples(), index + count * Params::frame_size, count);
-            if (fft_range_out1.size() && fft_range_out2.size())
+            auto fft_range_out1 = fft_analyzer.fft_range (wav_data, index, count);
+            auto fft_range_out2 = fft_analyzer.fft_range (wav_data, index + count * Params::frame_size, count);
+            if (!fft_range_out1.empty() && !fft_range_out2.empty())
               {
                 const auto raw_bit_vec1 = randomize_bit_order (key, mix_or_linear_decode (key, fft_range_out1, wav_data.n_channels()), /* encode */ false);
                 const auto raw_bit_vec2 = randomize_bit_order (key, mix_or_linear_decode (key, fft_range_out2, wav_data.n_channels()), /* encode */ false);
@@ -856,7 +893,8 @@ class ClipDecoder
         last_sample  = wav_data.n_values();
       }
     const double time_offset = double (first_sample) / wav_data.sample_rate() / wav_data.n_channels();
-    vector<float> ext_samples (wav_data.samples().begin() + first_sample, wav_data.samples().begin() + last_sample);
+    vector<float> ext_samples (last_sample - first_sample);
+    wav_data.get_samples (first_sample, ext_samples.size(), ext_samples.data());
 
     if (0)
       {
@@ -890,7 +928,8 @@ public:
 };
 
 static void
-decode (ResultSet& result_set, const vector<Key>& key_list, const WavData& wav_data, const vector<int>& orig_bits, bool first_chunk)
+decode (ResultSet& result_set, const vector<Key>& key_list, const WavData& wav_data, const vector<int>& orig_bits, bool first_chunk,
+        vector<DetectSpeedResult> *speed_prior)
 {
   /*
    * The strategy for integrating speed detection into decoding is this:
@@ -905,7 +944,7 @@ decode (ResultSet& result_set, const vector<Key>& key_list, const WavData& wav_d
     {
       vector<DetectSpeedResult> speed_results;
       if (Params::detect_speed || Params::detect_speed_patient)
-        speed_results = detect_speed (key_list, wav_data, !orig_bits.empty());
+        speed_results = detect_speed (key_list, wav_data, !orig_bits.empty(), speed_prior);
       else
         {
           for (const auto& key : key_list)
@@ -920,6 +959,7 @@ decode (ResultSet& result_set, const vector<Key>& key_list, const WavData& wav_d
       for (const auto& speed_result : speed_results)
         {
           WavData wav_data_speed = resample_ratio (wav_data, speed_result.speed, Params::mark_sample_rate * speed_result.speed);
+          wav_data_speed.set_format (wav_data.format());
 
           BlockDecoder block_decoder (speed_result.speed);
           block_decoder.run ({ speed_result.key }, wav_data_speed, result_set);
@@ -974,21 +1014,15 @@ report (ResultSet& result_set, size_t time_length, const vector<int>& orig_bits)
   return 0;
 }
 
-int
-get_watermark (const vector<Key>& key_list, const string& infile, const string& orig_pattern)
+static int
+decode_chunks (ResultSet& result_set, const vector<Key>& key_list, WavChunkLoader& wav_chunk_loader, const string& infile,
+               const vector<int>& orig_bitvec, size_t& time_length)
 {
-  ResultSet result_set;
+  bool first_chunk = true;
 
-  vector<int> orig_bitvec;
-  if (!orig_pattern.empty())
-    {
-      orig_bitvec = parse_payload (orig_pattern);
-      if (orig_bitvec.empty())
-        return 1;
-    }
+  /* with --detect-speed-reuse, the speed detected in the first chunk is used as starting point for the next chunks */
+  vector<DetectSpeedResult> speed_prior;
 
-  bool first_chunk = true;
-  WavChunkLoader wav_chunk_loader (infile);
   while (!wav_chunk_loader.done())
     {
       Error err = wav_chunk_loader.load_next_chunk();
@@ -1005,7 +1039,7 @@ get_watermark (const vector<Key>& key_list, const string& infile, const string&
 
           ResultSet chunk_result_set;
 
-          decode (chunk_result_set, key_list, wav_data, orig_bitvec, first_chunk);
+          decode (chunk_result_set, key_list, wav_data, orig_bitvec, first_chunk, Params::detect_speed_reuse ? &speed_prior : nullptr);
           chunk_result_set.apply_time_offset (wav_chunk_loader.time_offset());
 
           result_set.merge (chunk_result_set);
@@ -1014,6 +1048,88 @@ get_watermark (const vector<Key>& key_list, const string& infile, const string&
     }
   result_set.sort (key_list);
 
-  size_t time_length = lrint (wav_chunk_loader.length());
+  time_length = lrint (wav_chunk_loader.length());
+  return 0;
+}
+
+static int
+decode_file (ResultSet& result_set, const vector<Key>& key_list, const string& infile, const vector<int>& orig_bitvec, size_t& time_length)
+{
+  WavChunkLoader wav_chunk_loader (infile);
+
+  return decode_chunks (result_set, key_list, wav_chunk_loader, infile, orig_bitvec, time_length);
+}
+
+static int
+get_watermark (const vector<Key>& key_list, WavChunkLoader& wav_chunk_loader, const string& infile, const string& orig_pattern)
+{
+  ResultSet result_set;
+
+  vector<int> orig_bitvec;
+  if (!orig_pattern.empty())
+    {
+      orig_bitvec = parse_payload (orig_pattern);
+      if (orig_bitvec.empty())
+        return 1;
+    }
+
+  size_t time_length = 0;
+  int rc = decode_chunks (result_set, key_list, wav_chunk_loader, infile, orig_bitvec, time_length);
+  if (rc != 0)
+    return rc;
+
   return report (result_set, time_length, orig_bitvec);
 }
+
+int
+get_watermark (const vector<Key>& key_list, const string& infile, const string& orig_pattern)
+{
+  WavChunkLoader wav_chunk_loader (infile);
+
+  return get_watermark (key_list, wav_chunk_loader, infile, orig_pattern);
+}
+
+/* decode from an already opened input stream, name is used for error messages */
+int
+get_watermark (const vector<Key>& key_list, std::unique_ptr<AudioInputStream> in_stream, const string& name, const string& orig_pattern)
+{
+  WavChunkLoader wav_chunk_loader (std::move (in_stream));
+
+  return get_watermark (key_list, wav_chunk_loader, name, orig_pattern);
+}
+
+/* reassemble the payload of a stream delivered as A/B segment variants (see hls-prepare-ab) */
+int
+get_ab_watermark (const vector<Key>& key_list, const string& infile)
+{
+  ResultSet result_set;
+
+  size_t time_length = 0;
+  int rc = decode_file (result_set, key_list, infile, /* no ber */ {}, time_length);
+  if (rc != 0)
+    return rc;
+
+  if (!Params::json_output.empty())
+    result_set.print_json (time_length, Params::json_output);
+
+  if (Params::json_output != "-")
+    result_set.print();
+
+  vector<int> bits = result_set.ab_payload (Params::hls_ab_bits);
+
+  string bit_str;
+  for (auto b : bits)
+    bit_str += b < 0 ? '?' : char ('0' + b);
+  printf ("ab_bits %s\n", bit_str.c_str());
+
+  if (std::count (bits.begin(), bits.end(), -1))
+    {
+      error ("audiowmark: A/B payload incomplete: %zd of %zd bits found\n",
+             bits.size() - std::count (bits.begin(), bits.end(), -1), bits.size());
+      return 1;
+    }
+  /* hex payload only if all bits fit into hex digits, bit_vec_to_str would drop the rest */
+  if (bits.size() % 4 == 0)
+    printf ("ab_payload %s\n", bit_vec_to_str (bits).c_str());
+  return 0;
+}
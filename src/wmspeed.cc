@@ -21,6 +21,8 @@
 #include "threadpool.hh"
 #include "fft.hh"
 #include "resample.hh"
+#include "dspkernels.hh"
+#include "stats.hh"
 
 #include <algorithm>
 
@@ -44,8 +46,8 @@ get_speed_clip (double location, const WavData& in_data, double clip_seconds)
   printf ("[%f %f] l%f\n", double (start_point) / in_data.sample_rate(), double (end_point) / in_data.sample_rate(),
                            double (end_point - start_point) / in_data.sample_rate());
 #endif
-  vector<float> out_signal (in_data.samples().begin() + start_point * in_data.n_channels(),
-                            in_data.samples().begin() + end_point * in_data.n_channels());
+  vector<float> out_signal ((end_point - start_point) * in_data.n_channels());
+  in_data.get_samples (start_point * in_data.n_channels(), out_signal.size(), out_signal.data());
   WavData clip_data (out_signal, in_data.n_channels(), in_data.sample_rate(), in_data.bit_depth());
   return clip_data;
 }
@@ -204,6 +206,8 @@ public:
 void
 SpeedSync::prepare_mags (const SpeedScanParams& scan_params)
 {
+  ScopedStat stat (Stat::SPEED_PREPARE);
+
   // we downsample the audio by factor 2 to improve performance
   WavData in_data_sub (resample_ratio_truncate (in_data, center / 2, Params::mark_sample_rate / 2, /* truncate to length */ scan_params.seconds / center));
 
@@ -212,11 +216,13 @@ SpeedSync::prepare_mags (const SpeedScanParams& scan_params)
 
   vector<float> window = FFTAnalyzer::gen_normalized_window (sub_frame_size);
 
-  FFTProcessor fft_processor (sub_frame_size);
+  FFTProcessor& fft_processor = FFTProcessor::thread_local_instance (sub_frame_size);
 
   float *in = fft_processor.in();
   float *out = fft_processor.out();
 
+  const DSPKernels& dsp = dsp_kernels();
+
   /* set mag matrix size */
   int n_sync_rows = 0;
   int n_sync_cols = sync_bits.size();
@@ -236,28 +242,17 @@ SpeedSync::prepare_mags (const SpeedScanParams& scan_params)
 
       for (int ch = 0; ch < in_data_sub.n_channels(); ch++)
         {
-          for (int i = 0; i < sub_frame_size; i++)
-            {
-              in[i] = samples[ch + (pos + i) * in_data_sub.n_channels()] * window[i];
-            }
+          dsp.window_deinterleave (&samples[ch + pos * in_data_sub.n_channels()], in_data_sub.n_channels(), window.data(), in, sub_frame_size);
           fft_processor.fft();
 
-          for (int i = Params::min_band; i <= Params::max_band; i++)
-            {
-              const float min_db = -96;
-
-              fft_out_db[i - Params::min_band] += db_from_complex (out[i * 2], out[i * 2 + 1], min_db);
-            }
+          const float min_db = -96;
+          dsp.add_db_from_complex (out + Params::min_band * 2, fft_out_db.data(), fft_out_db.size(), min_db);
         }
       for (const auto& sync_bit : sync_bits)
         {
           float umag = 0, dmag = 0;
 
-          for (size_t i = 0; i < sync_bit.up.size(); i++)
-            {
-              umag += fft_out_db[sync_bit.up[i]];
-              dmag += fft_out_db[sync_bit.down[i]];
-            }
+          dsp.sum_up_down (fft_out_db.data(), sync_bit.up.data(), sync_bit.down.data(), sync_bit.up.size(), &umag, &dmag);
           sync_matrix (row, col++) = MagMatrix::Mags {umag, dmag};
         }
       assert (col == n_sync_cols);
@@ -329,6 +324,8 @@ SpeedSync::compare_bits (vector<CmpState>& cmp_states, double relative_speed)
 void
 SpeedSync::compare (double relative_speed)
 {
+  ScopedStat stat (Stat::SPEED_COMPARE);
+
   const int steps_per_frame = Params::frame_size / Params::sync_search_step;
   const int pad_start = frames_per_block * steps_per_frame + /* add a bit of overlap to handle boundaries */ steps_per_frame;
 
@@ -381,6 +378,23 @@ SpeedSync::compare (double relative_speed)
   result_scores.push_back (best_score);
 }
 
+void
+speed_sync_compare_bench (const Key& key, const WavData& in_data, const function<void (const function<void()>&)>& bench)
+{
+  const SpeedScanParams scan_params /* like first pass of detect_speed */
+    {
+      .seconds        = 25,
+      .step           = 1.0007,
+      .n_steps        = 5,
+    };
+  SpeedSync speed_sync (key, in_data, 1.0);
+  SpeedSync::Jobs jobs = speed_sync.get_jobs (scan_params, 1.0);
+
+  jobs.prepare_job();
+  bench (jobs.search_jobs[scan_params.n_steps]);
+  jobs.free_memory();
+}
+
 /*
  * The scores from speed search are usually a bit noisy, so the local maximum from the scores
  * vector is not necessarily the best choice.
@@ -536,10 +550,13 @@ get_clip_locations (const Key& key, const WavData& in_data, int n)
   Random rng (key, 0, Random::Stream::speed_clip);
 
   /* to improve performance, we don't hash all samples but just a few */
-  const vector<float>& samples = in_data.samples();
   vector<float> xsamples;
-  for (size_t p = 0; p < samples.size(); p += rng() % 1000)
-    xsamples.push_back (samples[p]);
+  for (size_t p = 0; p < in_data.n_values(); p += rng() % 1000)
+    {
+      float sample;
+      in_data.get_samples (p, 1, &sample);
+      xsamples.push_back (sample);
+    }
 
   rng.seed (Random::seed_from_hash (xsamples), Random::Stream::speed_clip);
 
@@ -621,8 +638,10 @@ split_jobs (int jobs, int threads)
 }
 
 vector<DetectSpeedResult>
-detect_speed (const vector<Key>& key_list, const WavData& in_data, bool print_results)
+detect_speed (const vector<Key>& key_list, const WavData& in_data, bool print_results, vector<DetectSpeedResult> *speed_prior)
 {
+  ScopedStat stat (Stat::SPEED_DETECT);
+
   vector<DetectSpeedResult> results;
 
   /* typically even for high strength we need at least a few seconds of audio
@@ -671,6 +690,22 @@ detect_speed (const vector<Key>& key_list, const WavData& in_data, bool print_re
     };
   const double scan3_smooth_distance = 20;
   const double speed_sync_threshold = 0.4;
+
+  const SpeedScanParams scan_prior /* replaces first and second pass if we have a speed from the previous chunk */
+    {
+      .seconds        = 50,
+      .step           = scan2.step,
+      .n_steps        = 4,
+    };
+  const double prior_min_quality_factor = 0.5;
+
+  const SpeedScanParams scan_unstretched /* fast path: check if input is not stretched at all */
+    {
+      .seconds        = scan1.seconds,
+      .step           = 1.0001,
+      .n_steps        = 1,
+    };
+  const double unstretched_quality_factor = 2;
   const int    n_best = Params::detect_speed_patient ? 15 : 5;
 
   // SpeedSearch::debug_range (scan1);
@@ -682,6 +717,8 @@ detect_speed (const vector<Key>& key_list, const WavData& in_data, bool print_re
     Key                           key;
     std::unique_ptr<SpeedSearch>  speed_search;
     vector<SpeedSync::Score>      scores;
+    double                        prior_speed = 0;
+    double                        prior_quality = 0;
   };
   vector<KeySpeedSearch> key_speed_search_vec;
   ThreadPool thread_pool;
@@ -722,60 +759,167 @@ detect_speed (const vector<Key>& key_list, const WavData& in_data, bool print_re
       key_speed_search.scores = key_speed_search.speed_search->get_results();
   };
 
-  /* initial search using grid */
-  for (auto& key : key_list)
-    {
-      const double clip_location = get_best_clip_location (key, in_data, scan1.seconds, clip_candidates);
+  /* search around the speed detected for the previous chunk (if available) */
+  vector<Key> grid_keys;
+  vector<DetectSpeedResult> key_results;
 
-      key_speed_search_vec.push_back ({key, std::make_unique<SpeedSearch> (in_data, clip_location), {}});
-    }
-  run_search (scan1, [] (auto& key_speed_search) -> vector<double>
+  auto refine_best = [&]()
     {
-      return { 1.0 };
-    });
+      /* improve best match */
+      for (auto& key_speed_search : key_speed_search_vec)
+        select_n_best_scores (key_speed_search.scores, 1);
 
-  /* improve N best matches */
-  run_search (scan2, [n_best] (auto& key_speed_search) -> vector<double>
+      run_search (scan3, [] (auto& key_speed_search) -> vector<double>
+        {
+          return { key_speed_search.scores[0].speed };
+        });
+    };
+  auto find_best = [&] (const KeySpeedSearch& key_speed_search)
     {
-      select_n_best_scores (key_speed_search.scores, n_best);
+      DetectSpeedResult result;
+      result.key = key_speed_search.key;
+      result.speed = score_smooth_find_best (key_speed_search.scores, 1 - scan3.step, scan3_smooth_distance);
 
-      vector<double> speeds;
       for (auto score : key_speed_search.scores)
-        speeds.push_back (score.speed);
-
-      return speeds;
-    });
+        result.quality = max (result.quality, score.quality);
+      return result;
+    };
 
-  /* improve best match */
-  for (auto& key_speed_search : key_speed_search_vec)
-    select_n_best_scores (key_speed_search.scores, 1);
+  for (auto& key : key_list)
+    {
+      const DetectSpeedResult *prior = nullptr;
+      if (speed_prior)
+        {
+          for (const auto& p : *speed_prior)
+            if (p.key == key)
+              prior = &p;
+        }
+      if (prior)
+        {
+          const double clip_location = get_best_clip_location (key, in_data, scan_prior.seconds, clip_candidates);
 
-  run_search (scan3, [] (auto& key_speed_search) -> vector<double>
+          key_speed_search_vec.push_back ({key, std::make_unique<SpeedSearch> (in_data, clip_location), {}, prior->speed, prior->quality});
+        }
+      else
+        {
+          grid_keys.push_back (key);
+        }
+    }
+  if (!key_speed_search_vec.empty())
     {
-      return { key_speed_search.scores[0].speed };
-    });
+      run_search (scan_prior, [] (auto& key_speed_search) -> vector<double>
+        {
+          return { key_speed_search.prior_speed };
+        });
+      refine_best();
+
+      for (auto& key_speed_search : key_speed_search_vec)
+        {
+          DetectSpeedResult result = find_best (key_speed_search);
+
+          /* fall back to full grid search if the prior speed doesn't work well for this chunk */
+          if (result.quality > max (speed_sync_threshold, key_speed_search.prior_quality * prior_min_quality_factor))
+            key_results.push_back (result);
+          else
+            grid_keys.push_back (key_speed_search.key);
+        }
+      key_speed_search_vec.clear();
+    }
 
-  for (auto& key_speed_search : key_speed_search_vec)
+  /* initial search using grid */
+  for (auto& key : grid_keys)
     {
-      double best_speed = score_smooth_find_best (key_speed_search.scores, 1 - scan3.step, scan3_smooth_distance);
+      const double clip_location = get_best_clip_location (key, in_data, scan1.seconds, clip_candidates);
 
-      double best_quality = 0;
-      for (auto score : key_speed_search.scores)
-        best_quality = max (best_quality, score.quality);
+      key_speed_search_vec.push_back ({key, std::make_unique<SpeedSearch> (in_data, clip_location), {}});
+    }
+
+  /* most files are not stretched at all: skip grid search if sync quality for speed 1.0 is high
+   *
+   * this is not done in patient mode, which should find small stretches (like 0.05%) reliably
+   */
+  if (!key_speed_search_vec.empty() && !Params::detect_speed_patient)
+    {
+      run_search (scan_unstretched, [] (auto& key_speed_search) -> vector<double>
+        {
+          return { 1.0 };
+        });
 
-      if (print_results)
+      vector<KeySpeedSearch> stretched_vec;
+      for (auto& key_speed_search : key_speed_search_vec)
         {
-          double delta = -1;
-          if (Params::test_speed > 0)
-            delta = 100 * fabs (best_speed - Params::test_speed) / Params::test_speed;
-          printf ("detect_speed %f %f %.4f\n", best_speed, best_quality, delta);
+          /* only accept if 1.0 is better than its neighbours (otherwise there may be a small stretch) */
+          double quality = 0, best_speed = 0;
+          for (auto score : key_speed_search.scores)
+            {
+              if (score.quality > quality)
+                {
+                  quality = score.quality;
+                  best_speed = score.speed;
+                }
+            }
+          if (quality > speed_sync_threshold * unstretched_quality_factor && fabs (best_speed - 1.0) < (scan_unstretched.step - 1) / 2)
+            key_results.push_back ({ key_speed_search.key, 1.0, quality });
+          else
+            stretched_vec.push_back (std::move (key_speed_search));
         }
+      key_speed_search_vec = std::move (stretched_vec);
+    }
+  if (!key_speed_search_vec.empty())
+    {
+      run_search (scan1, [] (auto& key_speed_search) -> vector<double>
+        {
+          return { 1.0 };
+        });
+
+      /* improve N best matches */
+      run_search (scan2, [n_best] (auto& key_speed_search) -> vector<double>
+        {
+          select_n_best_scores (key_speed_search.scores, n_best);
+
+          vector<double> speeds;
+          for (auto score : key_speed_search.scores)
+            speeds.push_back (score.speed);
+
+          return speeds;
+        });
 
-      if (best_quality > speed_sync_threshold)
+      refine_best();
+
+      for (auto& key_speed_search : key_speed_search_vec)
+        key_results.push_back (find_best (key_speed_search));
+    }
+
+  /* report results in key_list order */
+  for (auto& key : key_list)
+    {
+      for (const auto& result : key_results)
         {
-          // speeds closer to 1.0 than this usually work without stretching before decode
-          if (best_speed < 0.9999 || best_speed > 1.0001)
-            results.push_back ({ key_speed_search.key, best_speed });
+          if (!(result.key == key))
+            continue;
+
+          if (print_results)
+            {
+              double delta = -1;
+              if (Params::test_speed > 0)
+                delta = 100 * fabs (result.speed - Params::test_speed) / Params::test_speed;
+              printf ("detect_speed %f %f %.4f\n", result.speed, result.quality, delta);
+            }
+
+          if (result.quality > speed_sync_threshold)
+            {
+              if (speed_prior)
+                {
+                  auto it = std::find_if (speed_prior->begin(), speed_prior->end(), [&] (const auto& p) { return p.key == key; });
+                  if (it != speed_prior->end())
+                    *it = result;
+                  else
+                    speed_prior->push_back (result);
+                }
+              // speeds closer to 1.0 than this usually work without stretching before decode
+              if (result.speed < 0.9999 || result.speed > 1.0001)
+                results.push_back (result);
+            }
         }
     }
   return results;
@@ -18,6 +18,8 @@
 #ifndef AUDIOWMARK_WM_SPEED_HH
 #define AUDIOWMARK_WM_SPEED_HH
 
+#include <functional>
+
 #include "wavdata.hh"
 #include "random.hh"
 
@@ -25,8 +27,25 @@ struct DetectSpeedResult
 {
   Key key;
   double speed = 0;
+  double quality = 0;
 };
 
-std::vector<DetectSpeedResult> detect_speed (const std::vector<Key>& key_list, const WavData& in_data, bool print_results);
+/*
+ * If speed_prior is not null, it is used to carry speed detection results from
+ * one chunk to the next chunk. Keys that have a prior are only searched in a
+ * small range around the prior speed; the full grid search is only used if
+ * the quality of this narrow search drops. After the search, speed_prior is
+ * updated with the results of this call.
+ */
+std::vector<DetectSpeedResult> detect_speed (const std::vector<Key>& key_list, const WavData& in_data, bool print_results,
+                                             std::vector<DetectSpeedResult> *speed_prior = nullptr);
+
+/*
+ * Microbenchmark support (benchkernels): prepares the speed search data for one
+ * key and calls bench with a function that runs SpeedSync::compare for one
+ * relative speed, so that only the comparison is timed.
+ */
+void speed_sync_compare_bench (const Key& key, const WavData& in_data,
+                               const std::function<void (const std::function<void()>&)>& bench);
 
 #endif /* AUDIOWMARK_WM_SPEED_HH */
@@ -8,6 +8,7 @@ OUT_WAV=block-decoder-test-out.wav
 audiowmark test-gen-noise $IN_WAV 200 44100
 audiowmark_add $IN_WAV $OUT_WAV $TEST_MSG
 audiowmark_cmp --expect-matches 5 $OUT_WAV $TEST_MSG
+audiowmark_cmp --expect-matches 5 --sample-storage int16 $OUT_WAV $TEST_MSG
 
 check_length $IN_WAV $OUT_WAV
 
@@ -12,6 +12,7 @@ audiowmark_cmp --expect-matches 1 $OUT_WAV $TEST_MSG
 # cut 1 second 300 samples
 audiowmark cut-start $OUT_WAV $CUT_WAV 44300
 audiowmark_cmp --expect-matches 1 $CUT_WAV $TEST_MSG
+audiowmark_cmp --expect-matches 1 --sample-storage int16 $CUT_WAV $TEST_MSG
 
 rm $IN_WAV $OUT_WAV $CUT_WAV
 exit 0
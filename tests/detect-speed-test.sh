@@ -7,13 +7,34 @@ OUT_WAV=detect-speed-test-out.wav
 OUTS_WAV=detect-speed-test-out-spd.wav
 
 audiowmark test-gen-noise detect-speed-test.wav 30 44100
-for SPEED in 0.9764 1.0 1.01
+for SPEED in 0.9764 0.999 1.0 1.001 1.01
 do
   audiowmark_add $IN_WAV $OUT_WAV $TEST_MSG
   audiowmark test-change-speed $OUT_WAV $OUTS_WAV $SPEED
   audiowmark_cmp $OUTS_WAV $TEST_MSG --detect-speed --test-speed $SPEED
   audiowmark_cmp $OUTS_WAV $TEST_MSG --detect-speed-patient --test-speed $SPEED
+
+  # detected speed must be accurate (the unstretched fast path must not accept small stretches as 1.0)
+  for MODE in --detect-speed --detect-speed-patient
+  do
+    $AUDIOWMARK cmp $OUTS_WAV $TEST_MSG $MODE --test-speed $SPEED | awk '
+      /^detect_speed/ { n++; if ($4 < 0 || $4 > 0.03) bad = 1 }
+      END { exit (n == 0 || bad) }' || die "speed $SPEED not detected accurately with $MODE"
+  done
 done
 
-rm $IN_WAV $OUT_WAV $OUTS_WAV
+# detect_speed with a prior (from the previous chunk): accepted if quality is good, full grid search otherwise
+if [ "x$Q" == "x1" ] && [ -z "$V" ]; then
+  $TOP_BUILDDIR/src/testspeed prior $OUTS_WAV $SPEED > /dev/null || die "testspeed prior failed"
+else
+  $TOP_BUILDDIR/src/testspeed prior $OUTS_WAV $SPEED || die "testspeed prior failed"
+fi
+
+# stats should include speed detection phases
+STATS_JSON=detect-speed-test-stats.json
+audiowmark_cmp $OUTS_WAV $TEST_MSG --detect-speed --stats json --stats-file $STATS_JSON
+grep -q '"speed_compare": { "count": [1-9]' $STATS_JSON || die "speed detection missing in stats"
+grep -q '"viterbi": { "count": [1-9]' $STATS_JSON || die "viterbi decoding missing in stats"
+
+rm $IN_WAV $OUT_WAV $OUTS_WAV $STATS_JSON
 exit 0
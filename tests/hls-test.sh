@@ -36,6 +36,68 @@ ffmpeg $FFMPEG_Q -nostdin -y -i $HLS_DIR/as0m/out.m3u8 $HLS_DIR/test-output.wav
 # detect watermark from wav
 audiowmark_cmp --expect-matches 5 $HLS_DIR/test-output.wav $TEST_MSG
 
+# detect watermark directly from the hls playlist
+if [ "x$Q" == "x1" ] && [ -z "$V" ]; then
+  CMP_HLS_OUT="/dev/null"
+else
+  CMP_HLS_OUT="/dev/stdout"
+fi
+$AUDIOWMARK --strict cmp-hls --expect-matches 5 $HLS_DIR/as0m/out.m3u8 $TEST_MSG > $CMP_HLS_OUT || die "failed to detect watermark from hls playlist"
+
+# raw context: hls-add must produce the same output without flac decoding
+audiowmark hls-prepare --context raw $HLS_DIR/as0 $HLS_DIR/as0raw out.m3u8 $HLS_DIR/test-input.wav
+audiowmark hls-add $HLS_DIR/as0raw/out1.ts $HLS_DIR/test-raw-out1.ts $TEST_MSG
+cmp -s $HLS_DIR/as0m/out1.ts $HLS_DIR/test-raw-out1.ts || die "hls-add output for raw context differs"
+rm $HLS_DIR/test-raw-out1.ts
+
+# A/B segment variants: deliver a stream for viewer id bits "10"
+audiowmark hls-prepare-ab --ab-bits 2 $HLS_DIR/as0prep $HLS_DIR/as0ab out.m3u8
+mkdir -p $HLS_DIR/as0v
+for i in $(cd $HLS_DIR/as0; ls out*.ts)
+do
+  BIT_INDEX=$(grep "\"name\": \"$i\"" $HLS_DIR/as0ab/manifest.json | sed 's/.*"bit_index": \([0-9]*\).*/\1/')
+  cp $HLS_DIR/as0ab/$((1 - BIT_INDEX))/$i $HLS_DIR/as0v/$i
+done
+cp $HLS_DIR/as0/out.m3u8 $HLS_DIR/as0v/out.m3u8
+ffmpeg $FFMPEG_Q -nostdin -y -i $HLS_DIR/as0v/out.m3u8 $HLS_DIR/test-output-ab.wav
+
+AB_BITS=$($AUDIOWMARK get-ab --ab-bits 2 $HLS_DIR/test-output-ab.wav | grep ^ab_bits) || die "failed to retrieve A/B payload"
+[ "x$AB_BITS" == "xab_bits 10" ] || die "A/B payload mismatch: $AB_BITS"
+$AUDIOWMARK get-ab --ab-bits 2 $HLS_DIR/test-output-ab.wav | grep -q ^ab_payload && die "A/B payload printed as hex for 2 bits"
+
+# incremental hls-prepare: the first run only sees the first three segments of the playlist
+sed '/^out2.ts$/q' $HLS_DIR/as0/out.m3u8 > $HLS_DIR/as0/live.m3u8
+audiowmark hls-prepare --bit-rate 192000 --state $HLS_DIR/live.state $HLS_DIR/as0 $HLS_DIR/as0inc live.m3u8 $HLS_DIR/test-input.wav
+[ -f $HLS_DIR/as0inc/out3.ts ] && die "incremental hls-prepare processed segment that is not in the playlist"
+cp $HLS_DIR/as0/out.m3u8 $HLS_DIR/as0/live.m3u8
+audiowmark hls-prepare --bit-rate 192000 --state $HLS_DIR/live.state $HLS_DIR/as0 $HLS_DIR/as0inc live.m3u8 $HLS_DIR/test-input.wav
+cmp -s $HLS_DIR/as0/live.m3u8 $HLS_DIR/as0inc/live.m3u8 || die "incremental hls-prepare playlist differs"
+audiowmark hls-prepare --bit-rate 192000 $HLS_DIR/as0 $HLS_DIR/as0full out.m3u8 $HLS_DIR/test-input.wav
+for i in $(cd $HLS_DIR/as0; ls out*.ts)
+do
+  cmp -s $HLS_DIR/as0full/$i $HLS_DIR/as0inc/$i || die "incremental hls-prepare output differs for $i"
+done
+rm $HLS_DIR/as0/live.m3u8 $HLS_DIR/as0inc/live.m3u8 $HLS_DIR/live.state
+
+# incremental hls-prepare with a sliding window playlist: the second run no longer sees the first two segments
+sed '/^out2.ts$/q' $HLS_DIR/as0/out.m3u8 > $HLS_DIR/as0/live.m3u8
+audiowmark hls-prepare --bit-rate 192000 --state $HLS_DIR/live.state $HLS_DIR/as0 $HLS_DIR/as0win live.m3u8 $HLS_DIR/test-input.wav
+awk '/^#EXT-X-MEDIA-SEQUENCE:/ { print "#EXT-X-MEDIA-SEQUENCE:2"; next }
+     /^#EXTINF/ { extinf = $0; next }
+     /^[^#]/ { if (n++ >= 2) { print extinf; print $0 }; next }
+     { print }' $HLS_DIR/as0/out.m3u8 > $HLS_DIR/as0/live.m3u8
+audiowmark hls-prepare --bit-rate 192000 --state $HLS_DIR/live.state $HLS_DIR/as0 $HLS_DIR/as0win live.m3u8 $HLS_DIR/test-input.wav
+cmp -s $HLS_DIR/as0/live.m3u8 $HLS_DIR/as0win/live.m3u8 || die "sliding window hls-prepare playlist differs"
+for i in $(cd $HLS_DIR/as0; ls out*.ts)
+do
+  cmp -s $HLS_DIR/as0full/$i $HLS_DIR/as0win/$i || die "sliding window hls-prepare output differs for $i"
+done
+rm $HLS_DIR/as0/live.m3u8 $HLS_DIR/as0win/live.m3u8 $HLS_DIR/live.state
+
+rm $HLS_DIR/as0ab/[01]/*.ts
+rm $HLS_DIR/as0ab/[01]/out.m3u8
+rmdir $HLS_DIR/as0ab/[01]
+rm $HLS_DIR/as0ab/manifest.json
 rm $HLS_DIR/as0*/*.ts
 rm $HLS_DIR/as0*/out.m3u8
 rmdir $HLS_DIR/as0*
@@ -0,0 +1,48 @@
+#!/bin/bash
+
+source test-common.sh
+
+if [ "x$Q" == "x1" ] && [ -z "$V" ]; then
+  FFMPEG_Q="-v quiet"
+  TEST_OUT="/dev/null"
+else
+  TEST_OUT="/dev/stdout"
+fi
+
+IN_WAV=mp3-fast-open-test.wav
+XING_MP3=mp3-fast-open-test-xing.mp3
+NOXING_MP3=mp3-fast-open-test-noxing.mp3
+VBRI_MP3=mp3-fast-open-test-vbri.mp3
+OUT_WAV=mp3-fast-open-test-out.wav
+FAST_OUT_WAV=mp3-fast-open-test-fast-out.wav
+
+audiowmark test-gen-noise $IN_WAV 60 44100
+audiowmark_add $IN_WAV $IN_WAV.wm.wav $TEST_MSG
+
+# Xing/Info header (length known), no header (streamed), VBRI header (length not used by mpg123, streamed)
+ffmpeg $FFMPEG_Q -nostdin -y -i $IN_WAV.wm.wav -c:a libmp3lame -b:a 128k $XING_MP3 || die "failed to encode $XING_MP3"
+ffmpeg $FFMPEG_Q -nostdin -y -i $IN_WAV.wm.wav -c:a libmp3lame -b:a 128k -write_xing 0 $NOXING_MP3 || die "failed to encode $NOXING_MP3"
+$TOP_BUILDDIR/src/testmp3 add-vbri $NOXING_MP3 $VBRI_MP3 > $TEST_OUT || die "failed to add vbri header to $NOXING_MP3"
+
+for MP3_LENGTH in "$XING_MP3 known" "$NOXING_MP3 unknown" "$VBRI_MP3 unknown"
+do
+  set -- $MP3_LENGTH
+  MP3=$1
+
+  # decoded samples must be the same as with a full scan
+  $TOP_BUILDDIR/src/testmp3 fast-open $MP3 $2 > $TEST_OUT || die "fast open of $MP3 differs from full scan"
+
+  # get
+  GET_OUT=$($AUDIOWMARK get $MP3) || die "failed to run audiowmark get $MP3"
+  FAST_GET_OUT=$($AUDIOWMARK --mp3-fast-open get $MP3) || die "failed to run audiowmark --mp3-fast-open get $MP3"
+  [ "x$GET_OUT" == "x$FAST_GET_OUT" ] || die "get result for $MP3 with --mp3-fast-open differs from full scan"
+  audiowmark_cmp --mp3-fast-open $MP3 $TEST_MSG
+
+  # add
+  audiowmark_add $MP3 $OUT_WAV $TEST_MSG
+  audiowmark_add --mp3-fast-open $MP3 $FAST_OUT_WAV $TEST_MSG
+  cmp -s $OUT_WAV $FAST_OUT_WAV || die "add result for $MP3 with --mp3-fast-open differs from full scan"
+done
+
+rm $IN_WAV $IN_WAV.wm.wav $XING_MP3 $NOXING_MP3 $VBRI_MP3 $OUT_WAV $FAST_OUT_WAV
+exit 0
@@ -0,0 +1,43 @@
+#!/bin/bash
+
+source test-common.sh
+
+if [ "x$Q" == "x1" ] && [ -z "$V" ]; then
+  FFMPEG_Q="-v quiet"
+  TEST_OUT="/dev/null"
+else
+  TEST_OUT="/dev/stdout"
+fi
+
+IN_WAV=parallel-decode-test.wav
+IN_FLAC=parallel-decode-test.flac
+CUT_FLAC=parallel-decode-test-cut.flac
+
+# 60 seconds (2646000 frames) are decoded as several ranges of 256k frames
+audiowmark test-gen-noise $IN_WAV 60 44100
+ffmpeg $FFMPEG_Q -nostdin -y -i $IN_WAV $IN_FLAC || die "failed to encode $IN_FLAC"
+
+# parallel decoding must produce the same samples as serial decoding
+$TOP_BUILDDIR/src/teststream parallel $IN_FLAC > $TEST_OUT || die "parallel decoding of $IN_FLAC failed"
+
+# truncated file: the header length is wrong, so ranges after the real end are short or fail
+head -c $(($(stat -c %s $IN_FLAC) * 2 / 5)) $IN_FLAC > $CUT_FLAC
+$TOP_BUILDDIR/src/teststream parallel $CUT_FLAC > $TEST_OUT || die "parallel decoding of truncated $CUT_FLAC failed"
+
+# get uses parallel decoding for large flac files, and should still work for truncated files
+audiowmark_add $IN_WAV $IN_FLAC.wm.wav $TEST_MSG
+ffmpeg $FFMPEG_Q -nostdin -y -i $IN_FLAC.wm.wav $IN_FLAC || die "failed to encode $IN_FLAC"
+head -c $(($(stat -c %s $IN_FLAC) * 4 / 5)) $IN_FLAC > $CUT_FLAC
+audiowmark_cmp $CUT_FLAC $TEST_MSG
+
+# mp3: seeking must be sample exact (frames before the seek position are decoded again),
+# also for low bit rates where the bit reservoir reaches back over several frames
+IN_MP3=parallel-decode-test.mp3
+for MP3_OPTS in "-b:a 128k" "-b:a 32k -ar 22050" "-q:a 9 -ar 16000 -ac 1" "-q:a 7"
+do
+  ffmpeg $FFMPEG_Q -nostdin -y -i $IN_WAV -c:a libmp3lame $MP3_OPTS $IN_MP3 || die "failed to encode $IN_MP3 ($MP3_OPTS)"
+  $TOP_BUILDDIR/src/testmp3 parallel $IN_MP3 > $TEST_OUT || die "parallel decoding of $IN_MP3 ($MP3_OPTS) differs from serial decoding"
+done
+
+rm $IN_WAV $IN_FLAC $IN_FLAC.wm.wav $CUT_FLAC $IN_MP3
+exit 0
@@ -0,0 +1,29 @@
+#!/bin/bash
+
+source test-common.sh
+
+if [ "x$Q" == "x1" ] && [ -z "$V" ]; then
+  FFMPEG_Q="-v quiet"
+fi
+
+VIDEO_DIR=video-test-dir.$$
+mkdir -p $VIDEO_DIR
+
+# generate input sample: noise audio with a small lavfi test video
+audiowmark test-gen-noise $VIDEO_DIR/test-input.wav 60 44100
+ffmpeg $FFMPEG_Q -nostdin -f lavfi -i testsrc=size=160x120:rate=10 -i $VIDEO_DIR/test-input.wav \
+  -map 0:v -map 1:a -c:v mpeg4 -c:a aac -ab 192k -shortest $VIDEO_DIR/test-input.mkv
+
+# watermark audio stream, copy video stream
+audiowmark video-add $VIDEO_DIR/test-input.mkv $VIDEO_DIR/test-output.mkv $TEST_MSG
+
+# output must still contain one video and one audio stream
+ffprobe -v quiet -show_entries stream=codec_type -of csv=p=0 $VIDEO_DIR/test-output.mkv | sort | tr '\n' ' ' | grep -q "^audio video $" || die "video-add output has unexpected streams"
+
+# detect watermark from the audio stream of the video
+$AUDIOWMARK video-get $VIDEO_DIR/test-output.mkv | grep -q "$TEST_MSG" || die "failed to detect watermark from video"
+
+rm $VIDEO_DIR/test-input.wav $VIDEO_DIR/test-input.mkv $VIDEO_DIR/test-output.mkv
+rmdir $VIDEO_DIR
+
+exit 0
@@ -63,4 +63,19 @@ do
   compare_fmt_snr $FMT_WAV $MARK_WAV 32.3
 done
 
+# mmap wav reader must produce the same samples as libsndfile, including RF64 (ds64) and WAVE_FORMAT_EXTENSIBLE files
+for FMT in $(testwavformat list)
+do
+  for CONTAINER in wav rf64 wavex
+  do
+    testwavformat convert $IN_WAV $FMT_WAV $FMT $CONTAINER
+    testwavformat compare-mmap $FMT_WAV > /dev/null
+  done
+done
+
+# finalized wav file with an empty data chunk followed by other chunks
+testwavformat gen-empty-data $FMT_WAV
+EMPTY_FRAMES=$(testwavformat compare-mmap $FMT_WAV | awk '{print $(NF-1)}')
+[ "x$EMPTY_FRAMES" == "x0" ] || die "empty data chunk: expected 0 frames, got $EMPTY_FRAMES"
+
 rm $IN_WAV $FMT_WAV $MARK_WAV